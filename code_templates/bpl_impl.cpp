@@ -866,6 +866,17 @@ namespace autotelica {
         std::vector<std::string> _extensions_to_ignore;
         std::vector<std::string> _files_to_ignore;
         std::vector<std::string> _paths_to_ignore;
+        // every path is checked against the ignore lists, so they are compiled into wildcard sets once
+        wildcard_set _extension_patterns;
+        wildcard_set _file_patterns;
+
+        void compile_ignore_patterns() {
+            for (auto const& pattern : _extensions_to_ignore)
+                _extension_patterns.add(pattern);
+            // we want to be portable, so normalise file separators
+            for (auto const& pattern : _files_to_ignore)
+                _file_patterns.add(replace(pattern, "\\", "/"));
+        }
 
         inline bool has(std::vector<std::string> const& v, std::string const& s) {
             // just to make lots of lines shorter
@@ -886,33 +897,22 @@ namespace autotelica {
             }
             // is it ignored by extension?
             auto extension = to_lower(target_path.extension().string());
-            if (!extension.empty() && !_extensions_to_ignore.empty()) {
+            if (!extension.empty() && !_extension_patterns.empty()) {
                 // wildcard matching works with equality too
-                for (auto const& pattern : _extensions_to_ignore) {
-                    if (wildcard_match(extension, pattern)) {
-                        cache_path_to_ignore(path_s);
-                        return true;
-                    }
-                    // in case people specified extensions to ignore including dots at the start
-                    if (extension[0] == '.') {
-                        auto const shorter = extension.substr(1);
-                        if (wildcard_match(shorter, pattern)) {
-                            cache_path_to_ignore(path_s);
-                            return true;
-                        }
-                    }
+                // the extension comes with a dot, people may or may not have specified extensions to ignore with one
+                if (_extension_patterns.match(extension) ||
+                    (extension[0] == '.' && _extension_patterns.match(extension.c_str() + 1, extension.size() - 1))) {
+                    cache_path_to_ignore(path_s);
+                    return true;
                 }
             }
             // is it ignored by filename?
-            if (!_files_to_ignore.empty()) {
+            if (!_file_patterns.empty()) {
                 // we want to be portable, so normalise file separators
                 auto const norm_path = replace(to_lower(target_path.string()), "\\", "/");
-                for (auto const& pattern : _files_to_ignore) {
-                    auto const norm_pattern = replace(pattern, "\\", "/");
-                    if (wildcard_match(norm_path, norm_pattern)) {
-                        cache_path_to_ignore(path_s);
-                        return true;
-                    }
+                if (_file_patterns.match(norm_path)) {
+                    cache_path_to_ignore(path_s);
+                    return true;
                 }
             }
             // well, we tried what we could
@@ -1006,6 +1006,7 @@ namespace autotelica {
                 csv_to_vector(to_lower(extensions_to_ignore_), _extensions_to_ignore);
             if (!files_to_ignore_.empty())
                 csv_to_vector(to_lower(files_to_ignore_), _files_to_ignore);
+            compile_ignore_patterns();
         }
 
         bpl_impl(
@@ -1019,6 +1020,7 @@ namespace autotelica {
             _strict = strict_;
             csv_to_vector(to_lower(extensions_to_ignore_), _extensions_to_ignore);
             csv_to_vector(to_lower(files_to_ignore_), _files_to_ignore);
+            compile_ignore_patterns();
 
             _source_path = path_t(source_path_).make_preferred();
             _target_path = path_t(target_path_).make_preferred();
@@ -1044,6 +1046,7 @@ namespace autotelica {
             _strict = strict_;
             csv_to_vector(to_lower(extensions_to_ignore_), _extensions_to_ignore);
             csv_to_vector(to_lower(files_to_ignore_), _files_to_ignore);
+            compile_ignore_patterns();
 
             _source_path = path_t(source_path_).make_preferred();
             _target_path = path_t(target_path_).make_preferred();
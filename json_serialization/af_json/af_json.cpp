@@ -0,0 +1,11 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "af_json.h"
+#include "af_json_types.h"
+
+int main(int argc, const char* argv[])
+{
+	using namespace autotelica::af_json;
+	register_types(describer_t::instance());
+	return run(argc, argv);
+}
@@ -0,0 +1,396 @@
+#pragma once
+// af_json: command line tool for big JSON files
+// everything streams through the SAX reader with fixed size buffers,
+// so memory use doesn't depend on the size of the input
+#include "json_serialization.h"
+#include "autotelica_core/util/include/cl_parsing.h"
+#include "autotelica_core/util/include/timing.h"
+#include "autotelica_core/util/include/std_pretty_printing.h"
+#include <cstdio>
+#include <map>
+#include <vector>
+#include <functional>
+
+namespace autotelica {
+	namespace af_json {
+		static const size_t buffer_size = 65536;
+
+		// a file, or stdin/stdout when the path is "-"
+		class file_t {
+			FILE* _fp;
+			bool const _owned;
+		public:
+			file_t(std::string const& path_, bool reading_) :
+				_fp(nullptr),
+				_owned(path_ != "-") {
+				if (!_owned)
+					_fp = reading_ ? stdin : stdout;
+				else
+					_fp = fopen(path_.c_str(), reading_ ? "rb" : "wb");
+				AF_ASSERT(_fp, "Failed to open %.", path_);
+			}
+			~file_t() {
+				if (_owned)
+					fclose(_fp);
+				else
+					fflush(_fp);
+			}
+			file_t(file_t const&) = delete;
+			file_t& operator=(file_t const&) = delete;
+
+			inline FILE* get() const { return _fp; }
+		};
+
+		// JSON pointer (RFC 6901), split into reference tokens
+		class json_pointer_t {
+			std::vector<std::string> _tokens;
+			std::vector<size_t> _indices;// tokens as array indices, npos when they are not numbers
+		public:
+			static const size_t npos = size_t(-1);
+
+			json_pointer_t(std::string const& pointer_) {
+				AF_ASSERT(pointer_.empty() || pointer_[0] == '/', "JSON pointer % has to start with /.", pointer_);
+				if (pointer_.empty())
+					return;
+				std::string token;
+				for (size_t i = 1; i <= pointer_.size(); ++i) {
+					if (i == pointer_.size() || pointer_[i] == '/') {
+						add(token);
+						token.clear();
+					}
+					else if (pointer_[i] == '~') {
+						AF_ASSERT(i + 1 < pointer_.size() && (pointer_[i + 1] == '0' || pointer_[i + 1] == '1'),
+							"Bad escape in JSON pointer %.", pointer_);
+						token += (pointer_[++i] == '0') ? '~' : '/';
+					}
+					else
+						token += pointer_[i];
+				}
+			}
+
+			inline void add(std::string const& token_) {
+				size_t index = token_.empty() ? npos : 0;
+				for (char c : token_) {
+					if (c < '0' || c > '9') {
+						index = npos;
+						break;
+					}
+					index = index * 10 + static_cast<size_t>(c - '0');
+				}
+				_tokens.push_back(token_);
+				_indices.push_back(index);
+			}
+			inline size_t size() const { return _tokens.size(); }
+			inline std::string const& token(size_t i_) const { return _tokens[i_]; }
+			inline size_t index(size_t i_) const { return _indices[i_]; }
+		};
+
+		// SAX handler that passes on to handler_ only the value at a JSON pointer
+		// only the path down to the current value is kept, one frame per level of nesting
+		// parsing is stopped once the value is passed on, unless stop_when_found_ is false
+		// (validation needs to see the whole document)
+		template<typename handler_t>
+		class pointer_filter_t {
+			using char_t = char;
+			struct frame_t {
+				bool _array;
+				bool _on_path;			// the container itself is on the pointer path
+				bool _element_on_path;	// and so is its current element
+				size_t _index;
+			};
+			json_pointer_t const& _pointer;
+			handler_t& _handler;
+			bool const _stop_when_found;
+			std::vector<frame_t> _frames;
+			size_t _passing;// nesting level inside the value we are passing on, 0 when not passing
+			bool _found;
+
+			// called for every value that is not passed on already, tells if it is the one
+			bool is_target() {
+				if (_frames.empty())
+					return _pointer.size() == 0;
+				auto& frame = _frames.back();
+				if (frame._array) {
+					++frame._index;
+					frame._element_on_path = frame._on_path &&
+						_pointer.index(_frames.size() - 1) == frame._index;
+				}
+				return frame._element_on_path && _frames.size() == _pointer.size();
+			}
+			inline bool found() {
+				_found = true;
+				return !_stop_when_found;
+			}
+			template<typename f_t>
+			inline bool scalar(f_t const& f_) {
+				if (_passing)
+					return f_();
+				if (is_target())
+					return f_() && found();
+				return true;
+			}
+			template<typename f_t>
+			inline bool start(bool array_, f_t const& f_) {
+				if (_passing) {
+					++_passing;
+					return f_();
+				}
+				if (is_target()) {
+					_passing = 1;
+					return f_();
+				}
+				bool on_path = (_frames.empty() || _frames.back()._element_on_path) &&
+					_frames.size() < _pointer.size();
+				_frames.push_back({ array_, on_path, false, json_pointer_t::npos });
+				return true;
+			}
+			template<typename f_t>
+			inline bool end(f_t const& f_) {
+				if (_passing) {
+					if (!f_())
+						return false;
+					return (--_passing) ? true : found();
+				}
+				_frames.pop_back();
+				return true;
+			}
+		public:
+			pointer_filter_t(json_pointer_t const& pointer_, handler_t& handler_, bool stop_when_found_ = true) :
+				_pointer(pointer_),
+				_handler(handler_),
+				_stop_when_found(stop_when_found_),
+				_passing(0),
+				_found(false) {
+			}
+
+			inline bool has_found() const { return _found; }
+
+			bool Null() { return scalar([&]() { return _handler.Null(); }); }
+			bool Bool(bool b) { return scalar([&]() { return _handler.Bool(b); }); }
+			bool Int(int i) { return scalar([&]() { return _handler.Int(i); }); }
+			bool Uint(unsigned i) { return scalar([&]() { return _handler.Uint(i); }); }
+			bool Int64(int64_t i) { return scalar([&]() { return _handler.Int64(i); }); }
+			bool Uint64(uint64_t i) { return scalar([&]() { return _handler.Uint64(i); }); }
+			bool Double(double d) { return scalar([&]() { return _handler.Double(d); }); }
+			bool RawNumber(const char_t* str, rapidjson::SizeType length, bool copy) {
+				return scalar([&]() { return _handler.RawNumber(str, length, copy); });
+			}
+			bool String(const char_t* str, rapidjson::SizeType length, bool copy) {
+				return scalar([&]() { return _handler.String(str, length, copy); });
+			}
+			bool StartObject() { return start(false, [&]() { return _handler.StartObject(); }); }
+			bool Key(const char_t* str, rapidjson::SizeType length, bool copy) {
+				if (_passing)
+					return _handler.Key(str, length, copy);
+				auto& frame = _frames.back();
+				size_t level = _frames.size() - 1;
+				frame._element_on_path = frame._on_path &&
+					_pointer.token(level).size() == length &&
+					_pointer.token(level).compare(0, length, str, length) == 0;
+				return true;
+			}
+			bool EndObject(rapidjson::SizeType count) { return end([&]() { return _handler.EndObject(count); }); }
+			bool StartArray() { return start(true, [&]() { return _handler.StartArray(); }); }
+			bool EndArray(rapidjson::SizeType count) { return end([&]() { return _handler.EndArray(count); }); }
+		};
+
+		// numbers are read as text (RawNumber) and written back as they were,
+		// so copying doesn't round big integers or rewrite 1.00 as 1.0
+		static const unsigned parse_flags = rapidjson::kParseNumbersAsStringsFlag;
+		static const unsigned validation_parse_flags = parse_flags | rapidjson::kParseValidateEncodingFlag;
+
+		// rapidjson writers quote raw numbers, this one writes them unquoted
+		template<typename base_writer_t>
+		class raw_number_writer_t : public base_writer_t {
+		public:
+			using char_t = typename base_writer_t::Ch;
+			using base_writer_t::base_writer_t;
+
+			bool RawNumber(const char_t* str, rapidjson::SizeType length, bool /*copy*/) {
+				return base_writer_t::RawValue(str, length, rapidjson::kNumberType);
+			}
+		};
+
+		// reads JSON from in_ into handler_, validating against schema_ when there is one
+		// returns the number of bytes read
+		// schema validation checks numbers by value, so they are parsed (and written back as parsed) then
+		template<unsigned parse_flags_v = parse_flags, typename handler_t>
+		size_t read(FILE* in_, handler_t& handler_, json::schema_p<> schema_ = nullptr) {
+			std::vector<char> buffer(buffer_size);
+			rapidjson::FileReadStream stream(in_, buffer.data(), buffer.size());
+			if (schema_)
+				schema_->parse_with_validation(stream, handler_);
+			else {
+				rapidjson::Reader reader;
+				// handlers stop the parsing on purpose when they have what they need
+				if (!reader.Parse<parse_flags_v>(stream, handler_) &&
+					reader.GetParseErrorCode() != rapidjson::kParseErrorTermination)
+					json::impl::report_parsing_error(reader);
+			}
+			return stream.Tell();
+		}
+
+		// runs f_ with a compact or pretty rapidjson writer to out_
+		template<typename f_t>
+		void with_writer(FILE* out_, bool pretty_, f_t const& f_) {
+			std::vector<char> buffer(buffer_size);
+			rapidjson::FileWriteStream stream(out_, buffer.data(), buffer.size());
+			if (pretty_) {
+				raw_number_writer_t<rapidjson::PrettyWriter<rapidjson::FileWriteStream>> writer(stream);
+				f_(writer);
+			}
+			else {
+				raw_number_writer_t<rapidjson::Writer<rapidjson::FileWriteStream>> writer(stream);
+				f_(writer);
+			}
+			stream.Flush();
+		}
+
+		// throughput goes to stderr, so it doesn't mix with JSON written to stdout
+		inline void report(std::string const& command_, size_t bytes_, timing::timer const& timer_) {
+			using namespace autotelica::string_util;
+			double seconds = std::chrono::duration<double>(timer_.period()).count();
+			double mb = static_cast<double>(bytes_) / (1024.0 * 1024.0);
+			var_printf(std::cerr, "%: % bytes in % (% MB/s)\n",
+				command_, bytes_, timing::duration_formatter(timer_.period()),
+				seconds > 0 ? mb / seconds : 0.0);
+		}
+
+		// minify or pretty print
+		inline size_t copy(std::string const& in_, std::string const& out_, bool pretty_, json::schema_p<> schema_ = nullptr) {
+			file_t in(in_, true);
+			file_t out(out_, false);
+			size_t bytes = 0;
+			with_writer(out.get(), pretty_, [&](auto& writer_) {
+				bytes = read(in.get(), writer_, schema_);
+			});
+			return bytes;
+		}
+
+		// well formed (and valid against schema_ if there is one)
+		inline size_t validate(std::string const& in_, json::schema_p<> schema_ = nullptr) {
+			file_t in(in_, true);
+			rapidjson::BaseReaderHandler<> handler;
+			return read<validation_parse_flags>(in.get(), handler, schema_);
+		}
+
+		// writes the value at pointer_
+		inline size_t extract(std::string const& in_, std::string const& pointer_, std::string const& out_, json::schema_p<> schema_ = nullptr) {
+			json_pointer_t pointer(pointer_);
+			file_t in(in_, true);
+			file_t out(out_, false);
+			size_t bytes = 0;
+			bool found = false;
+			with_writer(out.get(), false, [&](auto& writer_) {
+				pointer_filter_t<std::decay_t<decltype(writer_)>> filter(pointer, writer_, !schema_);
+				bytes = read(in.get(), filter, schema_);
+				found = filter.has_found();
+			});
+			AF_ASSERT(found, "Nothing found at %.", pointer_);
+			return bytes;
+		}
+
+		// types that -describe knows about, see af_json_types.h
+		class describer_t {
+			using describe_f_t = std::function<std::string(bool)>;
+			std::map<std::string, describe_f_t> _types;
+		public:
+			static describer_t& instance() {
+				static describer_t _instance;
+				return _instance;
+			}
+
+			template<typename target_t>
+			describer_t& add(std::string const& name_) {
+				_types[name_] = [](bool pretty_) { return json::writer<>::schema_to_string<target_t>(pretty_); };
+				return *this;
+			}
+
+			std::vector<std::string> names() const {
+				std::vector<std::string> out;
+				for (auto const& t : _types)
+					out.push_back(t.first);
+				return out;
+			}
+
+			std::string describe(std::string const& name_, bool pretty_ = true) const {
+				auto it = _types.find(name_);
+				AF_ASSERT(it != _types.end(), "Type % is not registered, known types are %.",
+					name_, std_pretty_printing::pretty_s(names()));
+				return it->second(pretty_);
+			}
+		};
+
+		inline void describe(std::string const& type_, std::string const& out_) {
+			std::string schema = describer_t::instance().describe(type_);
+			file_t out(out_, false);
+			fwrite(schema.data(), 1, schema.size(), out.get());
+		}
+
+		inline int run(int argc_, const char* argv_[]) {
+			using namespace autotelica::cl_parsing;
+			cl_commands commands(
+				"Streaming JSON tool, memory use doesn't depend on the size of the input.\n"
+				"Use - for stdin/stdout. Throughput is reported on stderr.");
+			commands.register_command("minify", "Writes the input without whitespace: -minify <in> <out>",
+				{ "minify", "m" }, 2);
+			commands.register_command("pretty", "Pretty prints the input: -pretty <in> <out>",
+				{ "pretty", "p" }, 2);
+			commands.register_command("validate", "Checks the input is well formed JSON: -validate <in>",
+				{ "validate", "v" }, 1);
+			commands.register_command("extract", "Writes the value at a JSON pointer: -extract <in> <pointer> <out>",
+				{ "extract", "x" }, 3);
+			commands.register_command("describe", "Writes the JSON schema of a registered type: -describe <type> <out>",
+				{ "describe", "d" }, 2);
+			commands.register_command("schema", "Validates the input against a schema file, for all commands that read JSON: -schema <file>",
+				{ "schema", "s" }, 1);
+			try {
+				commands.parse_command_line(argc_, argv_);
+				if (commands.executors().empty()) {
+					commands.help();
+					return 1;
+				}
+				commands.execute();// help
+
+				json::schema_p<> schema;
+				if (commands.has("schema"))
+					schema = json::schema<>::from_file(commands.arguments("schema")[0]);
+
+				timing::timer timer;
+				timer.start();
+				if (commands.has("minify")) {
+					auto const& args = commands.arguments("minify");
+					size_t bytes = copy(args[0], args[1], false, schema);
+					timer.stop();
+					report("minify", bytes, timer);
+				}
+				else if (commands.has("pretty")) {
+					auto const& args = commands.arguments("pretty");
+					size_t bytes = copy(args[0], args[1], true, schema);
+					timer.stop();
+					report("pretty", bytes, timer);
+				}
+				else if (commands.has("validate")) {
+					size_t bytes = validate(commands.arguments("validate")[0], schema);
+					timer.stop();
+					report("validate", bytes, timer);
+				}
+				else if (commands.has("extract")) {
+					auto const& args = commands.arguments("extract");
+					size_t bytes = extract(args[0], args[1], args[2], schema);
+					timer.stop();
+					report("extract", bytes, timer);
+				}
+				else if (commands.has("describe")) {
+					auto const& args = commands.arguments("describe");
+					describe(args[0], args[1]);
+				}
+			}
+			catch (std::exception const& e) {
+				std::cerr << e.what() << std::endl;
+				return 1;
+			}
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#include "autotelica_core/util/include/testing_util.h"
+#include "af_json.h"
+
+namespace af_json_examples {
+    std::string extract(std::string const& json, std::string const& pointer_) {
+        using namespace autotelica::af_json;
+        json_pointer_t pointer(pointer_);
+        rapidjson::StringBuffer sb;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+        pointer_filter_t<rapidjson::Writer<rapidjson::StringBuffer>> filter(pointer, writer);
+        rapidjson::StringStream ss(json.c_str());
+        rapidjson::Reader reader;
+        reader.Parse(ss, filter);
+        return filter.has_found() ? sb.GetString() : "not found";
+    }
+
+    // minify or pretty print through temporary files, the way the tool does it
+    std::string copy(std::string const& json_, bool pretty_) {
+        using namespace autotelica::af_json;
+        FILE* in = tmpfile();
+        FILE* out = tmpfile();
+        fwrite(json_.data(), 1, json_.size(), in);
+        rewind(in);
+        with_writer(out, pretty_, [&](auto& writer_) { read(in, writer_); });
+        rewind(out);
+        std::string copied;
+        char buffer[256];
+        size_t read_count = 0;
+        while ((read_count = fread(buffer, 1, sizeof(buffer), out)) > 0)
+            copied.append(buffer, read_count);
+        fclose(in);
+        fclose(out);
+        return copied;
+    }
+
+    template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+    void examples() {
+        // code here will only be run in example runs
+        using namespace autotelica::diagnostic_messages;
+        const std::string json = R"({"a": 1, "b": [10, {"c": "x"}], "d/e": {"~": true}})";
+        messages::message("Extracting /b/1 from % gives %", json, extract(json, "/b/1"));
+    }
+    template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+    void tests() {
+        // code here will be run in test, examples and record mode
+        const std::string json = R"({"a": 1, "b": [10, {"c": "x"}], "d/e": {"~": true}})";
+        AF_TEST_RESULT(std::string(R"({"a":1,"b":[10,{"c":"x"}],"d/e":{"~":true}})"), extract(json, ""));
+        AF_TEST_RESULT(std::string("1"), extract(json, "/a"));
+        AF_TEST_RESULT(std::string("10"), extract(json, "/b/0"));
+        AF_TEST_RESULT(std::string(R"({"c":"x"})"), extract(json, "/b/1"));
+        AF_TEST_RESULT(std::string(R"("x")"), extract(json, "/b/1/c"));
+        AF_TEST_RESULT(std::string("true"), extract(json, "/d~1e/~0"));
+        AF_TEST_RESULT(std::string("not found"), extract(json, "/b/2"));
+        AF_TEST_RESULT(std::string("not found"), extract(json, "/a/b"));
+
+        AF_TEST_COMMENT("Numbers are copied as they were written.");
+        const std::string numbers = R"({"big": 12345678901234567890123, "numbers": [1.00, 1E2, -0]})";
+        AF_TEST_RESULT(std::string(R"({"big":12345678901234567890123,"numbers":[1.00,1E2,-0]})"), copy(numbers, false));
+        AF_TEST_RESULT(std::string(R"({"big":12345678901234567890123,"numbers":[1.00,1E2,-0]})"), copy(copy(numbers, true), false));
+    }
+}
+
+AF_DECLARE_TEST_SET("af_json tests", af_json, af_json_examples::examples<>(), af_json_examples::tests<>());
@@ -0,0 +1,6 @@
+#include "autotelica_core/util/include/test_runner_impl.h"
+
+int main(int argc, const char* argv[])
+{
+	return autotelica::test_runner_impl::main_impl(argc, argv);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "af_json.h"
+
+// types that af_json -describe knows about
+// include the headers with the type descriptions and add the types here, for example:
+//		describer_.add<my_namespace::my_type>("my_type");
+namespace autotelica {
+	namespace af_json {
+		inline void register_types(describer_t& describer_) {
+		}
+	}
+}
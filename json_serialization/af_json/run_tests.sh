@@ -0,0 +1,3 @@
+#!/bin/sh
+./linux_build/packages/af_json/release/af_json_test -re -errors_only
+
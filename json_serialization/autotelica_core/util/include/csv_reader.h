@@ -0,0 +1,422 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <iterator>
+#include <exception>
+#include <cstring>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "asserts.h"
+#include "string_util.h"
+
+// Streaming csv reader.
+// The file is memory mapped and parsed in place: fields point straight into the mapping,
+// so reading a file does not copy it and does not allocate per field.
+// Quoting follows the rules used by to_csv_row: fields are trimmed, quoted fields may contain
+// commas and newlines, doubled quotes inside quoted fields stand for a single quote and
+// (in excel format) doubled colons stand for a single colon.
+namespace autotelica {
+	namespace csv_reader {
+		// read only memory mapping of a whole file
+		class mapped_file_t {
+			const char* _data = nullptr;
+			size_t _size = 0;
+		public:
+			explicit mapped_file_t(std::string const& path_) {
+#ifdef _WIN32
+				HANDLE file = CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+					OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+				AF_ASSERT(file != INVALID_HANDLE_VALUE, "Failed to open %.", path_);
+				LARGE_INTEGER size;
+				if (GetFileSizeEx(file, &size) && size.QuadPart) {
+					HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+					if (mapping) {
+						_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+						CloseHandle(mapping);
+					}
+					_size = _data ? static_cast<size_t>(size.QuadPart) : 0;
+					CloseHandle(file);
+					AF_ASSERT(_data, "Failed to map %.", path_);
+					return;
+				}
+				CloseHandle(file);
+#else
+				int const fd = ::open(path_.c_str(), O_RDONLY);
+				AF_ASSERT(fd >= 0, "Failed to open %.", path_);
+				struct stat st;
+				if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+					void* const data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+					if (data != MAP_FAILED) {
+						::madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+						_data = static_cast<const char*>(data);
+						_size = static_cast<size_t>(st.st_size);
+					}
+					::close(fd);
+					AF_ASSERT(_data, "Failed to map %.", path_);
+					return;
+				}
+				::close(fd);
+#endif
+			}
+			~mapped_file_t() {
+				if (!_data) return;
+#ifdef _WIN32
+				UnmapViewOfFile(_data);
+#else
+				::munmap(const_cast<char*>(_data), _size);
+#endif
+			}
+			mapped_file_t(mapped_file_t const&) = delete;
+			mapped_file_t& operator=(mapped_file_t const&) = delete;
+
+			const char* data() const { return _data; }
+			size_t size() const { return _size; }
+		};
+
+		namespace csv_reader_impl {
+			inline bool blank(char c_) { return c_ == ' ' || c_ == '\t' || c_ == '\r'; }
+
+			// quotes only open a quoted field at the start of a field, anywhere else they are just text
+			inline bool starts_field(const char* begin_, const char* quote_) {
+				while (quote_ != begin_ && (quote_[-1] == ' ' || quote_[-1] == '\t'))
+					--quote_;
+				return quote_ == begin_ || quote_[-1] == ',' || quote_[-1] == '\n';
+			}
+
+			// moves p_ up to limit_ jumping from quote to quote, keeping track of being inside a quoted field
+			// (the closing quote can be past limit_, in which case p_ ends up past limit_ too)
+			inline void scan_quotes(const char* begin_, const char*& p_, const char* limit_, const char* end_, bool& in_quotes_) {
+				while (p_ < limit_) {
+					if (in_quotes_) {
+						auto const q = static_cast<const char*>(std::memchr(p_, '"', end_ - p_));
+						if (!q) { p_ = end_; return; }
+						if (q + 1 != end_ && q[1] == '"') { p_ = q + 2; continue; }
+						in_quotes_ = false;
+						p_ = q + 1;
+					}
+					else {
+						auto const q = static_cast<const char*>(std::memchr(p_, '"', limit_ - p_));
+						if (!q) { p_ = limit_; return; }
+						in_quotes_ = starts_field(begin_, q);
+						p_ = q + 1;
+					}
+				}
+			}
+
+			// first position after the end of the record p_ is in
+			inline const char* record_end(const char* begin_, const char* p_, const char* end_, bool& in_quotes_) {
+				while (p_ < end_) {
+					if (in_quotes_) {
+						// runs on to the closing quote
+						scan_quotes(begin_, p_, p_ + 1, end_, in_quotes_);
+						continue;
+					}
+					auto const nl = static_cast<const char*>(std::memchr(p_, '\n', end_ - p_));
+					auto const stop = nl ? nl : end_;
+					scan_quotes(begin_, p_, stop, end_, in_quotes_);
+					if (!in_quotes_ && p_ == stop)
+						return nl ? nl + 1 : end_;
+				}
+				return end_;
+			}
+		}
+
+		// a single field of a record, pointing into the parsed text
+		class csv_field_t {
+			const char* _data = nullptr;
+			size_t _size = 0;
+			bool _quoted = false;
+			bool _escaped = false;
+		public:
+			csv_field_t() {}
+			csv_field_t(const char* data_, size_t size_, bool quoted_, bool escaped_) :
+				_data(data_), _size(size_), _quoted(quoted_), _escaped(escaped_) {}
+
+			// raw text of the field, without the surrounding quotes
+			const char* data() const { return _data; }
+			size_t size() const { return _size; }
+			bool empty() const { return _size == 0; }
+			bool quoted() const { return _quoted; }
+			// raw text contains doubled quotes, so it differs from the value
+			bool escaped() const { return _escaped; }
+
+			// value of the field, with the escaping undone
+			std::string str(bool excel_format_ = false) const {
+				std::string out;
+				if (!_escaped)
+					out.assign(_data, _size);
+				else {
+					out.reserve(_size);
+					for (size_t i = 0; i < _size; ++i) {
+						out.push_back(_data[i]);
+						if (_data[i] == '"' && i + 1 < _size && _data[i + 1] == '"')
+							++i;
+					}
+				}
+				// excel format doubles colons in quoted single line fields
+				if (excel_format_ && _quoted && out.find(':') != std::string::npos && out.find('\n') == std::string::npos)
+					out = string_util::replace(out, std::string("::"), std::string(":"));
+				return out;
+			}
+
+			template<typename T>
+			bool to(T& out_) const {
+				return string_util::convert_string(_data, _data + _size, out_) == string_util::convert_status::ok;
+			}
+			bool to(std::string& out_) const {
+				out_ = str();
+				return true;
+			}
+			template<typename T>
+			T as() const {
+				T out{};
+				AF_ASSERT(to(out), "Could not convert csv field '%' to the requested type.", str());
+				return out;
+			}
+		};
+
+		using csv_record_t = std::vector<csv_field_t>;
+
+		// lets string_util::convert_strings convert records
+		template<typename T>
+		inline string_util::convert_status convert_string(csv_field_t const& field_, T& out_) {
+			return string_util::convert_string(field_.data(), field_.data() + field_.size(), out_);
+		}
+		inline string_util::convert_status convert_string(csv_field_t const& field_, std::string& out_) {
+			out_ = field_.str();
+			return string_util::convert_status::ok;
+		}
+
+		// parses records out of a range of csv text
+		class csv_parser_t {
+			const char* _p;
+			const char* const _end;
+		public:
+			csv_parser_t(const char* begin_, const char* end_) : _p(begin_), _end(end_) {}
+
+			const char* position() const { return _p; }
+
+			// reads the next record into fields_, returns false when there are no more records
+			bool next(csv_record_t& fields_) {
+				fields_.clear();
+				// empty lines are not records
+				while (_p != _end && (*_p == '\n' || (*_p == '\r' && (_p + 1 == _end || _p[1] == '\n'))))
+					++_p;
+				if (_p == _end)
+					return false;
+				while (true) {
+					while (_p != _end && (*_p == ' ' || *_p == '\t'))
+						++_p;
+					if (_p != _end && *_p == '"') {
+						const char* const begin = ++_p;
+						bool escaped = false;
+						while (true) {
+							auto const q = static_cast<const char*>(std::memchr(_p, '"', _end - _p));
+							if (!q) {
+								// unterminated quote takes the rest of the text
+								fields_.emplace_back(begin, _end - begin, true, escaped);
+								_p = _end;
+								return true;
+							}
+							if (q + 1 != _end && q[1] == '"') {
+								escaped = true;
+								_p = q + 2;
+								continue;
+							}
+							fields_.emplace_back(begin, q - begin, true, escaped);
+							_p = q + 1;
+							break;
+						}
+						while (_p != _end && *_p != ',' && *_p != '\n')
+							++_p;
+					}
+					else {
+						const char* const begin = _p;
+						while (_p != _end && *_p != ',' && *_p != '\n')
+							++_p;
+						const char* e = _p;
+						while (e != begin && csv_reader_impl::blank(e[-1]))
+							--e;
+						fields_.emplace_back(begin, e - begin, false, false);
+					}
+					if (_p == _end)
+						return true;
+					if (*_p++ == '\n')
+						return true;
+				}
+			}
+		};
+
+		// a range of the text that starts and ends on record boundaries
+		struct csv_chunk_t {
+			const char* _begin;
+			const char* _end;
+			csv_parser_t parser() const { return csv_parser_t(_begin, _end); }
+			size_t size() const { return static_cast<size_t>(_end - _begin); }
+		};
+
+		class csv_reader_t {
+			std::shared_ptr<mapped_file_t> _file;
+			const char* _begin;
+			const char* _end;
+			const char* _body;
+			std::vector<std::string> _header;
+			string_util::map_nc<size_t> _columns;
+
+			void read_header() {
+				csv_parser_t parser(_begin, _end);
+				csv_record_t fields;
+				if (parser.next(fields))
+					for (auto const& f : fields) {
+						_columns.emplace(f.str(), _header.size());
+						_header.push_back(f.str());
+					}
+				_body = parser.position();
+			}
+
+			// runs f_(chunk index, chunk) for every chunk, each on its own thread
+			template<typename F>
+			static void run_chunks(std::vector<csv_chunk_t> const& chunks_, F const& f_) {
+				std::vector<std::exception_ptr> errors(chunks_.size());
+				auto run = [&](size_t i_) {
+					try { f_(i_, chunks_[i_]); }
+					catch (...) { errors[i_] = std::current_exception(); }
+				};
+				std::vector<std::thread> workers;
+				for (size_t i = 1; i < chunks_.size(); ++i)
+					workers.emplace_back(run, i);
+				if (!chunks_.empty())
+					run(0);
+				for (auto& w : workers)
+					w.join();
+				for (auto const& e : errors)
+					if (e) std::rethrow_exception(e);
+			}
+
+			template<typename T>
+			static void parse_column(csv_chunk_t const& chunk_, size_t index_, std::vector<T>& out_) {
+				auto parser = chunk_.parser();
+				csv_record_t fields;
+				while (parser.next(fields)) {
+					bool const present = index_ < fields.size();
+					AF_ASSERT(present, "Csv record has % fields, column % requested.", fields.size(), index_);
+					T value{};
+					AF_ASSERT(!present || fields[index_].to(value),
+						"Could not convert csv field '%' in column % to the requested type.", fields[index_].str(), index_);
+					out_.push_back(std::move(value));
+				}
+			}
+
+		public:
+			// reads text held elsewhere, the text has to outlive the reader
+			csv_reader_t(const char* begin_, const char* end_, bool has_header_ = true) :
+				_begin(begin_), _end(end_), _body(begin_) {
+				if (has_header_)
+					read_header();
+			}
+			csv_reader_t(std::shared_ptr<mapped_file_t> file_, bool has_header_ = true) :
+				_file(file_), _begin(file_->data()), _end(file_->data() + file_->size()), _body(_begin) {
+				if (has_header_)
+					read_header();
+			}
+
+			std::vector<std::string> const& header() const { return _header; }
+			size_t column_index(std::string const& name_) const {
+				auto const it = _columns.find(name_);
+				AF_ASSERT(it != _columns.end(), "Csv column % does not exist.", name_);
+				return it->second;
+			}
+
+			// text after the header
+			csv_chunk_t body() const { return { _body, _end }; }
+
+			// splits the body into at most count_ chunks of roughly equal size that start and end on record boundaries
+			// (only the quotes get looked at, so this is much quicker than parsing)
+			std::vector<csv_chunk_t> chunks(size_t count_) const {
+				std::vector<csv_chunk_t> out;
+				const char* from = _body;
+				const char* p = _body;
+				bool in_quotes = false;
+				size_t const size = static_cast<size_t>(_end - _body);
+				for (size_t i = 1; i < count_ && p < _end; ++i) {
+					const char* const target = _body + size / count_ * i;
+					if (p < target)
+						csv_reader_impl::scan_quotes(_body, p, target, _end, in_quotes);
+					p = csv_reader_impl::record_end(_body, p, _end, in_quotes);
+					if (p > from) {
+						out.push_back({ from, p });
+						from = p;
+					}
+				}
+				if (from < _end || out.empty())
+					out.push_back({ from, _end });
+				return out;
+			}
+
+			// calls f_(record) for every record in the body
+			template<typename F>
+			void for_each_record(F&& f_) const {
+				auto parser = body().parser();
+				csv_record_t fields;
+				while (parser.next(fields))
+					f_(static_cast<csv_record_t const&>(fields));
+			}
+			// calls f_(chunk index, record) for every record in the body, chunks get parsed in parallel on threads_ threads
+			template<typename F>
+			void for_each_record(F&& f_, size_t threads_) const {
+				run_chunks(chunks(threads_), [&f_](size_t i_, csv_chunk_t const& chunk_) {
+					auto parser = chunk_.parser();
+					csv_record_t fields;
+					while (parser.next(fields))
+						f_(i_, static_cast<csv_record_t const&>(fields));
+					});
+			}
+
+			// all values in a column, converted to T
+			template<typename T>
+			std::vector<T> column(size_t index_, size_t threads_ = 1) const {
+				auto const parts = chunks(threads_);
+				if (parts.size() == 1) {
+					std::vector<T> out;
+					parse_column(parts.front(), index_, out);
+					return out;
+				}
+				std::vector<std::vector<T>> results(parts.size());
+				run_chunks(parts, [&](size_t i_, csv_chunk_t const& chunk_) {
+					parse_column(chunk_, index_, results[i_]);
+					});
+				size_t total = 0;
+				for (auto const& r : results)
+					total += r.size();
+				std::vector<T> out;
+				out.reserve(total);
+				for (auto& r : results)
+					std::move(r.begin(), r.end(), std::back_inserter(out));
+				return out;
+			}
+			template<typename T>
+			std::vector<T> column(std::string const& name_, size_t threads_ = 1) const {
+				return column<T>(column_index(name_), threads_);
+			}
+		};
+
+		inline csv_reader_t make_csv_file_reader(std::string const& path_, bool has_header_ = true) {
+			return csv_reader_t(std::make_shared<mapped_file_t>(path_), has_header_);
+		}
+		// the text has to outlive the reader
+		inline csv_reader_t make_csv_text_reader(std::string const& text_, bool has_header_ = true) {
+			return csv_reader_t(text_.data(), text_.data() + text_.size(), has_header_);
+		}
+	}
+}
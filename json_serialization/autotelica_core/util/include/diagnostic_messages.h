@@ -8,6 +8,16 @@
 #include <ctime>
 #include <time.h>
 #include <cstring>
+#include <cstddef>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 #include "string_util.h"
 
 namespace autotelica {
@@ -179,6 +189,390 @@ namespace autotelica {
             inline void set_include_timestamp(bool v = true) { _include_timestamp = v; }
         };
 
+        // Asynchronous messages.
+        // While an async_message_handler is the current handler, emitting a message only stores its format and arguments
+        // in a lock free ring owned by the calling thread. A background thread formats the stored messages, 
+        // timestamps them and passes them on to the target handler in batches.
+        namespace diagnostic_messages_impl {
+            // arguments are stored by value, strings given by pointer are copied as they may not outlive the call
+            // deferred messages are narrow, so wide strings are stored converted to utf8
+            template<typename T> struct deferred_arg { 
+                using type = T; 
+                static T const& store(T const& arg_) { return arg_; }
+            };
+            template<> struct deferred_arg<char*> {
+                using type = std::string;
+                static std::string store(char const* arg_) { return arg_; }
+            };
+            template<> struct deferred_arg<char const*> : public deferred_arg<char*> {};
+            template<> struct deferred_arg<wchar_t*> {
+                using type = std::string;
+                static std::string store(wchar_t const* arg_) { return string_util::utf8::to_string(std::wstring(arg_)); }
+            };
+            template<> struct deferred_arg<wchar_t const*> : public deferred_arg<wchar_t*> {};
+
+            // formats timestamps, strftime is only called when the second changes
+            class timestamp_cache_t {
+                std::time_t _second;
+                char _text[100];
+            public:
+                timestamp_cache_t() : _second(-1) { _text[0] = '\0'; }
+                const char* text(std::chrono::system_clock::time_point const& time_) {
+                    using traits_t = messages_traits<std::string>;
+                    std::time_t const second = std::chrono::system_clock::to_time_t(time_);
+                    if (second != _second) {
+                        tm tm_buff;
+#ifdef __linux__
+                        gmtime_r(&second, &tm_buff);
+#else
+                        gmtime_s(&tm_buff, &second);
+#endif
+                        traits_t::ftime(_text, sizeof(_text), traits_t::timestamp_f, &tm_buff);
+                        _second = second;
+                    }
+                    return _text;
+                }
+            };
+
+            // state of the background thread
+            struct async_context_t {
+                message_handler& _target;
+                std::string _out;
+                timestamp_cache_t _timestamps;
+                async_context_t(message_handler& target_) :_target(target_) {}
+            };
+
+            struct async_record_t {
+                std::chrono::system_clock::time_point const _time;
+                async_record_t() :_time(std::chrono::system_clock::now()) {}
+                virtual ~async_record_t() {}
+                virtual void write(async_context_t& context_) = 0;
+            };
+
+            // message that was formatted on the calling thread (errors that throw, wide strings)
+            template<typename string_t>
+            struct formatted_record_t : public async_record_t {
+                string_t const _message;
+                formatted_record_t(string_t const& message_) :_message(message_) {}
+                void write(async_context_t& context_) override { context_._target.message(_message); }
+            };
+
+            // record that doesn't fit into a ring slot, kept on the heap
+            struct boxed_record_t : public async_record_t {
+                std::unique_ptr<async_record_t> const _record;
+                boxed_record_t(async_record_t* record_) :_record(record_) {}
+                void write(async_context_t& context_) override { _record->write(context_); }
+            };
+
+            // message formatted on the background thread
+            // texts are copied to the space after the record in its ring slot when they fit, and to _text when they don't
+            template<typename... Targs>
+            struct deferred_record_t : public async_record_t {
+                using traits_t = messages_traits<std::string>;
+                using args_t = std::tuple<typename deferred_arg<Targs>::type...>;
+
+                const char* const _prefix;
+                int const _line;
+                bool const _whitespace;
+                bool const _long_form;
+                bool const _timestamp;
+                std::string _text;
+                const char* _m;
+                const char* _condition;
+                const char* _file;
+                args_t const _args;
+
+                deferred_record_t(
+                    char* space_, size_t space_size_,
+                    const char* prefix_, const char* condition_, const char* file_, int line_,
+                    bool whitespace_, bool long_form_, bool timestamp_,
+                    const char* m_, Targs... Fargs) :
+                    _prefix(prefix_), _line(line_), 
+                    _whitespace(whitespace_), _long_form(long_form_), _timestamp(timestamp_),
+                    _args(deferred_arg<Targs>::store(Fargs)...) {
+                    size_t const m_size = strlen(m_) + 1;
+                    size_t const condition_size = condition_ ? strlen(condition_) + 1 : 0;
+                    size_t const file_size = file_ ? strlen(file_) + 1 : 0;
+                    size_t const size = m_size + condition_size + file_size;
+                    if (size > space_size_) {
+                        _text.resize(size);
+                        space_ = &_text[0];
+                    }
+                    auto copy = [&](const char* s_, size_t size_) -> const char* {
+                        if (!s_) return nullptr;
+                        memcpy(space_, s_, size_);
+                        space_ += size_;
+                        return space_ - size_;
+                    };
+                    _m = copy(m_, m_size);
+                    _condition = copy(condition_, condition_size);
+                    _file = copy(file_, file_size);
+                }
+
+                template<size_t... Is>
+                void print(std::string& out_, std::index_sequence<Is...>) const {
+                    string_util::format_append(out_, _m, std::get<Is>(_args)...);
+                }
+
+                void write(async_context_t& context_) override {
+                    std::string& out = context_._out;
+                    out.clear();
+                    if (!_whitespace) {
+                        if (_timestamp)
+                            out += context_._timestamps.text(_time);
+                        out += _prefix;
+                        if (_long_form && _condition && *_condition) {
+                            out += traits_t::assertion;
+                            out += _condition;
+                            out += traits_t::failed;
+                        }
+                    }
+                    print(out, std::index_sequence_for<Targs...>());
+                    if (!_whitespace && _long_form && _file) {
+                        out += traits_t::in_file;
+                        out += _file;
+                        out += traits_t::at_line;
+                        string_util::append_value(out, _line);
+                        out += traits_t::rbracket;
+                    }
+                    context_._target.message(out);
+                }
+            };
+
+            // single producer, single consumer ring of fixed size slots, records are constructed in place
+            class async_ring_t {
+            public:
+                static constexpr size_t slot_size = 256;
+            private:
+                struct slot_t {
+                    alignas(std::max_align_t) unsigned char _bytes[slot_size];
+                };
+                std::vector<slot_t> _slots;
+                size_t const _mask;
+                std::atomic<size_t> _head; // next slot to write, only moved by the owning thread
+                std::atomic<size_t> _tail; // next slot to read, only moved by the background thread
+                std::atomic<bool> _orphaned; // the owning thread has exited
+
+                static size_t round_up(size_t capacity_) {
+                    size_t c = 2;
+                    while (c < capacity_) c <<= 1;
+                    return c;
+                }
+                async_record_t* record(size_t i_) {
+                    return reinterpret_cast<async_record_t*>(_slots[i_ & _mask]._bytes);
+                }
+            public:
+                async_ring_t(size_t capacity_) :
+                    _slots(round_up(capacity_)), _mask(_slots.size() - 1), _head(0), _tail(0), _orphaned(false) {
+                }
+                ~async_ring_t() {
+                    release(_head.load(std::memory_order_acquire));
+                }
+                size_t capacity() const { return _slots.size(); }
+                size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+                bool empty() const { return size() == 0; }
+                void orphan() { _orphaned.store(true, std::memory_order_release); }
+                bool orphaned() const { return _orphaned.load(std::memory_order_acquire); }
+
+                // space for the next record, nullptr when the ring is full
+                void* reserve() {
+                    size_t const head = _head.load(std::memory_order_relaxed);
+                    if (head - _tail.load(std::memory_order_acquire) > _mask)
+                        return nullptr;
+                    return _slots[head & _mask]._bytes;
+                }
+                // publishes the record constructed in reserved space
+                void commit() {
+                    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                }
+                // adds published records to records_, returns the position to release them up to
+                size_t peek(std::vector<async_record_t*>& records_) {
+                    size_t const head = _head.load(std::memory_order_acquire);
+                    for (size_t i = _tail.load(std::memory_order_relaxed); i != head; ++i)
+                        records_.push_back(record(i));
+                    return head;
+                }
+                // destroys records up to head_, making their slots available again
+                void release(size_t head_) {
+                    size_t tail = _tail.load(std::memory_order_relaxed);
+                    for (; tail != head_; ++tail)
+                        record(tail)->~async_record_t();
+                    _tail.store(tail, std::memory_order_release);
+                }
+            };
+        }
+
+        // Handler that passes messages on to the target handler from a background thread.
+        // Each thread emitting messages gets its own ring of ring_capacity_ records; when it fills up, the thread waits for the writer.
+        // Messages from different threads are written in the order of their timestamps within each batch.
+        // The target handler is only ever called from the background thread.
+        class async_message_handler : public message_handler {
+            using ring_t = diagnostic_messages_impl::async_ring_t;
+            using record_t = diagnostic_messages_impl::async_record_t;
+
+            std::shared_ptr<message_handler> const _target;
+            size_t const _ring_capacity;
+            std::chrono::milliseconds const _flush_interval;
+            size_t const _id; // threads cache their rings per handler
+
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::condition_variable _flushed;
+            std::vector<std::shared_ptr<ring_t>> _rings;
+            size_t _flush_requested;
+            size_t _flush_done;
+            bool _stop;
+            std::atomic<size_t> _waits; // times a thread found its ring full
+            std::thread _writer;
+
+            static size_t next_id() {
+                static std::atomic<size_t> id(0);
+                return ++id;
+            }
+
+            struct thread_ring_t {
+                size_t _owner = 0;
+                std::shared_ptr<ring_t> _ring;
+                ~thread_ring_t() { if (_ring) _ring->orphan(); }
+            };
+            ring_t& this_thread() {
+                static thread_local thread_ring_t local;
+                if (local._owner != _id) {
+                    if (local._ring) 
+                        local._ring->orphan();
+                    local._ring = std::make_shared<ring_t>(_ring_capacity);
+                    local._owner = _id;
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _rings.push_back(local._ring);
+                }
+                return *local._ring;
+            }
+
+            void* reserve(ring_t& ring_) {
+                void* space = ring_.reserve();
+                while (!space) {
+                    ++_waits;
+                    _wake.notify_one();
+                    std::this_thread::yield();
+                    space = ring_.reserve();
+                }
+                return space;
+            }
+            void commit(ring_t& ring_) {
+                ring_.commit();
+                if (ring_.size() * 2 >= ring_.capacity())
+                    _wake.notify_one();
+            }
+
+            template<typename RecordT, typename... Targs>
+            void push(Targs&&... args_) {
+                ring_t& ring = this_thread();
+                void* space = reserve(ring);
+                new (space) RecordT(std::forward<Targs>(args_)...);
+                commit(ring);
+            }
+
+            void write_batch(std::vector<std::shared_ptr<ring_t>> const& rings_, 
+                    std::vector<record_t*>& batch_,
+                    diagnostic_messages_impl::async_context_t& context_) {
+                std::vector<size_t> heads;
+                heads.reserve(rings_.size());
+                batch_.clear();
+                for (auto const& ring : rings_)
+                    heads.push_back(ring->peek(batch_));
+                std::stable_sort(batch_.begin(), batch_.end(),
+                    [](record_t const* l, record_t const* r) { return l->_time < r->_time; });
+                for (auto record : batch_) {
+                    try {
+                        record->write(context_);
+                    }
+                    catch (...) {
+                        // nowhere to report it from here
+                    }
+                }
+                for (size_t i = 0; i < rings_.size(); ++i)
+                    rings_[i]->release(heads[i]);
+            }
+
+            void run() {
+                diagnostic_messages_impl::async_context_t context(*_target);
+                std::vector<record_t*> batch;
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (true) {
+                    _wake.wait_for(lock, _flush_interval, [this]() { return _stop || _flush_requested != _flush_done; });
+                    bool const stopping = _stop;
+                    size_t const requested = _flush_requested;
+                    auto const rings = _rings;
+                    lock.unlock();
+                    write_batch(rings, batch, context);
+                    lock.lock();
+                    _rings.erase(std::remove_if(_rings.begin(), _rings.end(),
+                        [](std::shared_ptr<ring_t> const& r) { return r->orphaned() && r->empty(); }), _rings.end());
+                    _flush_done = requested;
+                    _flushed.notify_all();
+                    if (stopping) 
+                        break;
+                }
+            }
+        public:
+            async_message_handler(
+                std::shared_ptr<message_handler> target_, 
+                size_t ring_capacity_ = 1024,
+                std::chrono::milliseconds flush_interval_ = std::chrono::milliseconds(1)) :
+                _target(target_), _ring_capacity(ring_capacity_), _flush_interval(flush_interval_), _id(next_id()),
+                _flush_requested(0), _flush_done(0), _stop(false), _waits(0) {
+                if (!_target)
+                    throw std::runtime_error("async_message_handler needs a target handler.");
+                _writer = std::thread([this]() { run(); });
+            }
+            ~async_message_handler() {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _stop = true;
+                }
+                _wake.notify_one();
+                _writer.join();
+            }
+
+            std::shared_ptr<message_handler> target() const { return _target; }
+            
+            // times a thread had to wait for the writer because its ring was full
+            size_t waits() const { return _waits.load(); }
+
+            // blocks until messages emitted by this thread before the call are passed on to the target handler
+            void flush() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                size_t const request = ++_flush_requested;
+                _wake.notify_one();
+                _flushed.wait(lock, [&]() { return _flush_done >= request; });
+            }
+
+            // stores a message to be formatted on the background thread
+            template<typename... Targs>
+            void defer(
+                const char* prefix_, const char* condition_, const char* file_, int line_,
+                bool whitespace_, bool long_form_, bool timestamp_,
+                const char* m_, Targs... Fargs) {
+                using deferred_t = diagnostic_messages_impl::deferred_record_t<Targs...>;
+                ring_t& ring = this_thread();
+                char* space = static_cast<char*>(reserve(ring));
+                if (sizeof(deferred_t) <= ring_t::slot_size)
+                    new (space) deferred_t(space + sizeof(deferred_t), ring_t::slot_size - sizeof(deferred_t),
+                        prefix_, condition_, file_, line_, whitespace_, long_form_, timestamp_, m_, Fargs...);
+                else
+                    new (space) diagnostic_messages_impl::boxed_record_t(new deferred_t(nullptr, 0,
+                        prefix_, condition_, file_, line_, whitespace_, long_form_, timestamp_, m_, Fargs...));
+                commit(ring);
+            }
+
+            void message(std::string const& m) override {
+                push<diagnostic_messages_impl::formatted_record_t<std::string>>(m);
+            }
+            void message(std::wstring const& m) override {
+                push<diagnostic_messages_impl::formatted_record_t<std::wstring>>(m);
+            }
+        };
+
         namespace diagnostic_messages_impl {
             // helpers to delegete stuff to the right string
             inline bool is_empty(const char* const s) {return s && strlen(s) == 0;}
@@ -190,38 +584,45 @@ namespace autotelica {
             class messages_impl {
             protected:
                 std::shared_ptr<message_handler> _handler; // current message handler
+                async_message_handler* _async; // current message handler, if it is asynchronous
                 messages_policy _policy;
                 // Constructor creates a default handler if not given one.
                 messages_impl(
                     std::shared_ptr<message_handler> handler_ = nullptr
-                ) : _handler(handler_){
+                ) : _handler(handler_), _async(nullptr){
                     if (!_handler)
                         _handler = std::shared_ptr<message_handler>{ new default_message_handler() };
+                    _async = dynamic_cast<async_message_handler*>(_handler.get());
                 }
 
                 // Adds information about file and line to the message.
-                template<typename stringstream_t, typename char_t>
+                template<typename char_t>
                 static inline void append_file_line(
-                        stringstream_t& sout, 
+                        std::basic_string<char_t>& sout, 
                         const char_t* const file, 
                         int line) {
                     using string_t = typename std::basic_string<char_t>;
                     using traits_t = messages_traits<string_t>;
 
                     if (!file) return;
-                    sout << traits_t::in_file << file << traits_t::at_line << line << traits_t::rbracket;
+                    sout += traits_t::in_file;
+                    sout += file;
+                    sout += traits_t::at_line;
+                    string_util::append_value(sout, line);
+                    sout += traits_t::rbracket;
                 }
                 // Add information about condition that failed to the message. 
-                template<typename stringstream_t, typename string_t>
-                static inline void prepend_failed_condition_message(stringstream_t& sout, const string_t& condition) {
+                template<typename char_t, typename string_t>
+                static inline void prepend_failed_condition_message(std::basic_string<char_t>& sout, const string_t& condition) {
                     using traits_t = messages_traits<string_t>;
                     if (is_empty(condition)) return;
-                    sout << std::boolalpha << traits_t::assertion << condition << traits_t::failed;
+                    sout += traits_t::assertion;
+                    sout += condition;
+                    sout += traits_t::failed;
                 }
                 // Prefixes the message with the timestamp
-                template<typename stringstream_t>
-                static void prepend_timestamp(stringstream_t& sout) {
-                    using char_t = typename stringstream_t::char_type;
+                template<typename char_t>
+                static void prepend_timestamp(std::basic_string<char_t>& sout) {
                     using string_t = typename std::basic_string<char_t>;
                     using traits_t = messages_traits<string_t>;
 
@@ -236,19 +637,34 @@ namespace autotelica {
 #endif
                     traits_t::ftime(timeString, sizeof(timeString)/sizeof(char_t),
                         traits_t::timestamp_f, &tm_buff);
-                    sout << timeString;
+                    sout += timeString;
                 }
 
                 // Get the instance of this object, configure the handler while at it.
+                // (construction of the instance is thread safe, changing the handler while other threads emit messages isn't)
                 static std::shared_ptr<messages_impl> get(std::shared_ptr<message_handler> handler_ = nullptr) {
-                    static std::shared_ptr<messages_impl> _instance;
-                    if (!_instance)
-                        _instance = std::shared_ptr<messages_impl>(new messages_impl(handler_));
-                    if (handler_ && _instance->_handler != handler_)
+                    static std::shared_ptr<messages_impl> _instance(new messages_impl(handler_));
+                    if (handler_ && _instance->_handler != handler_) {
                         _instance->_handler = handler_;
+                        _instance->_async = dynamic_cast<async_message_handler*>(handler_.get());
+                    }
                     return _instance;
                 }
 
+                // only narrow messages are formatted on the background thread
+                template<typename... Targs>
+                static inline bool defer(async_message_handler* async_, messages_policy const& policy_, 
+                    const char* prefix, const char* condition, const char* file, int line, bool whitespace, 
+                    const char* m, Targs... Fargs) {
+                    async_->defer(prefix, condition, file, line, whitespace, policy_.long_form(), policy_.include_timestamp(), m, Fargs...);
+                    return true;
+                }
+                template<typename... Targs>
+                static inline bool defer(async_message_handler*, messages_policy const&,
+                    const wchar_t*, const wchar_t*, const wchar_t*, int, bool, const wchar_t*, Targs...) {
+                    return false;
+                }
+
                 template<typename char_t>
                 static bool is_whitespace(const char_t* const m) {
                     const char_t* s = m;
@@ -269,30 +685,31 @@ namespace autotelica {
                     Targs... Fargs) // parameters for interpolation of m
                 {
                     using string_t = std::basic_string<char_t>;
-                    using traits_t = messages_traits<string_t>;
-                    using stringstream_t = typename traits_t::stringstream_t;
-
-                    if (!m || !get()->_handler) return;
+                    auto const impl = get();
+                    if (!m || !impl->_handler) return;
                     bool wht = is_whitespace(m);
-                    stringstream_t sout;
+                    // errors that throw need the text here, so they are formatted on this thread
+                    if (impl->_async && !throw_exception && 
+                        defer(impl->_async, impl->_policy, prefix, condition, file, line, wht, m, Fargs...))
+                        return;
+                    string_t sout;
                     if(!wht){
 						prepend_timestamp(sout);
-						sout << std::boolalpha << prefix;
-						if (get()->_policy.long_form() && condition)
+						sout += prefix;
+						if (impl->_policy.long_form() && condition)
 							prepend_failed_condition_message(sout, condition);
 					}
-                    string_util::var_printf(sout, m, Fargs...);
+                    string_util::format_append(sout, m, Fargs...);
                     if(!wht){
-						if (get()->_policy.long_form())
+						if (impl->_policy.long_form())
 							append_file_line(sout, file, line);
 					}
                     if (throw_exception) {
-                        std::basic_string<char_t> const m(sout.str());
-                        get()->_handler->message(m);
-                        throw std::runtime_error(string_util::utf8::to_string(m));
+                        impl->_handler->message(sout);
+                        throw std::runtime_error(string_util::utf8::to_string(sout));
                     }
                     else {
-                        get()->_handler->message(sout.str());
+                        impl->_handler->message(sout);
                     }
                 }
 
@@ -351,6 +768,7 @@ namespace autotelica {
                 // Disables logging
                 static inline void disable() {
                     get()->_handler = nullptr;
+                    get()->_async = nullptr;
                 }
 
                 template<typename char_t, typename... Targs>
@@ -994,6 +1412,27 @@ namespace autotelica {
         }
 
 
+        // asynchronous message handler, formats and passes messages on to target_ from a background thread
+        static inline std::shared_ptr<message_handler> make_async_message_handler(
+                std::shared_ptr<message_handler> target_, size_t ring_capacity_ = 1024) {
+            std::shared_ptr<message_handler> handler(new async_message_handler(target_, ring_capacity_));
+            return handler;
+        }
+        static inline std::shared_ptr<message_handler> make_async_message_handler_active(
+                std::shared_ptr<message_handler> target_, size_t ring_capacity_ = 1024) {
+            auto handler = make_async_message_handler(target_, ring_capacity_);
+            messages::set_handler(handler);
+            return handler;
+        }
+        static inline scoped_message_handler make_scoped_async_message_handler(
+                std::shared_ptr<message_handler> target_, size_t ring_capacity_ = 1024) {
+            return make_scoped_handler(make_async_message_handler(target_, ring_capacity_));
+        }
+        // asynchronous file message handler
+        static inline std::shared_ptr<message_handler> make_async_file_message_handler_active(std::string const& file_name) {
+            return make_async_message_handler_active(make_file_message_handler(file_name));
+        }
+
         // scoped disabling of timestamps in logs, used for recording
         class timestamp_disabler {
         public:
@@ -222,6 +222,9 @@ namespace autotelica {
 		using is_priority_queue_t = std_disambiguation::is_priority_queue_t<T>;
 		template<typename T>
 		using is_bitset_t = std_disambiguation::is_bitset_t<T>;
+		// is_pmr detects containers and strings with std::pmr::polymorphic_allocator
+		template<typename T>
+		using is_pmr_t = std_disambiguation::is_pmr_t<T>;
 
 		// kinds of containers
 		// is sequence detects vector or deque or forward_list or list
@@ -384,6 +387,10 @@ namespace autotelica {
 		template<typename T>
 		using if_bitset_t = if_t<is_bitset_t<T>>;
 
+		// choose if T uses a polymorphic allocator
+		template<typename T>
+		using if_pmr_t = if_t<is_pmr_t<T>>;
+
 
 		// choose if T is a map not indexed by strings
 		template<typename T>
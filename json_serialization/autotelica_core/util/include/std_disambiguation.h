@@ -19,6 +19,19 @@
 
 #include <type_traits>
 
+// polymorphic allocators came with c++ 17
+#ifndef _AF_HAS_PMR
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || (__cplusplus >= 201703L)
+#define _AF_HAS_PMR true
+#else
+#define _AF_HAS_PMR false
+#endif
+#endif
+
+#if _AF_HAS_PMR
+#include <memory_resource>
+#endif
+
 namespace autotelica {
     namespace std_disambiguation {
         // SFINAE based type detection for std types
@@ -58,8 +71,10 @@ namespace autotelica {
         //      map, multimap, unordered_map, unordered_multimap, stack, queue, priority_queue
         // is_container_t, is_container_f - any of the above
         //
-        // NOTE: these may fail for polymorphic allocator version in c++ 17
-        //       it's a simple extension, a TODO I guess
+        // is_pmr_t, is_pmr_f - anything that uses std::pmr::polymorphic_allocator (always false before c++ 17)
+        //
+        // NOTE: container and string predicates don't care about the allocator, 
+        //       so std::pmr versions are detected the same way as the std ones
 
         // Trickery to make use of SFINAE - can be instantiated only if the listed types exist
         // C++ 17 has this built in (and calls it std::void_t)     
@@ -168,6 +183,20 @@ namespace autotelica {
         template<typename T>\
             constexpr bool is_bitset_f(T const& t) { return is_bitset_t<T>(); }
 
+        // polymorphic allocators (std::pmr containers and strings)
+        template<typename T, typename U = void>
+            struct is_pmr_impl : std::false_type {};
+#if _AF_HAS_PMR
+        template<typename T>
+        struct is_pmr_impl<T, _void_t<std::enable_if_t<std::is_same< typename T::allocator_type,
+            std::pmr::polymorphic_allocator<typename T::allocator_type::value_type>>::value>>> : std::true_type {};
+#endif
+        template<typename T>
+        struct is_pmr_t : is_pmr_impl<T>::type {};
+
+        template<typename T>
+            constexpr bool is_pmr_f(T const& t) { return is_pmr_t<T>(); }
+
 
 #define GCC_PASTING_NAMEPSACE(L, R) L##::##R
 
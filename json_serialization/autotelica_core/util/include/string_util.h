@@ -4,6 +4,14 @@
 #include <algorithm>
 #include <functional>
 #include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <iterator>
+#include <stdexcept>
 #include <cwchar>
 #include <map>
 #include <unordered_map>
@@ -13,6 +21,11 @@
 #include <type_traits>
 #include <locale>
 #include <codecvt>
+#include <locale.h>
+#include <stdlib.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
 
 namespace autotelica {
 	namespace string_util {
@@ -726,6 +739,334 @@ namespace autotelica {
 		inline bool wildcard_match(std::wstring const& text, std::wstring const& pattern, const bool case_sensitive = false) {
 			return wildcard_match_<wchar_t>(text, pattern, case_sensitive);
 		}
+
+		// wildcard pattern compiled once, for matching many strings
+		// the pattern is split on '*' into a prefix, a suffix and segments in between:
+		// a text matches if it starts with the prefix, ends with the suffix and contains the segments, in order, in between
+		// ('?' matches any single character in any of these)
+		template<typename char_t>
+		class compiled_wildcard_ {
+			using string_t = std::basic_string<char_t>;
+			using symbols = wildcard_symbols<char_t>;
+
+			string_t _pattern;
+			bool _case_sensitive;
+			bool _has_any; // without a '*' the whole pattern is the prefix, and has to match the whole text
+			string_t _prefix;
+			string_t _suffix;
+			std::vector<string_t> _segments;
+
+			static const char* scan(const char* from_, size_t size_, char c_) {
+				return static_cast<const char*>(memchr(from_, c_, size_));
+			}
+			static const wchar_t* scan(const wchar_t* from_, size_t size_, wchar_t c_) {
+				return wmemchr(from_, c_, size_);
+			}
+
+			char_t fold(char_t c_) const { return _case_sensitive ? c_ : fast_to_lower(c_); }
+
+			// does the piece of pattern (without '*') match text_ at its start
+			bool matches_at(const char_t* text_, string_t const& piece_) const {
+				for (size_t i = 0; i < piece_.size(); ++i)
+					if (piece_[i] != symbols::one && fold(text_[i]) != piece_[i])
+						return false;
+				return true;
+			}
+			// first occurence of c_ (in either case) in [from_, to_)
+			const char_t* find_char(const char_t* from_, const char_t* to_, char_t c_) const {
+				char_t const upper = _case_sensitive ? c_ : fast_to_upper(c_);
+				if (upper == c_)
+					return scan(from_, static_cast<size_t>(to_ - from_), c_);
+				for (; from_ != to_; ++from_)
+					if (*from_ == c_ || *from_ == upper)
+						return from_;
+				return nullptr;
+			}
+			// leftmost match of the piece of pattern within [from_, to_)
+			const char_t* find(const char_t* from_, const char_t* to_, string_t const& piece_) const {
+				size_t const size = piece_.size();
+				if (static_cast<size_t>(to_ - from_) < size)
+					return nullptr;
+				// candidates are found by the first character that isn't a '?'
+				size_t anchor = 0;
+				while (anchor < size && piece_[anchor] == symbols::one)
+					++anchor;
+				if (anchor == size)
+					return from_;
+				const char_t* const last = to_ - size + anchor + 1;
+				for (const char_t* p = from_ + anchor; p < last; ++p) {
+					p = find_char(p, last, piece_[anchor]);
+					if (!p)
+						return nullptr;
+					if (matches_at(p - anchor, piece_))
+						return p - anchor;
+				}
+				return nullptr;
+			}
+			static string_t literal(string_t const& piece_) {
+				return piece_.substr(0, std::min(piece_.find(symbols::one), piece_.size()));
+			}
+		public:
+			compiled_wildcard_(string_t const& pattern_, bool case_sensitive_ = false) :
+				_pattern(pattern_), _case_sensitive(case_sensitive_), _has_any(false) {
+				string_t piece;
+				std::vector<string_t> pieces;
+				for (char_t c : pattern_) {
+					if (c == symbols::any) {
+						pieces.push_back(piece);
+						piece.clear();
+					}
+					else
+						piece.push_back(fold(c));
+				}
+				pieces.push_back(piece);
+				_has_any = pieces.size() > 1;
+				_prefix = pieces.front();
+				if (_has_any) {
+					_suffix = pieces.back();
+					for (size_t i = 1; i + 1 < pieces.size(); ++i)
+						if (!pieces[i].empty())
+							_segments.push_back(pieces[i]);
+				}
+			}
+
+			string_t const& pattern() const { return _pattern; }
+			bool case_sensitive() const { return _case_sensitive; }
+			// start and end that every match has, up to the first '?' (folded to lower case when case insensitive)
+			string_t literal_prefix() const { return literal(_prefix); }
+			string_t literal_suffix() const {
+				if (!_has_any) return string_t();
+				string_t reversed(_suffix.rbegin(), _suffix.rend());
+				reversed = literal(reversed);
+				return string_t(reversed.rbegin(), reversed.rend());
+			}
+
+			bool match(const char_t* text_, size_t size_) const {
+				if (!_has_any)
+					return size_ == _prefix.size() && matches_at(text_, _prefix);
+				if (size_ < _prefix.size() + _suffix.size())
+					return false;
+				const char_t* const end = text_ + size_ - _suffix.size();
+				if (!matches_at(text_, _prefix) || !matches_at(end, _suffix))
+					return false;
+				const char_t* p = text_ + _prefix.size();
+				for (auto const& segment : _segments) {
+					p = find(p, end, segment);
+					if (!p) 
+						return false;
+					p += segment.size();
+				}
+				return true;
+			}
+			bool match(string_t const& text_) const {
+				return match(text_.c_str(), text_.size());
+			}
+		};
+		using compiled_wildcard = compiled_wildcard_<char>;
+		using wcompiled_wildcard = compiled_wildcard_<wchar_t>;
+
+		// set of wildcard patterns, matched against a string together
+		// patterns are indexed by their literal prefix (or literal suffix, if they start with a wildcard) in tries,
+		// so a string is only checked against patterns whose prefix or suffix it has,
+		// patterns that start and end with wildcards are always checked
+		template<typename char_t>
+		class wildcard_set_ {
+			using string_t = std::basic_string<char_t>;
+			struct node_t {
+				std::vector<std::pair<char_t, size_t>> _children;
+				std::vector<size_t> _patterns;
+			};
+			bool _case_sensitive;
+			std::vector<compiled_wildcard_<char_t>> _patterns;
+			std::vector<node_t> _prefixes; // trie of literal prefixes
+			std::vector<node_t> _suffixes; // trie of reversed literal suffixes
+			std::vector<size_t> _unanchored;
+
+			char_t fold(char_t c_) const { return _case_sensitive ? c_ : fast_to_lower(c_); }
+
+			static size_t child(std::vector<node_t> const& trie_, size_t node_, char_t c_) {
+				for (auto const& c : trie_[node_]._children)
+					if (c.first == c_)
+						return c.second;
+				return 0;
+			}
+			template<typename IteratorT>
+			static void insert(std::vector<node_t>& trie_, IteratorT begin_, IteratorT end_, size_t pattern_) {
+				size_t node = 0;
+				for (; begin_ != end_; ++begin_) {
+					size_t next = child(trie_, node, *begin_);
+					if (!next) {
+						next = trie_.size();
+						trie_[node]._children.emplace_back(*begin_, next);
+						trie_.emplace_back();
+					}
+					node = next;
+				}
+				trie_[node]._patterns.push_back(pattern_);
+			}
+			// calls f_ with patterns that match the text until it returns false
+			template<typename F>
+			bool for_each_match(const char_t* text_, size_t size_, F f_) const {
+				auto check = [&](std::vector<size_t> const& patterns_) {
+					for (size_t p : patterns_)
+						if (_patterns[p].match(text_, size_) && !f_(p))
+							return false;
+					return true;
+				};
+				size_t node = 0;
+				for (size_t i = 0; i < size_ && (node = child(_prefixes, node, fold(text_[i]))); ++i)
+					if (!check(_prefixes[node]._patterns))
+						return false;
+				node = 0;
+				for (size_t i = size_; i > 0 && (node = child(_suffixes, node, fold(text_[i - 1]))); --i)
+					if (!check(_suffixes[node]._patterns))
+						return false;
+				return check(_unanchored);
+			}
+		public:
+			wildcard_set_(bool case_sensitive_ = false) :
+				_case_sensitive(case_sensitive_), _prefixes(1), _suffixes(1) {
+			}
+
+			// returns the index of the added pattern
+			size_t add(string_t const& pattern_) {
+				size_t const index = _patterns.size();
+				_patterns.emplace_back(pattern_, _case_sensitive);
+				auto const& compiled = _patterns.back();
+				string_t const prefix = compiled.literal_prefix();
+				string_t const suffix = compiled.literal_suffix();
+				if (!prefix.empty())
+					insert(_prefixes, prefix.begin(), prefix.end(), index);
+				else if (!suffix.empty())
+					insert(_suffixes, suffix.rbegin(), suffix.rend(), index);
+				else
+					_unanchored.push_back(index);
+				return index;
+			}
+
+			size_t size() const { return _patterns.size(); }
+			bool empty() const { return _patterns.empty(); }
+			compiled_wildcard_<char_t> const& pattern(size_t i_) const { return _patterns[i_]; }
+
+			// does any of the patterns match
+			bool match(const char_t* text_, size_t size_) const {
+				return !for_each_match(text_, size_, [](size_t) { return false; });
+			}
+			bool match(string_t const& text_) const {
+				return match(text_.c_str(), text_.size());
+			}
+			// indices of all patterns that match, in the order they were added
+			std::vector<size_t> matches(string_t const& text_) const {
+				std::vector<size_t> out;
+				for_each_match(text_.c_str(), text_.size(), [&](size_t p_) { out.push_back(p_); return true; });
+				std::sort(out.begin(), out.end());
+				return out;
+			}
+		};
+		using wildcard_set = wildcard_set_<char>;
+		using wwildcard_set = wildcard_set_<wchar_t>;
+		namespace string_util_impl {
+			// case insensitive comparisons fold case on the fly, the same way fast_to_lower does (only ASCII letters change)
+			// narrow strings are folded 8 characters at a time, bytes of multi-byte UTF-8 characters are compared as they are
+			inline char fold_nc(char c) {
+				return static_cast<unsigned char>(c - 'A') < 26 ? static_cast<char>(c + ('a' - 'A')) : c;
+			}
+			inline wchar_t fold_nc(wchar_t c) {
+				return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+			}
+			inline uint64_t load_word(const char* s) {
+				uint64_t w;
+				memcpy(&w, s, sizeof(w));
+				return w;
+			}
+			// lower case of 8 characters at once
+			inline uint64_t fold_word(uint64_t w) {
+				uint64_t const ones = 0x0101010101010101ull;
+				uint64_t const high = 0x8080808080808080ull;
+				uint64_t const heptets = w & ~high;
+				uint64_t const above_z = heptets + (0x7f - 'Z') * ones; // high bit set where the character is above 'Z'
+				uint64_t const from_a = heptets + (0x80 - 'A') * ones; // high bit set where the character is 'A' or above
+				uint64_t const upper = (from_a ^ above_z) & ~w & high;
+				return w | (upper >> 2);
+			}
+			inline uint64_t mix(uint64_t h, uint64_t w) {
+				h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+				return h ^ (h >> 29);
+			}
+			inline uint64_t finalize(uint64_t h) {
+				h ^= h >> 33;
+				h *= 0xff51afd7ed558ccdull;
+				h ^= h >> 33;
+				h *= 0xc4ceb9fe1a85ec53ull;
+				return h ^ (h >> 33);
+			}
+
+			inline size_t hash_nc(const char* s, size_t n) {
+				uint64_t h = mix(0, n);
+				size_t i = 0;
+				for (; i + 8 <= n; i += 8)
+					h = mix(h, fold_word(load_word(s + i)));
+				if (i < n) {
+					uint64_t w = 0;
+					memcpy(&w, s + i, n - i);
+					h = mix(h, fold_word(w));
+				}
+				return static_cast<size_t>(finalize(h));
+			}
+			inline size_t hash_nc(const wchar_t* s, size_t n) {
+				uint64_t h = mix(0, n);
+				for (size_t i = 0; i < n; ++i)
+					h = mix(h, static_cast<uint64_t>(fold_nc(s[i])));
+				return static_cast<size_t>(finalize(h));
+			}
+
+			inline bool equal_nc(const char* s1, const char* s2, size_t n) {
+				size_t i = 0;
+				for (; i + 8 <= n; i += 8) {
+					uint64_t const w1 = load_word(s1 + i);
+					uint64_t const w2 = load_word(s2 + i);
+					if (w1 != w2 && fold_word(w1) != fold_word(w2))
+						return false;
+				}
+				for (; i < n; ++i)
+					if (fold_nc(s1[i]) != fold_nc(s2[i]))
+						return false;
+				return true;
+			}
+			inline bool equal_nc(const wchar_t* s1, const wchar_t* s2, size_t n) {
+				for (size_t i = 0; i < n; ++i)
+					if (fold_nc(s1[i]) != fold_nc(s2[i]))
+						return false;
+				return true;
+			}
+
+			// characters are compared as char_t, the same way as std::lexicographical_compare does
+			inline size_t first_difference_nc(const char* s1, const char* s2, size_t n) {
+				size_t i = 0;
+				for (; i + 8 <= n; i += 8)
+					if (fold_word(load_word(s1 + i)) != fold_word(load_word(s2 + i)))
+						break;
+				for (; i < n; ++i)
+					if (fold_nc(s1[i]) != fold_nc(s2[i]))
+						break;
+				return i;
+			}
+			inline size_t first_difference_nc(const wchar_t* s1, const wchar_t* s2, size_t n) {
+				size_t i = 0;
+				for (; i < n; ++i)
+					if (fold_nc(s1[i]) != fold_nc(s2[i]))
+						break;
+				return i;
+			}
+			template<typename char_t>
+			inline int compare_nc(const char_t* s1, size_t l1, const char_t* s2, size_t l2) {
+				size_t const i = first_difference_nc(s1, s2, std::min(l1, l2));
+				if (i < std::min(l1, l2))
+					return fold_nc(s1[i]) < fold_nc(s2[i]) ? -1 : 1;
+				return l1 < l2 ? -1 : (l1 > l2 ? 1 : 0);
+			}
+		}
+
 		// case insesitive equality
 		template<typename char_t>
 		static bool equal_nc(
@@ -734,10 +1075,30 @@ namespace autotelica {
 			const char_t* const s2,
 			size_t l2
 		) {
-			if (l1 != l2) return false;
-			for (size_t i = 0; i < l1; ++i)
-				if (!fast_no_case_equal(s1[i], s2[i])) return false;
-			return true;
+			return l1 == l2 && string_util_impl::equal_nc(s1, s2, l1);
+		}
+
+		// case insensitive three way comparison (negative if s1 comes first)
+		template<typename char_t>
+		inline int compare_nc(
+			const char_t* const s1,
+			size_t l1,
+			const char_t* const s2,
+			size_t l2
+		) {
+			return string_util_impl::compare_nc(s1, l1, s2, l2);
+		}
+
+		// case insensitive hash, equal strings (ignoring case) have equal hashes
+		template<typename char_t>
+		inline size_t hash_nc(const char_t* const s, size_t l) {
+			return string_util_impl::hash_nc(s, l);
+		}
+		inline size_t hash_nc(std::string const& s) {
+			return hash_nc(s.c_str(), s.size());
+		}
+		inline size_t hash_nc(std::wstring const& s) {
+			return hash_nc(s.c_str(), s.size());
 		}
 		
 		template<typename char_t>
@@ -834,14 +1195,20 @@ namespace autotelica {
 			to_lower_inpl_<wchar_t>(s);
 		}
 		// case insesitive less for strings
+		// it is transparent, so ordered containers can be searched with string literals without making strings
 		template<typename char_t>
 		struct less_nc_t : std::binary_function<std::basic_string<char_t>, std::basic_string<char_t>, bool>
 		{
-			bool operator() (std::basic_string<char_t> const& s1, std::basic_string<char_t> const& s2) const {
-				return std::lexicographical_compare
-				(s1.begin(), s1.end(),   
-					s2.begin(), s2.end(),
-					[](const char_t c1, const char_t c2) {return (fast_to_lower(c1) < fast_to_lower(c2)); });  // comparison
+			using is_transparent = void;
+			using string_t = std::basic_string<char_t>;
+			bool operator() (string_t const& s1, string_t const& s2) const {
+				return compare_nc(s1.c_str(), s1.size(), s2.c_str(), s2.size()) < 0;
+			}
+			bool operator() (string_t const& s1, const char_t* const s2) const {
+				return compare_nc(s1.c_str(), s1.size(), s2, string_length(s2)) < 0;
+			}
+			bool operator() (const char_t* const s1, string_t const& s2) const {
+				return compare_nc(s1, string_length(s1), s2.c_str(), s2.size()) < 0;
 			}
 		};
 
@@ -854,14 +1221,25 @@ namespace autotelica {
 		template<typename char_t>
 		struct equal_nc_t : std::binary_function<std::basic_string<char_t>, std::basic_string<char_t>, bool>
 		{
-			bool operator() (std::basic_string<char_t> const& s1, std::basic_string<char_t> const& s2) const {
-				return equal_nc(s1, s2);  // comparison
+			using string_t = std::basic_string<char_t>;
+			bool operator() (string_t const& s1, string_t const& s2) const {
+				return equal_nc(s1.c_str(), s1.size(), s2.c_str(), s2.size());  // comparison
+			}
+			bool operator() (string_t const& s1, const char_t* const s2) const {
+				return equal_nc(s1.c_str(), s1.size(), s2, string_length(s2));
+			}
+			bool operator() (const char_t* const s1, string_t const& s2) const {
+				return equal_nc(s1, string_length(s1), s2.c_str(), s2.size());
 			}
 		};
+		// hashes case folded characters as it goes, doesn't make a lower case copy
 		template<typename char_t>
 		struct hash_nc_t {
 			size_t operator()(std::basic_string<char_t> const& s) const {
-				return std::hash<std::basic_string<char_t>>()(to_lower(s));
+				return hash_nc(s.c_str(), s.size());
+			}
+			size_t operator()(const char_t* const s) const {
+				return hash_nc(s, string_length(s));
 			}
 		};
 
@@ -899,35 +1277,331 @@ namespace autotelica {
 			static constexpr auto escape = L'\\';
 			static constexpr auto replace = L'%';
 		};
-		template<typename char_t>
-		static void var_printf(std::basic_ostream<char_t>& out, const char_t* format){ // base function
-			out << std::boolalpha << format;
-		}
 
-		template<typename char_t, typename T, typename... Targs>
-		static void var_printf(std::basic_ostream<char_t>& out, const char_t* format, T value, Targs... Fargs){
+		namespace string_util_impl {
+			// the "C" locale, numbers that go through the C library are formatted and read in it
+			// so that the decimal point doesn't depend on the global locale (LC_NUMERIC)
+#ifdef _MSC_VER
+			inline _locale_t c_locale() {
+				static _locale_t const _locale = _create_locale(LC_ALL, "C");
+				return _locale;
+			}
+#else
+			inline locale_t c_locale() {
+				static locale_t const _locale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+				return _locale;
+			}
+#endif
+			// snprintf in the "C" locale
+			// there is no snprintf_l in glibc, so elsewhere the thread's locale is switched for the call
+			template<typename... ArgsT>
+			inline int c_snprintf(char* buffer_, size_t size_, const char* format_, ArgsT... args_) {
+#ifdef _MSC_VER
+				return _snprintf_l(buffer_, size_, format_, c_locale(), args_...);
+#else
+				locale_t const previous = uselocale(c_locale());
+				int const n = snprintf(buffer_, size_, format_, args_...);
+				uselocale(previous);
+				return n;
+#endif
+			}
 
-			for (; *format != varprint_symbols<char_t>::null; format++)
-			{
-				if (*format == varprint_symbols<char_t>::escape && *(format + 1) != varprint_symbols<char_t>::replace) {
-					format++;
+			// Formatting writes through a sink.
+			// Numbers, booleans, characters and strings are written directly, without streams or locales,
+			// anything else goes through operator<<.
+
+			// counts characters, for size queries
+			template<typename char_t>
+			class counting_sink_t {
+				size_t _size;
+			public:
+				counting_sink_t() :_size(0) {}
+				void append(const char_t* s_, size_t n_) { _size += n_; }
+				void put(char_t) { ++_size; }
+				size_t size() const { return _size; }
+				template<typename T>
+				bool stream(T const&) { return false; }
+			};
+
+			// writes into a caller supplied buffer, counts what didn't fit
+			template<typename char_t>
+			class buffer_sink_t {
+				char_t* const _buffer;
+				size_t const _capacity;
+				size_t _size;
+			public:
+				buffer_sink_t(char_t* buffer_, size_t capacity_) :_buffer(buffer_), _capacity(capacity_), _size(0) {}
+				void append(const char_t* s_, size_t n_) {
+					if (_size < _capacity)
+						memcpy(_buffer + _size, s_, std::min(n_, _capacity - _size) * sizeof(char_t));
+					_size += n_;
+				}
+				void put(char_t c_) {
+					if (_size < _capacity)
+						_buffer[_size] = c_;
+					++_size;
 				}
-				else if (*format == varprint_symbols<char_t>::replace)
-				{
-					out << std::boolalpha << value;
-					var_printf(out, format + 1, Fargs...); // recursive call
+				size_t size() const { return _size; }
+				template<typename T>
+				bool stream(T const&) { return false; }
+			};
+
+			// appends to a string
+			template<typename char_t>
+			class string_sink_t {
+				std::basic_string<char_t>& _out;
+			public:
+				string_sink_t(std::basic_string<char_t>& out_) :_out(out_) {}
+				void append(const char_t* s_, size_t n_) { _out.append(s_, n_); }
+				void put(char_t c_) { _out.push_back(c_); }
+				template<typename T>
+				bool stream(T const&) { return false; }
+			};
+
+			// writes to a stream, values go through operator<< if the stream isn't formatted the default way
+			template<typename char_t>
+			class ostream_sink_t {
+				std::basic_ostream<char_t>& _out;
+				bool const _plain;
+			public:
+				ostream_sink_t(std::basic_ostream<char_t>& out_) :
+					_out(out_ << std::boolalpha),
+					_plain((out_.flags() & ~std::ios_base::boolalpha) == (std::ios_base::dec | std::ios_base::skipws) &&
+						out_.precision() == 6 && out_.width() == 0) {
+				}
+				void append(const char_t* s_, size_t n_) { _out.write(s_, static_cast<std::streamsize>(n_)); }
+				void put(char_t c_) { _out.put(c_); }
+				template<typename T>
+				bool stream(T const& value_) {
+					if (_plain) return false;
+					_out << value_;
+					return true;
+				}
+			};
+
+			template<typename char_t>
+			inline size_t length(const char_t* s_) { return std::char_traits<char_t>::length(s_); }
+
+			template<typename IntT>
+			inline bool is_negative(IntT value_, std::true_type) { return value_ < IntT(0); }
+			template<typename IntT>
+			inline bool is_negative(IntT, std::false_type) { return false; }
+
+			template<typename char_t, typename SinkT, typename IntT>
+			inline void format_integer(SinkT& sink_, IntT value_) {
+				static constexpr char digit_pairs[] =
+					"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+					"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+					"8081828384858687888990919293949596979899";
+				using unsigned_t = typename std::make_unsigned<IntT>::type;
+				char_t buffer[24];
+				char_t* end = buffer + sizeof(buffer) / sizeof(char_t);
+				char_t* p = end;
+				bool const negative = is_negative(value_, std::is_signed<IntT>());
+				unsigned_t u = negative ? unsigned_t(0) - static_cast<unsigned_t>(value_) : static_cast<unsigned_t>(value_);
+				while (u >= 100) {
+					auto const pair = static_cast<size_t>(u % 100) * 2;
+					u /= 100;
+					*--p = static_cast<char_t>(digit_pairs[pair + 1]);
+					*--p = static_cast<char_t>(digit_pairs[pair]);
+				}
+				if (u >= 10) {
+					auto const pair = static_cast<size_t>(u) * 2;
+					*--p = static_cast<char_t>(digit_pairs[pair + 1]);
+					*--p = static_cast<char_t>(digit_pairs[pair]);
+				}
+				else
+					*--p = static_cast<char_t>('0' + u);
+				if (negative)
+					*--p = static_cast<char_t>('-');
+				sink_.append(p, static_cast<size_t>(end - p));
+			}
+
+			// same output as a stream with default formatting: general notation, 6 significant digits
+			template<typename char_t, typename SinkT>
+			inline void format_floating(SinkT& sink_, long double value_) {
+				char buffer[64];
+				int const n = c_snprintf(buffer, sizeof(buffer), "%Lg", value_);
+				for (int i = 0; i < n; ++i)
+					sink_.put(static_cast<char_t>(buffer[i]));
+			}
+			template<typename char_t, typename SinkT>
+			inline void format_floating(SinkT& sink_, double value_) {
+				// whole numbers with up to 6 digits are written as integers in general notation
+				if (value_ > -1e6 && value_ < 1e6 && value_ == static_cast<double>(static_cast<long>(value_)) &&
+						!(value_ == 0 && std::signbit(value_))) {
+					format_integer<char_t>(sink_, static_cast<long>(value_));
 					return;
 				}
-				out << std::boolalpha << *format;
+				char buffer[64];
+				int const n = c_snprintf(buffer, sizeof(buffer), "%g", value_);
+				for (int i = 0; i < n; ++i)
+					sink_.put(static_cast<char_t>(buffer[i]));
 			}
+
+			template<typename char_t, typename SinkT, typename T>
+			inline void format_streamed(SinkT& sink_, T const& value_) {
+				if (sink_.stream(value_)) return;
+				std::basic_ostringstream<char_t> out;
+				out << std::boolalpha << value_;
+				auto const s = out.str();
+				sink_.append(s.c_str(), s.size());
+			}
+
+			// characters print as characters in streams of the same width (and char widens), other character types print as numbers
+			template<typename char_t, typename T>
+			struct is_printed_as_character : std::integral_constant<bool,
+				std::is_same<T, char_t>::value || std::is_same<T, char>::value ||
+				(std::is_same<char_t, char>::value && (std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value))> {};
+
+			template<typename char_t, typename T, typename Enable = void>
+			struct value_formatter {
+				template<typename SinkT>
+				static void format(SinkT& sink_, T const& value_) { format_streamed<char_t>(sink_, value_); }
+			};
+			template<typename char_t>
+			struct value_formatter<char_t, bool> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, bool value_) {
+					if (sink_.stream(value_)) return;
+					static constexpr char_t t[] = { 't','r','u','e' };
+					static constexpr char_t f[] = { 'f','a','l','s','e' };
+					if (value_) sink_.append(t, 4);
+					else sink_.append(f, 5);
+				}
+			};
+			template<typename char_t, typename T>
+			struct value_formatter<char_t, T, typename std::enable_if<is_printed_as_character<char_t, T>::value>::type> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, T value_) { 
+					if (sink_.stream(value_)) return;
+					sink_.put(static_cast<char_t>(value_)); 
+				}
+			};
+			template<typename char_t, typename T>
+			struct value_formatter<char_t, T, typename std::enable_if<
+					std::is_integral<T>::value && !std::is_same<T, bool>::value && !is_printed_as_character<char_t, T>::value>::type> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, T value_) { 
+					if (sink_.stream(value_)) return;
+					format_integer<char_t>(sink_, value_);
+				}
+			};
+			template<typename char_t, typename T>
+			struct value_formatter<char_t, T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, T value_) {
+					if (sink_.stream(value_)) return;
+					using promoted_t = typename std::conditional<std::is_same<T, long double>::value, long double, double>::type;
+					format_floating<char_t>(sink_, static_cast<promoted_t>(value_));
+				}
+			};
+			template<typename char_t>
+			struct value_formatter<char_t, const char_t*> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, const char_t* value_) {
+					if (value_) sink_.append(value_, length(value_));
+				}
+			};
+			template<typename char_t>
+			struct value_formatter<char_t, char_t*> : public value_formatter<char_t, const char_t*> {};
+			template<typename char_t>
+			struct value_formatter<char_t, std::basic_string<char_t>> {
+				template<typename SinkT>
+				static void format(SinkT& sink_, std::basic_string<char_t> const& value_) {
+					sink_.append(value_.c_str(), value_.size());
+				}
+			};
+
+			// arrays (string literals) are formatted as pointers
+			template<typename T>
+			inline T const& decay_argument(T const& value_) { return value_; }
+			template<typename T, size_t N>
+			inline T const* decay_argument(T const (&value_)[N]) { return value_; }
+
+			template<typename char_t, typename SinkT, typename T>
+			inline void format_value(SinkT& sink_, T const& value_) {
+				value_formatter<char_t, T>::format(sink_, value_);
+			}
+
+			template<typename char_t, typename SinkT>
+			inline void format(SinkT& sink_, const char_t* format_) { // base function
+				sink_.append(format_, length(format_));
+			}
+
+			template<typename char_t, typename SinkT, typename T, typename... Targs>
+			inline void format(SinkT& sink_, const char_t* format_, T const& value_, Targs const&... Fargs) {
+				using symbols = varprint_symbols<char_t>;
+				const char_t* run = format_; // text copied as it is
+				for (; *format_ != symbols::null; ++format_) {
+					if (*format_ == symbols::escape && *(format_ + 1) != symbols::replace) {
+						sink_.append(run, static_cast<size_t>(format_ - run));
+						if (*(format_ + 1) == symbols::null) 
+							return;
+						run = ++format_; // escaped character is copied as it is
+					}
+					else if (*format_ == symbols::replace) {
+						sink_.append(run, static_cast<size_t>(format_ - run));
+						format_value<char_t>(sink_, decay_argument(value_));
+						format<char_t>(sink_, format_ + 1, Fargs...); // recursive call
+						return;
+					}
+				}
+				sink_.append(run, static_cast<size_t>(format_ - run));
+			}
+		}
+
+		template<typename char_t, typename... Targs>
+		inline void var_printf(std::basic_ostream<char_t>& out, const char_t* format, Targs const&... Fargs){
+			string_util_impl::ostream_sink_t<char_t> sink(out);
+			string_util_impl::format<char_t>(sink, format, Fargs...);
+		}
+
+		// size of the formatted string, without the terminating null
+		template<typename char_t, typename... Targs>
+		inline size_t formatted_size(const char_t* format, Targs const&... Fargs) {
+			string_util_impl::counting_sink_t<char_t> sink;
+			string_util_impl::format<char_t>(sink, format, Fargs...);
+			return sink.size();
+		}
+
+		// formats into a caller supplied buffer of size_ characters, always null terminated (unless size_ is 0)
+		// returns the size of the whole formatted string, so truncation is detected by comparing it with size_
+		template<typename char_t, typename... Targs>
+		inline size_t format_to(char_t* buffer, size_t size_, const char_t* format, Targs const&... Fargs) {
+			if (!size_) 
+				return formatted_size(format, Fargs...);
+			string_util_impl::buffer_sink_t<char_t> sink(buffer, size_ - 1);
+			string_util_impl::format<char_t>(sink, format, Fargs...);
+			buffer[std::min(sink.size(), size_ - 1)] = varprint_symbols<char_t>::null;
+			return sink.size();
+		}
+
+		// appends formatted string to out
+		template<typename char_t, typename... Targs>
+		inline void format_append(std::basic_string<char_t>& out, const char_t* format, Targs const&... Fargs) {
+			string_util_impl::string_sink_t<char_t> sink(out);
+			string_util_impl::format<char_t>(sink, format, Fargs...);
+		}
+
+		// appends a single value to out, formatted the same way as in af_format_string
+		template<typename char_t, typename T>
+		inline void append_value(std::basic_string<char_t>& out, T const& value) {
+			string_util_impl::string_sink_t<char_t> sink(out);
+			string_util_impl::format_value<char_t>(sink, string_util_impl::decay_argument(value));
 		}
 
 		// string interpolation, like modern languages do it
+		// formats on the stack first, so short results don't allocate beyond the returned string
 		template<typename char_t, typename... Targs>
-		inline std::basic_string<char_t> af_format_string(const char_t* format, Targs... Fargs) {
-			std::basic_stringstream<char_t> s;
-			var_printf(s, format, Fargs...);
-			return s.str();
+		inline std::basic_string<char_t> af_format_string(const char_t* format, Targs const&... Fargs) {
+			char_t buffer[256];
+			size_t const size = format_to(buffer, 256, format, Fargs...);
+			if (size < 256)
+				return std::basic_string<char_t>(buffer, size);
+			std::basic_string<char_t> s(size, varprint_symbols<char_t>::null);
+			format_to(&s[0], size + 1, format, Fargs...);
+			return s;
 		}
 
 		
@@ -1359,24 +2033,244 @@ namespace autotelica {
 		template<>
 		inline bool convert_string<bool>(std::wstring const& s) { return equal_nc(trim(s), L"true") ? true : false; }
 
+		// non-throwing conversions, in the manner of std::from_chars
+		// the text (less surrounding whitespace, for numbers and bools) has to hold just the value,
+		// out_ is only written when the conversion succeeds
+		// numbers are read without going through the locale, bools are true/false (any case) or 1/0
+		enum class convert_status { ok, invalid, out_of_range };
+
+		namespace string_util_impl {
+			template<typename char_t>
+			inline bool convert_blank(char_t c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+			template<typename char_t>
+			inline void convert_trim(const char_t*& first_, const char_t*& last_) {
+				while (first_ != last_ && convert_blank(*first_)) ++first_;
+				while (last_ != first_ && convert_blank(last_[-1])) --last_;
+			}
+			template<typename char_t>
+			inline unsigned convert_digit(char_t c) { return static_cast<unsigned>(c) - static_cast<unsigned>('0'); }
+
+			template<typename char_t, typename T>
+			inline std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value, convert_status>
+				convert_range(const char_t* first_, const char_t* last_, T& out_) {
+				using unsigned_t = std::make_unsigned_t<T>;
+				convert_trim(first_, last_);
+				bool negative = false;
+				if (first_ != last_ && (*first_ == '-' || *first_ == '+')) {
+					negative = *first_ == '-';
+					++first_;
+				}
+				if (first_ == last_) return convert_status::invalid;
+				unsigned_t const limit = negative ?
+					static_cast<unsigned_t>(static_cast<unsigned_t>(std::numeric_limits<T>::max()) + (std::is_signed<T>::value ? 1 : 0)) :
+					static_cast<unsigned_t>(std::numeric_limits<T>::max());
+				unsigned_t value = 0;
+				bool overflow = false;
+				for (; first_ != last_; ++first_) {
+					unsigned const digit = convert_digit(*first_);
+					if (digit > 9) return convert_status::invalid;
+					if (value > (limit - digit) / 10) overflow = true;
+					else value = static_cast<unsigned_t>(value * 10 + digit);
+				}
+				if (overflow || (negative && !std::is_signed<T>::value && value)) return convert_status::out_of_range;
+				out_ = negative ? static_cast<T>(0 - value) : static_cast<T>(value);
+				return convert_status::ok;
+			}
+
+			// strtod and friends in the "C" locale (see c_locale)
+#ifdef _MSC_VER
+			inline float convert_strto(const char* s_, char** e_, float) { return _strtof_l(s_, e_, c_locale()); }
+			inline double convert_strto(const char* s_, char** e_, double) { return _strtod_l(s_, e_, c_locale()); }
+			inline long double convert_strto(const char* s_, char** e_, long double) { return _strtold_l(s_, e_, c_locale()); }
+#else
+			inline float convert_strto(const char* s_, char** e_, float) { return strtof_l(s_, e_, c_locale()); }
+			inline double convert_strto(const char* s_, char** e_, double) { return strtod_l(s_, e_, c_locale()); }
+			inline long double convert_strto(const char* s_, char** e_, long double) { return strtold_l(s_, e_, c_locale()); }
+#endif
+
+			// everything the fast path can't do exactly (long mantissas, big exponents, inf, nan) goes to strtod
+			template<typename char_t, typename T>
+			inline convert_status convert_floating_fallback(const char_t* first_, const char_t* last_, T& out_) {
+				char buffer[128];
+				size_t const size = static_cast<size_t>(last_ - first_);
+				std::string long_text;
+				char* text = buffer;
+				if (size >= sizeof(buffer)) {
+					long_text.resize(size);
+					text = &long_text[0];
+				}
+				for (size_t i = 0; i < size; ++i) {
+					if (static_cast<unsigned>(first_[i]) > 127) return convert_status::invalid;
+					text[i] = static_cast<char>(first_[i]);
+				}
+				text[size] = '\0';
+				char* end = nullptr;
+				int const saved_errno = errno;
+				errno = 0;
+				T const value = convert_strto(text, &end, T());
+				bool const out_of_range = errno == ERANGE;
+				errno = saved_errno;
+				if (end != text + size) return convert_status::invalid;
+				if (out_of_range) return convert_status::out_of_range;
+				out_ = value;
+				return convert_status::ok;
+			}
+
+			inline double power_of_ten(int e_) {
+				static const double powers[] = {
+					1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+					1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+				return powers[e_];
+			}
+
+			template<typename char_t, typename T>
+			inline std::enable_if_t<std::is_floating_point<T>::value, convert_status>
+				convert_range(const char_t* first_, const char_t* last_, T& out_) {
+				convert_trim(first_, last_);
+				if (first_ == last_) return convert_status::invalid;
+				const char_t* p = first_;
+				bool const negative = *p == '-';
+				if (*p == '-' || *p == '+') ++p;
+				// decimal mantissa of up to 19 significant digits and a power of ten
+				uint64_t mantissa = 0;
+				int digits = 0;
+				int exponent = 0;
+				bool any = false;
+				for (; p != last_ && convert_digit(*p) <= 9; ++p) {
+					any = true;
+					if (mantissa || *p != '0') {
+						if (++digits > 19) return convert_floating_fallback(first_, last_, out_);
+						mantissa = mantissa * 10 + convert_digit(*p);
+					}
+				}
+				if (p != last_ && *p == '.') {
+					for (++p; p != last_ && convert_digit(*p) <= 9; ++p) {
+						any = true;
+						if (mantissa || *p != '0') {
+							if (++digits > 19) return convert_floating_fallback(first_, last_, out_);
+							mantissa = mantissa * 10 + convert_digit(*p);
+						}
+						--exponent;
+					}
+				}
+				if (!any) return convert_floating_fallback(first_, last_, out_);
+				if (p != last_ && (*p == 'e' || *p == 'E')) {
+					++p;
+					bool const negative_exponent = p != last_ && *p == '-';
+					if (p != last_ && (*p == '-' || *p == '+')) ++p;
+					if (p == last_) return convert_status::invalid;
+					int e = 0;
+					for (; p != last_ && convert_digit(*p) <= 9; ++p)
+						if (e < 100000) e = e * 10 + static_cast<int>(convert_digit(*p));
+					exponent += negative_exponent ? -e : e;
+				}
+				if (p != last_) return convert_status::invalid;
+				if (mantissa == 0) {
+					out_ = negative ? -T(0) : T(0);
+					return convert_status::ok;
+				}
+				// a mantissa and a power of ten that are both exact in T give a correctly rounded result
+				// with a single multiplication or division
+				int const mantissa_bits = std::numeric_limits<T>::digits < 64 ? std::numeric_limits<T>::digits : 64;
+				int const max_exponent = std::numeric_limits<T>::digits < 53 ? 10 : 22;
+				if ((mantissa_bits < 64 && mantissa > (uint64_t(1) << mantissa_bits)) || exponent > max_exponent || exponent < -max_exponent)
+					return convert_floating_fallback(first_, last_, out_);
+				T value = static_cast<T>(mantissa);
+				if (exponent < 0) value /= static_cast<T>(power_of_ten(-exponent));
+				else value *= static_cast<T>(power_of_ten(exponent));
+				out_ = negative ? -value : value;
+				return convert_status::ok;
+			}
+
+			template<typename char_t>
+			inline bool convert_keyword(const char_t* first_, const char_t* last_, const char* keyword_) {
+				for (; first_ != last_ && *keyword_; ++first_, ++keyword_)
+					if (fold_nc(*first_) != static_cast<char_t>(*keyword_))
+						return false;
+				return first_ == last_ && !*keyword_;
+			}
+			template<typename char_t>
+			inline convert_status convert_range(const char_t* first_, const char_t* last_, bool& out_) {
+				convert_trim(first_, last_);
+				if (convert_keyword(first_, last_, "true") || convert_keyword(first_, last_, "1")) { out_ = true; return convert_status::ok; }
+				if (convert_keyword(first_, last_, "false") || convert_keyword(first_, last_, "0")) { out_ = false; return convert_status::ok; }
+				return convert_status::invalid;
+			}
+			template<typename char_t>
+			inline convert_status convert_range(const char_t* first_, const char_t* last_, std::basic_string<char_t>& out_) {
+				out_.assign(first_, last_);
+				return convert_status::ok;
+			}
+		}
+
+		template<typename T>
+		inline convert_status convert_string(const char* first_, const char* last_, T& out_) {
+			return string_util_impl::convert_range(first_, last_, out_);
+		}
+		template<typename T>
+		inline convert_status convert_string(const wchar_t* first_, const wchar_t* last_, T& out_) {
+			return string_util_impl::convert_range(first_, last_, out_);
+		}
+		template<typename T>
+		inline convert_status convert_string(const char* s_, T& out_) {
+			return convert_string(s_, s_ + string_length(s_), out_);
+		}
+		template<typename T>
+		inline convert_status convert_string(const wchar_t* s_, T& out_) {
+			return convert_string(s_, s_ + string_length(s_), out_);
+		}
+		template<typename T>
+		inline convert_status convert_string(std::string const& s_, T& out_) {
+			return convert_string(s_.data(), s_.data() + s_.size(), out_);
+		}
+		template<typename T>
+		inline convert_status convert_string(std::wstring const& s_, T& out_) {
+			return convert_string(s_.data(), s_.data() + s_.size(), out_);
+		}
+
+		// converts all the strings in [first_, last_) and appends the values to out_
+		// stops at the first string that does not convert and returns its status,
+		// so the number of values appended tells which string it was
+		template<typename It, typename T>
+		inline convert_status convert_strings(It first_, It last_, std::vector<T>& out_) {
+			out_.reserve(out_.size() + static_cast<size_t>(std::distance(first_, last_)));
+			for (; first_ != last_; ++first_) {
+				T value{};
+				auto const status = convert_string(*first_, value);
+				if (status != convert_status::ok)
+					return status;
+				out_.push_back(std::move(value));
+			}
+			return convert_status::ok;
+		}
+		template<typename string_t, typename T>
+		inline convert_status convert_strings(std::vector<string_t> const& in_, std::vector<T>& out_) {
+			return convert_strings(in_.begin(), in_.end(), out_);
+		}
+
 		template<typename T, typename string_t>
 		static void csv_to_vector(string_t const& csv, std::vector<T>& out) {
 			using char_t = typename string_t::value_type;
 			using symbols = string_util_impl::csv_symbols<char_t>;
-			string_t acc;
-			for (auto const c : csv) {
-				switch (c) {
-				case symbols::comma:
-					out.push_back(convert_string<T>(trim(acc)));
-					acc.clear();
-					break;
+			const char_t* p = csv.data();
+			const char_t* const end = p + csv.size();
+			while (p != end) {
+				const char_t* const comma = std::find(p, end, static_cast<char_t>(symbols::comma));
+				const char_t* first = p;
+				const char_t* last = comma;
+				string_util_impl::convert_trim(first, last);
+				T value{};
+				switch (convert_string(first, last, value)) {
+				case convert_status::invalid:
+					throw std::invalid_argument("csv_to_vector");
+				case convert_status::out_of_range:
+					throw std::out_of_range("csv_to_vector");
 				default:
-					acc.push_back(c);
 					break;
 				}
+				out.push_back(std::move(value));
+				p = comma == end ? end : comma + 1;
 			}
-			if (!acc.empty())
-				out.push_back(trim(acc));
 		}
 
 		template<typename T>
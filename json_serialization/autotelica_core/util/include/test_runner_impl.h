@@ -9,6 +9,11 @@ namespace autotelica {
 // -re, -run_examples with no arguments runs them all, with arguments runs listed ones
 // -rt, -run_tests with no arguments runs them all, with arguments runs listed ones
 // -record with no arguments records them all, with arguments records listed ones
+//          (benchmarks are measured and recorded with their results as baselines)
+// -rb, -run_benchmarks with no arguments runs benchmarks of all test sets, with arguments of listed ones
+// -threshold percent, benchmarks slower than their baselines by more than this are reported as errors (10 by default)
+// -benchmark_time milliseconds to spend measuring each benchmark (200 by default)
+// -j, -jobs number of test sets to run at the same time, each in its own process (1 by default)
 // -f filename outputs to file
 // -csv outputs in csv format
 // -excel outputs in excel csv format
@@ -45,6 +50,14 @@ class test_runner_impl{
         else
             AF_RECORD_TESTS(v);
     }
+    static void run_benchmarks(std::vector<std::string> const& v) {
+        if (v.empty()) {
+            AF_RUN_ALL_BENCHMARKS();
+        }
+        else {
+            AF_RUN_BENCHMARKS(v);
+        }
+    }
 
     static autotelica::cl_parsing::cl_commands register_commands(){
         using namespace autotelica::cl_parsing;
@@ -74,6 +87,27 @@ class test_runner_impl{
                 { "record" },
                 -1,
                 record)
+            .register_command(
+                "Run benchmarks",
+                "Runs benchmarks of named test sets (if none are named, all are run) and compares them with their baselines.",
+                { "rb", "run_benchmarks", "run-benchmarks" },
+                -1,
+                run_benchmarks)
+            .register_command(
+                "Benchmark threshold",
+                "Benchmarks slower than their baselines by more than this percentage are reported as errors (10 by default).",
+                { "threshold" },
+                1)
+            .register_command(
+                "Benchmark time",
+                "Milliseconds spent measuring each benchmark (200 by default).",
+                { "benchmark_time" },
+                1)
+            .register_command(
+                "Jobs",
+                "Number of test sets run at the same time, each in its own process (1 by default). Output is reported in the usual order.",
+                { "j", "jobs" },
+                1)
             .register_command(
                 "Save to file",
                 "Redirects test outputs to a named file.",
@@ -142,6 +176,26 @@ public:
                 testing_config::set_run_mode_plain_csv();
 
         }
+        auto numeric_argument = [&commands](std::string const& name_, auto& value_) {
+            std::string const& text = commands.arguments(name_)[0];
+            AF_ASSERT(string_util::convert_string(text, value_) == string_util::convert_status::ok,
+                "Argument % of -% is not a valid number.", text, name_);
+        };
+        if (commands.has("threshold")) {
+            double threshold = 0;
+            numeric_argument("threshold", threshold);
+            testing_config::set_benchmark_threshold(threshold / 100.0);
+        }
+        if (commands.has("benchmark_time")) {
+            long long milliseconds = 0;
+            numeric_argument("benchmark_time", milliseconds);
+            testing_config::set_benchmark_time(std::chrono::milliseconds(milliseconds));
+        }
+        if (commands.has("jobs")) {
+            size_t jobs = 1;
+            numeric_argument("jobs", jobs);
+            testing_config::set_jobs(jobs);
+        }
         if (commands.has("output_file")) {
             std::string file_name = commands.arguments("output_file")[0];
            std::ignore = make_file_message_handler_active(file_name);
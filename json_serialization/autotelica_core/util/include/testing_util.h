@@ -9,6 +9,19 @@
 #include <exception>
 #include <type_traits>
 #include <functional>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifndef _WIN32
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 #include "string_util.h"
 #include "comparissons.h"
 #include "macro_magic.h"
@@ -29,7 +42,8 @@ namespace autotelica {
 				recording,		// test macros can record themselves, 
 								// in this mode every testing macro outputs itself with correct results as expected result
 				plain_csv,		// only execute tests, output results of tests in plain csv format, errors are reported in output, not thrown as exceptions
-				excel_csv		// only execute tests, output results of tests in excel csv format, errors are reported in output, not thrown as exceptions
+				excel_csv,		// only execute tests, output results of tests in excel csv format, errors are reported in output, not thrown as exceptions
+				benchmarking	// benchmarks are measured and compared to their recorded baselines, other tests run as in examples
 			};
 		private:
 			run_mode _run_mode;
@@ -38,6 +52,14 @@ namespace autotelica {
 			float _float_epsilon;
 			double _double_epsilon;
 
+			// benchmarks are slower than the baseline when ns/op exceeds it by more than the threshold (a fraction)
+			double _benchmark_threshold;
+			// time spent measuring each benchmark, after the warmup
+			std::chrono::milliseconds _benchmark_time;
+
+			// number of test sets run at the same time, each in its own process
+			size_t _jobs;
+
 			testing_config() {
 				_reset();
 			}
@@ -49,6 +71,9 @@ namespace autotelica {
 			void _reset() { // initialisation
 				_float_epsilon = sqrt(std::numeric_limits<float>::epsilon());
 				_double_epsilon = sqrt(std::numeric_limits<double>::epsilon());
+				_benchmark_threshold = 0.1;
+				_benchmark_time = std::chrono::milliseconds(200);
+				_jobs = 1;
 				_run_mode = run_mode::examples;
 			}
 		public:
@@ -59,6 +84,15 @@ namespace autotelica {
 			static float set_float_epsilon(float const& f) { return get()->_float_epsilon = f; }
 			static double set_double_epsilon(double const& d) { return get()->_double_epsilon = d; }
 
+			static double benchmark_threshold() { return get()->_benchmark_threshold; }
+			static std::chrono::milliseconds benchmark_time() { return get()->_benchmark_time; }
+
+			static double set_benchmark_threshold(double const& t) { return get()->_benchmark_threshold = t; }
+			static std::chrono::milliseconds set_benchmark_time(std::chrono::milliseconds const& t) { return get()->_benchmark_time = t; }
+
+			static size_t jobs() { return get()->_jobs; }
+			static size_t set_jobs(size_t j) { return get()->_jobs = (j ? j : 1); }
+
 			static run_mode current_run_mode() { return get()->_run_mode; }
 			static void set_run_mode(run_mode mode) { get()->_run_mode = mode; }
 			
@@ -67,6 +101,7 @@ namespace autotelica {
 			static void set_run_mode_recording() { set_run_mode(run_mode::recording); }
 			static void set_run_mode_plain_csv() { set_run_mode(run_mode::plain_csv); }
 			static void set_run_mode_excel_csv() { set_run_mode(run_mode::excel_csv); }
+			static void set_run_mode_benchmarking() { set_run_mode(run_mode::benchmarking); }
 
 
 			static bool is_run_mode_examples() { return current_run_mode() == run_mode::examples; }
@@ -75,6 +110,7 @@ namespace autotelica {
 			static bool is_run_mode_plain_csv() { return current_run_mode() == run_mode::plain_csv; }
 			static bool is_run_mode_excel_csv() { return current_run_mode() == run_mode::excel_csv; }
 			static bool is_run_mode_csv() { return is_run_mode_plain_csv() || is_run_mode_excel_csv(); }
+			static bool is_run_mode_benchmarking() { return current_run_mode() == run_mode::benchmarking; }
 
 			static bool throw_on_error() { return is_run_mode_testing() && diagnostic_messages::messages::throw_errors(); }
 			static bool run_examples() { return is_run_mode_examples(); }
@@ -82,6 +118,19 @@ namespace autotelica {
 			static void reset() { get()->_reset(); }
 		};
 
+		// keeps the optimiser from throwing away values computed in benchmarks
+		// the compiler has to assume that value is read and that any memory may have changed, but no code is emitted
+		template<typename T>
+		inline void do_not_optimize(T const& value) {
+#ifdef _MSC_VER
+			static void const* volatile sink;
+			sink = &value;
+			_ReadWriteBarrier();
+#else
+			asm volatile("" : : "g"(value) : "memory");
+#endif
+		}
+
 		namespace testing_impl {
 			// outputing strings when recording is a pain
 			// quote_string deals with that pain
@@ -501,6 +550,126 @@ namespace autotelica {
 				}
 			}
 
+			// benchmarks
+			// a benchmark is measured in samples, each sample runs the snippet enough times to take about a millisecond
+			// ns/op is the mean of the samples left after dropping the outliers (outside 1.5 interquartile ranges)
+			struct benchmark_result {
+				double _ns_per_op;
+				size_t _samples;
+				size_t _rejected;
+				size_t _iterations;		// per sample
+
+				double ops_per_second() const { return _ns_per_op > 0 ? 1e9 / _ns_per_op : 0; }
+			};
+
+			// mean of samples without outliers, rejected_ is set to the number of outliers
+			static double mean_without_outliers(std::vector<double> samples, size_t& rejected_) {
+				rejected_ = 0;
+				if (samples.empty())
+					return 0;
+				std::sort(samples.begin(), samples.end());
+				double q1 = samples[samples.size() / 4];
+				double q3 = samples[(samples.size() * 3) / 4];
+				double low = q1 - 1.5 * (q3 - q1);
+				double high = q3 + 1.5 * (q3 - q1);
+				double total = 0;
+				size_t count = 0;
+				for (auto s : samples) {
+					if (s < low || s > high)
+						++rejected_;
+					else {
+						total += s;
+						++count;
+					}
+				}
+				return count ? total / count : 0;
+			}
+
+			template<typename lambda_t>
+			static benchmark_result measure_benchmark(lambda_t lambda) {
+				using clock = std::chrono::steady_clock;
+				using namespace std::chrono;
+				auto const sample_time = microseconds(1000);
+				auto const time = duration_cast<nanoseconds>(testing_config::benchmark_time());
+
+				auto run = [&](size_t iterations_) {
+					auto start = clock::now();
+					for (size_t i = 0; i < iterations_; ++i)
+						lambda();
+					return duration_cast<nanoseconds>(clock::now() - start);
+				};
+				// warmup, and finding how many iterations make a sample
+				size_t iterations = 1;
+				auto warmup = time / 10;
+				nanoseconds elapsed = run(iterations);
+				nanoseconds warmed = elapsed;
+				while (elapsed < sample_time || warmed < warmup) {
+					if (elapsed < sample_time)
+						iterations *= 2;
+					elapsed = run(iterations);
+					warmed += elapsed;
+				}
+				// samples
+				std::vector<double> samples;
+				nanoseconds measured(0);
+				while (samples.size() < 5 || (measured < time && samples.size() < 1000)) {
+					elapsed = run(iterations);
+					measured += elapsed;
+					samples.push_back(static_cast<double>(elapsed.count()) / iterations);
+				}
+				benchmark_result out{ 0, samples.size(), 0, iterations };
+				out._ns_per_op = mean_without_outliers(samples, out._rejected);
+				return out;
+			}
+
+			// in benchmarking mode the snippet is measured and compared with the baseline (ns/op, 0 for none)
+			// in recording mode it is measured and recorded with the result as the baseline
+			// otherwise it runs once, as a test
+			template<typename lambda_t>
+			static void test_benchmark(
+				double baseline_ns_per_op,
+				const char* const macro_name,
+				lambda_t lambda,
+				const char* const code_snippet,
+				const char* const file_name,
+				int line
+			) {
+				using namespace diagnostic_messages;
+				using config = autotelica::testing::testing_config;
+				if (!config::is_run_mode_benchmarking() && !config::is_run_mode_recording()) {
+					test_no_throw(macro_name, lambda, code_snippet, file_name, line);
+					return;
+				}
+				try {
+					auto result = measure_benchmark(lambda);
+					if (config::is_run_mode_recording()) {
+						record_macro_with_result(result._ns_per_op, macro_name, code_snippet);
+						return;
+					}
+					double threshold = config::benchmark_threshold();
+					if (baseline_ns_per_op > 0 && result._ns_per_op > baseline_ns_per_op * (1 + threshold))
+						messages::error_text_ex(file_name, line,
+							"% regressed: % ns/op (% ops/sec), baseline was % ns/op, threshold is % percent.",
+							code_snippet, result._ns_per_op, result.ops_per_second(), baseline_ns_per_op, threshold * 100);
+					else if (baseline_ns_per_op > 0)
+						messages::message(
+							"SUCCESS: % ran at % ns/op (% ops/sec), baseline was % ns/op (% samples of %, % outliers).",
+							code_snippet, result._ns_per_op, result.ops_per_second(), baseline_ns_per_op,
+							result._samples, result._iterations, result._rejected);
+					else
+						messages::message(
+							"BENCHMARK: % ran at % ns/op (% ops/sec), there is no baseline (% samples of %, % outliers).",
+							code_snippet, result._ns_per_op, result.ops_per_second(),
+							result._samples, result._iterations, result._rejected);
+				}
+				catch (std::exception const& e) {
+					report_exception_error(code_snippet, file_name, line, e.what(), false);
+				}
+				catch (...) {
+					report_exception_error(code_snippet, file_name, line, "Unknown exception", false);
+				}
+			}
+
 			static void comment_test(const char* const comment) {
 				using namespace autotelica::diagnostic_messages;
 				using config = autotelica::testing::testing_config;
@@ -527,6 +696,7 @@ namespace autotelica {
 			virtual void run_examples() const = 0;
 			virtual void run_tests()  const = 0;
 			virtual void run_recording()  const = 0;
+			virtual void run_benchmarks()  const = 0;
 		};
 
 		// all_tests is a registry for tests
@@ -535,7 +705,9 @@ namespace autotelica {
 				std::shared_ptr< test_runner_base > _runner;
 				std::string _file;
 				std::string _class;
+				bool _serial;	// never runs at the same time as other test sets
 			};
+			using run_f = void (test_runner_base::*)() const;
 			string_util::map_nc<test_record> _tests;
 
 			all_tests(){}
@@ -547,7 +719,8 @@ namespace autotelica {
 				const char* const name, 
 				std::shared_ptr< test_runner_base > runner, 
 				std::string const& file_, 
-				std::string const& class_
+				std::string const& class_,
+				bool serial_
 				) {
 				// we look for duplicates, but we are very forgiving of static initialisation issues
 				auto const& existing = _tests.find(name);
@@ -567,7 +740,7 @@ namespace autotelica {
 						throw std::runtime_error(error);
 					}
 				}
-				_tests[name] = test_record{ runner, file_, class_ };
+				_tests[name] = test_record{ runner, file_, class_, serial_ };
 			}
 			std::vector<test_record>
 			find_tests(std::string const& pattern) {
@@ -578,19 +751,20 @@ namespace autotelica {
 				// 4. a wildcard string for any of those
 				
 				// a cool thing about wildcard matches is that they will do an exact match too
+				string_util::compiled_wildcard const wildcard(pattern);
 				std::vector<test_record> out;
 				for (auto const& r : _tests) {
-					if (string_util::wildcard_match(r.first, pattern))
+					if (wildcard.match(r.first))
 						out.push_back(r.second);
 				}
 				if (!out.empty()) return out;
 				for (auto const& r : _tests) {
-					if (string_util::wildcard_match(r.second._class, pattern))
+					if (wildcard.match(r.second._class))
 						out.push_back(r.second);
 				}
 				if (!out.empty()) return out;
 				for (auto const& r : _tests) {
-					if (string_util::wildcard_match(r.second._file, pattern))
+					if (wildcard.match(r.second._file))
 						out.push_back(r.second);
 				}
 				if (out.empty()) {
@@ -623,6 +797,183 @@ namespace autotelica {
 					return it->second._class;
 				return "";
 			}
+			bool is_serial_impl(std::string const& name) const {
+				auto const& it = _tests.find(name);
+				return it != _tests.end() && it->second._serial;
+			}
+
+			// parallel runs
+			// every test set runs in a forked process, so that global state (messages configuration, run modes) 
+			// doesn't leak between test sets running at the same time
+			// output of each test set is captured and printed once all are done, in registry order
+			// messages emitted in the child are captured with the rest of its output and passed on to the handler in this process,
+			// errors collected by an error_collector in the child are passed on to the collector in this process
+			// serial test sets run after the others, one at a time
+#ifndef _WIN32
+			static std::string read_all(FILE* f) {
+				std::string out;
+				char buffer[4096];
+				fflush(f);
+				fseek(f, 0, SEEK_SET);
+				size_t read = 0;
+				while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+					out.append(buffer, read);
+				return out;
+			}
+			// runs in the child process, returns the exit code
+			static int run_child(test_record const& test_, run_f run_, FILE* output_, FILE* errors_) {
+				using namespace diagnostic_messages;
+				dup2(fileno(output_), 1);
+				dup2(fileno(output_), 2);
+				auto collector = std::dynamic_pointer_cast<error_collector>(messages::current_handler());
+				size_t known_errors = collector ? collector->errors().size() : 0;
+				if (!collector && messages::current_handler())
+					messages::reset_handler();	// so that messages end up in the captured output
+				int status = 0;
+				auto add_error = [&](std::string const& error_) {
+					fwrite(error_.c_str(), 1, error_.size() + 1, errors_);// errors are separated by '\0'
+					status = 1;
+				};
+				try {
+					((*test_._runner).*run_)();
+				}
+				catch (std::exception const& e) {
+					add_error(e.what());
+				}
+				catch (...) {
+					add_error("Unknown exception");
+				}
+				if (collector)
+					for (size_t i = known_errors; i < collector->errors().size(); ++i)
+						add_error(collector->errors()[i]);
+				std::cout.flush();
+				std::wcout.flush();
+				fflush(stdout);
+				fflush(stderr);
+				fflush(errors_);
+				return status;
+			}
+#endif
+			void run_parallel_impl(std::vector<test_record> const& tests_, run_f run_) {
+				using namespace diagnostic_messages;
+#ifdef _WIN32
+				messages::warning("Parallel test runs are not supported on Windows, running test sets one by one.");
+				for (auto const& t : tests_)
+					((*t._runner).*run_)();
+#else
+				struct child_t {
+					pid_t _pid;
+					FILE* _output;
+					FILE* _errors;
+					int _status;
+				};
+				std::vector<child_t> children(tests_.size(), child_t{ 0, nullptr, nullptr, 0 });
+				size_t running = 0;
+				// only our own children are waited for, other children of the process are left to their owners
+				auto wait_one = [&]() {
+					while (true) {
+						for (auto& c : children) {
+							if (!c._pid)
+								continue;
+							int status = 0;
+							pid_t pid = waitpid(c._pid, &status, WNOHANG);
+							if (pid == 0 || (pid < 0 && errno == EINTR))
+								continue;
+							if (pid < 0)
+								throw std::runtime_error(string_util::af_format_string(
+									"Failed to wait for test process % (errno %).", c._pid, errno));
+							c._pid = 0;
+							c._status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+							--running;
+							return;
+						}
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+				};
+				auto start = [&](size_t i) {
+					auto& c = children[i];
+					c._output = tmpfile();
+					c._errors = tmpfile();
+					if (!c._output || !c._errors)
+						throw std::runtime_error("Failed to create files for capturing test output.");
+					std::cout.flush();
+					fflush(stdout);
+					fflush(stderr);
+					pid_t pid = fork();
+					if (pid < 0)
+						throw std::runtime_error("Failed to start a process for running tests.");
+					if (pid == 0)
+						_exit(run_child(tests_[i], run_, c._output, c._errors));
+					c._pid = pid;
+					++running;
+				};
+				size_t const jobs = testing_config::jobs();
+				for (size_t i = 0; i < tests_.size(); ++i) {
+					if (tests_[i]._serial)
+						continue;
+					while (running >= jobs)
+						wait_one();
+					start(i);
+				}
+				while (running)
+					wait_one();
+				for (size_t i = 0; i < tests_.size(); ++i) {
+					if (!tests_[i]._serial)
+						continue;
+					start(i);
+					while (running)
+						wait_one();
+				}
+
+				auto handler = messages::current_handler();
+				bool collecting = std::dynamic_pointer_cast<error_collector>(handler) != nullptr;
+				size_t failed = 0;
+				for (size_t i = 0; i < tests_.size(); ++i) {
+					auto& c = children[i];
+					std::string output = read_all(c._output);
+					if (collecting || !handler) {
+						std::cout << output;
+						std::cout.flush();
+					}
+					else if (!output.empty()) {
+						if (output.back() == '\n')
+							output.pop_back();
+						handler->message(output);
+					}
+					std::string errors = read_all(c._errors);
+					fclose(c._output);
+					fclose(c._errors);
+					if (c._status == 0)
+						continue;
+					++failed;
+					if (collecting) {
+						for (size_t b = 0, e = errors.find('\0'); e != std::string::npos; b = e + 1, e = errors.find('\0', b))
+							handler->message(errors.substr(b, e - b));
+						if (errors.empty())
+							handler->message(string_util::af_format_string(
+								"ERROR: Test set % failed with exit code %.", tests_[i]._runner->name(), c._status));
+					}
+					else
+						messages::error_text("Test set % failed.", tests_[i]._runner->name());
+				}
+				if (failed && !collecting)
+					throw std::runtime_error(string_util::af_format_string("% test sets failed.", failed));
+#endif
+			}
+			void run_parallel_impl(std::vector<std::string> const& names, run_f run_) {
+				std::vector<test_record> tests;
+				for (auto const& name : names) {
+					auto const found = find_tests(name);
+					tests.insert(tests.end(), found.begin(), found.end());
+				}
+				run_parallel_impl(tests, run_);
+			}
+			void run_all_parallel_impl(run_f run_) {
+				std::vector<test_record> tests;
+				for (auto const& k : _tests)
+					tests.push_back(k.second);
+				run_parallel_impl(tests, run_);
+			}
 			void run_examples_impl(std::string const& name) {
 				auto const tests = find_tests(name);
 				for(auto const& t : tests)
@@ -638,6 +989,11 @@ namespace autotelica {
 				for (auto const& t : tests)
 					t._runner->run_recording();
 			}
+			void run_benchmarks_impl(std::string const& name) {
+				auto const tests = find_tests(name);
+				for (auto const& t : tests)
+					t._runner->run_benchmarks();
+			}
 
 			void run_all_examples_impl() {
 				for (auto const& k : _tests)
@@ -651,14 +1007,19 @@ namespace autotelica {
 				for (auto const& k : _tests)
 					k.second._runner->run_recording();
 			}
+			void run_all_benchmarks_impl() {
+				for (auto const& k : _tests)
+					k.second._runner->run_benchmarks();
+			}
 
 			// register a new test set
 			static void add(
 				const char* const name,
 				std::shared_ptr< test_runner_base > runner,
 				std::string const& file_,
-				std::string const& class_) {
-				get().add_impl(name, runner, file_, class_);
+				std::string const& class_,
+				bool serial_) {
+				get().add_impl(name, runner, file_, class_, serial_);
 			}
 		public:
 			// list all available test sets
@@ -674,6 +1035,10 @@ namespace autotelica {
 			static std::string get_class(std::string const& name) {
 				return get().get_class_impl(name);
 			}
+			// is the test set tagged as serial (see AF_DECLARE_SERIAL_TEST_SET)
+			static bool is_serial(std::string const& name) {
+				return get().is_serial_impl(name);
+			}
 
 			// run named test set as examples
 			static void examples(std::string const& name) {
@@ -692,12 +1057,20 @@ namespace autotelica {
 			// run named test sets as examples
 			static void run_examples(std::vector<std::string> const& names) {
 				testing_impl::csv_column_titles();
+				if (testing_config::jobs() > 1) {
+					get().run_parallel_impl(names, &test_runner_base::run_examples);
+					return;
+				}
 				for(auto const & name : names)
 					get().run_examples_impl(name);
 			}
 			// run named test sets as tests
 			static void run_tests(std::vector<std::string> const& names) {
 				testing_impl::csv_column_titles();
+				if (testing_config::jobs() > 1) {
+					get().run_parallel_impl(names, &test_runner_base::run_tests);
+					return;
+				}
 				for (auto const& name : names)
 					get().run_tests_impl(name);
 			}
@@ -706,21 +1079,36 @@ namespace autotelica {
 				for (auto const& name : names)
 					get().run_recording_impl(name);
 			}
+			// run benchmarks of the named test sets
+			static void run_benchmarks(std::vector<std::string> const& names) {
+				for (auto const& name : names)
+					get().run_benchmarks_impl(name);
+			}
 
 			// run all test sets as examples
 			static void run_all_examples() {
 				testing_impl::csv_column_titles();
-				get().run_all_examples_impl();
+				if (testing_config::jobs() > 1)
+					get().run_all_parallel_impl(&test_runner_base::run_examples);
+				else
+					get().run_all_examples_impl();
 			}
 			// run all test sets as tests
 			static void run_all_tests() {
 				testing_impl::csv_column_titles();
-				get().run_all_tests_impl();
+				if (testing_config::jobs() > 1)
+					get().run_all_parallel_impl(&test_runner_base::run_tests);
+				else
+					get().run_all_tests_impl();
 			}
 			// record all test sets
 			static void record_all() {
 				get().run_all_recording_impl();
 			}
+			// run benchmarks of all test sets
+			static void run_all_benchmarks() {
+				get().run_all_benchmarks_impl();
+			}
 			
 			// register a new test set
 			template< typename TestT >
@@ -735,7 +1123,7 @@ namespace autotelica {
 					"Test class must implement 'static const char* const test_set_file()' function");
 				static_assert(std::is_constructible< std::function<void()>, test_examples_f>::value, 
 					"Test class must implement 'static void examples()' function");
-				add(TestT::test_set_name(), std::shared_ptr< test_runner_base>(new TestT()), TestT::test_set_file(), class_name);
+				add(TestT::test_set_name(), std::shared_ptr< test_runner_base>(new TestT()), TestT::test_set_file(), class_name, TestT::test_set_serial());
 				return true;
 			}
 		};
@@ -800,6 +1188,8 @@ namespace autotelica {
 		// curiously recursive templates, yay :) 
 		template< typename CuriousBaseT >
 		struct test_runner : public test_runner_base {
+			// test sets that share state with other test sets hide this with one that returns true
+			static constexpr bool test_set_serial() { return false; }
 			
 			// run as examples
 			static void af_examples() {
@@ -837,11 +1227,19 @@ namespace autotelica {
 				testing_config::set_run_mode_examples();
 			}
 
+			// measure benchmarks against their baselines
+			static void af_benchmarks() {
+				testing_config::set_run_mode_benchmarking();
+				af_examples();
+				testing_config::set_run_mode_examples();
+			}
+
 			// v table part, to make the registry work
 			const char* const name() const override { return CuriousBaseT::test_set_name(); }
 			void run_examples() const override { af_examples(); }
 			void run_tests()  const override { af_tests(); }
 			void run_recording() const override { af_record(); }
+			void run_benchmarks() const override { af_benchmarks(); }
 		};
 
 
@@ -867,10 +1265,22 @@ namespace autotelica {
 #define af_end_test_set_class_declaration(  ) AF_END_TEST_SET_CLASS_DECLARATION(  )
 
 #define AF_DECLARE_TEST_SET( description, test_namespace, examples_function, test_function )\
+	AF_DECLARE_TEST_SET_IMPL( description, test_namespace, examples_function, test_function, false )
+
+#define af_declare_test_set( description, test_namespace, examples_function, test_function) AF_DECLARE_TEST_SET( description, test_namespace, examples_function, test_function )\
+
+// serial test sets never run at the same time as other test sets in parallel runs
+#define AF_DECLARE_SERIAL_TEST_SET( description, test_namespace, examples_function, test_function )\
+	AF_DECLARE_TEST_SET_IMPL( description, test_namespace, examples_function, test_function, true )
+
+#define af_declare_serial_test_set( description, test_namespace, examples_function, test_function) AF_DECLARE_SERIAL_TEST_SET( description, test_namespace, examples_function, test_function )
+
+#define AF_DECLARE_TEST_SET_IMPL( description, test_namespace, examples_function, test_function, serial )\
 namespace autotelica {\
     namespace examples {\
         namespace test_namespace##__af_tests_impl {\
             AF_DECLARE_TEST_SET_CLASS(run, description);\
+            static constexpr bool test_set_serial() { return serial; }\
             static void af_examples() {\
                 if(autotelica::testing::testing_config::run_examples()) {\
 					examples_function;\
@@ -886,8 +1296,6 @@ namespace {\
 		autotelica::testing::all_tests::register_tests<autotelica::examples::test_namespace##__af_tests_impl::run>( #test_namespace );\
 }
 
-#define af_declare_test_set( description, test_namespace, examples_function, test_function) AF_DECLARE_TEST_SET( description, test_namespace, examples_function, test_function )\
-
 // list all registered test sets 
 #define AF_LIST_TEST_SETS( ) autotelica::testing::all_tests::list_tests();
 
@@ -908,6 +1316,11 @@ namespace {\
 
 #define af_record_tests(...) AF_RECORD_TESTS(__VA_ARGS__)
 
+// run benchmarks of named test sets
+#define AF_RUN_BENCHMARKS(...) autotelica::testing::all_tests::run_benchmarks( { __VA_ARGS__ } )
+
+#define af_run_benchmarks(...) AF_RUN_BENCHMARKS(__VA_ARGS__)
+
 // run all registered test sets as examples
 #define AF_RUN_ALL_EXAMPLES( ) autotelica::testing::all_tests::run_all_examples(  )
 
@@ -923,6 +1336,11 @@ namespace {\
 
 #define af_record_all_tests( ) AF_RECORD_ALL_TESTS( )
 
+// run benchmarks of all registered test sets
+#define AF_RUN_ALL_BENCHMARKS( ) autotelica::testing::all_tests::run_all_benchmarks(  )
+
+#define af_run_all_benchmarks( ) AF_RUN_ALL_BENCHMARKS( )
+
 // to trace all output in csv format suround the block where tests sets are executed 
 // with AF_START_CSV_TRACING and AF_END_CSV_TRACING; or package it all up within AF_CSV_TRACING parameter
 // Also ... excel gets weird about interpreting csv field value types, so a bit of special handling is needed;
@@ -1027,6 +1445,13 @@ namespace {\
 
 #define af_test_result( expected_result, expression ) AF_TEST_RESULT( expected_result, expression ) 
 
+// benchmark a snippet, baseline is in ns/op (0 when there is none yet, recording fills it in)
+#define AF_BENCHMARK( baseline_ns_per_op, ... ) \
+		autotelica::testing::testing_impl::test_benchmark(\
+			baseline_ns_per_op, "AF_BENCHMARK", [&](){ __VA_ARGS__ ;},#__VA_ARGS__,__FILE__, __LINE__);
+
+#define af_benchmark( baseline_ns_per_op, ... ) AF_BENCHMARK( baseline_ns_per_op, __VA_ARGS__ )
+
 // add a comment to the test output
 #define AF_TEST_COMMENT( comment ) \
 	autotelica::testing::testing_impl::comment_test(#comment);
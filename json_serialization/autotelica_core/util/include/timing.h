@@ -2,9 +2,31 @@
 #include <chrono>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cmath>
+#include <cstdint>
 #include "asserts.h"
+#include "macro_magic.h"
 #include "std_pretty_printing.h"
 
+#ifndef		_AF_TIMING_USE_TSC
+#define		_AF_TIMING_USE_TSC false
+#endif
+
+#if _AF_TIMING_USE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
 namespace autotelica {
 	namespace timing {
 		template<typename char_t>
@@ -204,5 +226,607 @@ namespace autotelica {
 			out << table_w(ts.to_table(), true);
 			return out;
 		}
+
+		// scoped profiling
+		// AF_PROFILE_SCOPE("name") times the rest of the enclosing scope
+		// scopes nest, so the profile is a tree of call paths, per thread
+		// each node keeps call count, total time and a latency histogram, in raw ticks of profiler_clock
+		// threads only ever touch their own profile, profiler_t merges them on demand and converts ticks to time when reporting
+		// define _AF_TIMING_USE_TSC as true to read the time stamp counter instead of steady_clock (x86 only)
+		// tracer_t can also record the scopes as a timeline, see trace events below
+
+		// nanosecond ticks from steady_clock
+		struct steady_ticks_clock {
+			static inline uint64_t now() {
+				using namespace std::chrono;
+				return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+			}
+			static inline double nanoseconds_per_tick() { return 1.0; }
+		};
+
+#if _AF_TIMING_USE_TSC
+		// time stamp counter ticks, calibrated against steady_clock the first time they are converted
+		// scopes record raw ticks, so that happens when a profile is reported, never inside a timed scope
+		struct tsc_clock {
+			static inline uint64_t now() { return __rdtsc(); }
+			static inline double nanoseconds_per_tick() {
+				static const double _nanoseconds_per_tick = []() {
+					uint64_t start_ns = steady_ticks_clock::now();
+					uint64_t start = now();
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					uint64_t end_ns = steady_ticks_clock::now();
+					uint64_t end = now();
+					return static_cast<double>(end_ns - start_ns) / static_cast<double>(end - start);
+				}();
+				return _nanoseconds_per_tick;
+			}
+		};
+		using profiler_clock = tsc_clock;
+#else
+		using profiler_clock = steady_ticks_clock;
+#endif
+
+		class scope_counters_t;
+
+		// HDR style histogram: values below 2^sub_bucket_bits are exact,
+		// above that every power of two is split into 2^sub_bucket_bits buckets (about 3% relative error)
+		class latency_histogram_t {
+			friend class scope_counters_t;
+			static const size_t sub_bucket_bits = 5;
+			static const size_t sub_buckets = size_t(1) << sub_bucket_bits;
+
+			std::vector<uint64_t> _counts;	// grows up to the highest bucket used
+			uint64_t _count;
+			uint64_t _min;
+			uint64_t _max;
+
+			static inline size_t highest_bit(uint64_t v_) {
+				size_t out = 0;
+				for (size_t shift = 32; shift; shift >>= 1)
+					if (v_ >> shift) {
+						v_ >>= shift;
+						out += shift;
+					}
+				return out;
+			}
+		public:
+			latency_histogram_t() : _count(0), _min(0), _max(0) {}
+
+			static inline size_t bucket(uint64_t v_) {
+				if (v_ < sub_buckets)
+					return static_cast<size_t>(v_);
+				size_t shift = highest_bit(v_) - sub_bucket_bits;
+				return (shift + 1) * sub_buckets + static_cast<size_t>((v_ >> shift) - sub_buckets);
+			}
+			// highest value that lands in bucket_
+			static inline uint64_t bucket_value(size_t bucket_) {
+				if (bucket_ < sub_buckets)
+					return bucket_;
+				size_t shift = bucket_ / sub_buckets - 1;
+				uint64_t sub_bucket = bucket_ % sub_buckets + sub_buckets;
+				return ((sub_bucket + 1) << shift) - 1;
+			}
+
+			void record(uint64_t v_) {
+				size_t b = bucket(v_);
+				if (b >= _counts.size())
+					_counts.resize(b + 1, 0);
+				++_counts[b];
+				_min = (_count == 0 || v_ < _min) ? v_ : _min;
+				_max = v_ > _max ? v_ : _max;
+				++_count;
+			}
+
+			void merge(latency_histogram_t const& other_) {
+				if (other_._count == 0)
+					return;
+				if (other_._counts.size() > _counts.size())
+					_counts.resize(other_._counts.size(), 0);
+				for (size_t i = 0; i < other_._counts.size(); ++i)
+					_counts[i] += other_._counts[i];
+				_min = (_count == 0 || other_._min < _min) ? other_._min : _min;
+				_max = other_._max > _max ? other_._max : _max;
+				_count += other_._count;
+			}
+
+			void reset() {
+				_counts.clear();
+				_count = _min = _max = 0;
+			}
+
+			uint64_t count() const { return _count; }
+			uint64_t min() const { return _min; }
+			uint64_t max() const { return _max; }
+
+			// smallest recorded value (to histogram precision) that percentile_ % of values are less than or equal to
+			uint64_t percentile(double percentile_) const {
+				if (_count == 0)
+					return 0;
+				uint64_t target = static_cast<uint64_t>(std::ceil(percentile_ / 100.0 * static_cast<double>(_count)));
+				target = target ? target : 1;
+				uint64_t seen = 0;
+				for (size_t i = 0; i < _counts.size(); ++i) {
+					seen += _counts[i];
+					if (seen >= target) {
+						uint64_t v = bucket_value(i);
+						return v < _max ? v : _max;
+					}
+				}
+				return _max;
+			}
+		};
+
+		// statistics of a scope as one thread records them
+		// only the owning thread adds to them, with relaxed atomics, so they can be merged while it keeps going
+		// histogram buckets come in blocks of one power of two, allocated (by the owner) on first use
+		class scope_counters_t {
+			using counter_t = std::atomic<uint64_t>;
+			static const size_t block_size = latency_histogram_t::sub_buckets;
+			static const size_t blocks = 64 - latency_histogram_t::sub_bucket_bits + 1;	// enough for any 64 bit value
+			struct block_t {
+				counter_t _counts[block_size];
+				block_t() {
+					for (auto& c : _counts)
+						c.store(0, std::memory_order_relaxed);
+				}
+			};
+
+			counter_t _calls;
+			counter_t _total;
+			counter_t _min;
+			counter_t _max;
+			std::atomic<block_t*> _blocks[blocks];
+
+			static inline void add(counter_t& counter_, uint64_t value_) {
+				counter_.fetch_add(value_, std::memory_order_relaxed);
+			}
+		public:
+			scope_counters_t() : _calls(0), _total(0), _min(0), _max(0) {
+				for (auto& b : _blocks)
+					b.store(nullptr, std::memory_order_relaxed);
+			}
+			~scope_counters_t() {
+				for (auto& b : _blocks)
+					delete b.load(std::memory_order_relaxed);
+			}
+			// a snapshot, so that nodes can be moved around
+			scope_counters_t(scope_counters_t const& other_) : scope_counters_t() {
+				for (size_t b = 0; b < blocks; ++b) {
+					block_t const* block = other_._blocks[b].load(std::memory_order_acquire);
+					if (!block)
+						continue;
+					block_t* copy = new block_t();
+					for (size_t i = 0; i < block_size; ++i)
+						copy->_counts[i].store(block->_counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+					_blocks[b].store(copy, std::memory_order_relaxed);
+				}
+				_calls.store(other_._calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				_total.store(other_._total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				_min.store(other_._min.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				_max.store(other_._max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			scope_counters_t& operator=(scope_counters_t const&) = delete;
+
+			// owning thread only
+			inline void record(uint64_t ticks_) {
+				size_t bucket = latency_histogram_t::bucket(ticks_);
+				auto& slot = _blocks[bucket / block_size];
+				block_t* block = slot.load(std::memory_order_relaxed);
+				if (!block) {
+					block = new block_t();
+					slot.store(block, std::memory_order_release);
+				}
+				add(block->_counts[bucket % block_size], 1);
+				if (_calls.load(std::memory_order_relaxed) == 0 || ticks_ < _min.load(std::memory_order_relaxed))
+					_min.store(ticks_, std::memory_order_relaxed);
+				if (ticks_ > _max.load(std::memory_order_relaxed))
+					_max.store(ticks_, std::memory_order_relaxed);
+				add(_total, ticks_);
+				add(_calls, 1);
+			}
+
+			// any thread, values recorded meanwhile may or may not be included
+			void merge_into(uint64_t& calls_, uint64_t& total_, latency_histogram_t& histogram_) const {
+				calls_ += _calls.load(std::memory_order_relaxed);
+				total_ += _total.load(std::memory_order_relaxed);
+				uint64_t count = 0;
+				for (size_t b = 0; b < blocks; ++b) {
+					block_t const* block = _blocks[b].load(std::memory_order_acquire);
+					if (!block)
+						continue;
+					for (size_t i = 0; i < block_size; ++i) {
+						uint64_t c = block->_counts[i].load(std::memory_order_relaxed);
+						if (!c)
+							continue;
+						size_t bucket = b * block_size + i;
+						if (bucket >= histogram_._counts.size())
+							histogram_._counts.resize(bucket + 1, 0);
+						histogram_._counts[bucket] += c;
+						count += c;
+					}
+				}
+				if (!count)
+					return;
+				uint64_t min = _min.load(std::memory_order_relaxed);
+				uint64_t max = _max.load(std::memory_order_relaxed);
+				histogram_._min = (histogram_._count == 0 || min < histogram_._min) ? min : histogram_._min;
+				histogram_._max = max > histogram_._max ? max : histogram_._max;
+				histogram_._count += count;
+			}
+
+			// blocks stay allocated, the owner may be using them
+			void reset() {
+				for (auto& b : _blocks) {
+					block_t* block = b.load(std::memory_order_acquire);
+					if (block)
+						for (auto& c : block->_counts)
+							c.store(0, std::memory_order_relaxed);
+				}
+				for (auto* c : { &_calls, &_total, &_min, &_max })
+					c->store(0, std::memory_order_relaxed);
+			}
+		};
+
+		// a node in the call tree of profiled scopes
+		// nodes of thread profiles record into _counters, merged trees have the totals in _calls, _total and _histogram
+		struct profile_node_t {
+			std::string _name;
+			char const* _key;			// the name as it was passed in, compared by address first
+			profile_node_t* _parent;
+			std::vector<std::unique_ptr<profile_node_t>> _children;
+			uint64_t _calls;
+			uint64_t _total;			// ticks, see profiler_t::nanoseconds
+			latency_histogram_t _histogram;	// ticks
+			scope_counters_t _counters;
+
+			profile_node_t(char const* name_ = "", profile_node_t* parent_ = nullptr) :
+				_name(name_), _key(name_), _parent(parent_), _calls(0), _total(0) {}
+
+			profile_node_t* find(char const* name_) const {
+				for (auto const& c : _children)
+					if (c->_key == name_)
+						return c.get();
+				for (auto const& c : _children)
+					if (c->_name == name_)
+						return c.get();
+				return nullptr;
+			}
+
+			inline void record(uint64_t ticks_) {
+				_counters.record(ticks_);
+			}
+
+			void merge(profile_node_t const& other_) {
+				_calls += other_._calls;
+				_total += other_._total;
+				_histogram.merge(other_._histogram);
+				other_._counters.merge_into(_calls, _total, _histogram);
+				for (auto const& oc : other_._children) {
+					profile_node_t* c = find(oc->_name.c_str());
+					if (!c) {
+						_children.emplace_back(new profile_node_t(oc->_name.c_str(), this));
+						c = _children.back().get();
+						c->_key = nullptr;
+					}
+					c->merge(*oc);
+				}
+			}
+
+			void reset() {
+				_calls = _total = 0;
+				_histogram.reset();
+				_counters.reset();
+				for (auto& c : _children)
+					c->reset();
+			}
+		};
+
+		// profile of one thread
+		// the owning thread walks the tree and records statistics without locking,
+		// only adding nodes is done under the lock so that merging can walk the tree
+		class thread_profile_t {
+			mutable std::mutex _mutex;
+			profile_node_t _root;
+			profile_node_t* _current;
+		public:
+			thread_profile_t() : _current(&_root) {}
+
+			inline profile_node_t* enter(char const* name_) {
+				profile_node_t* node = _current->find(name_);
+				if (!node) {
+					std::lock_guard<std::mutex> lock(_mutex);
+					_current->_children.emplace_back(new profile_node_t(name_, _current));
+					node = _current->_children.back().get();
+				}
+				return (_current = node);
+			}
+			inline void leave(profile_node_t* node_, uint64_t ticks_) {
+				node_->record(ticks_);
+				_current = node_->_parent;
+			}
+
+			void merge_into(profile_node_t& out_) const {
+				std::lock_guard<std::mutex> lock(_mutex);
+				out_.merge(_root);
+			}
+			void reset() {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_root.reset();
+			}
+		};
+
+		// all the thread profiles, profiles of finished threads are kept so that they get reported too
+		class profiler_t {
+			mutable std::mutex _mutex;
+			std::vector<std::shared_ptr<thread_profile_t>> _threads;
+
+			profiler_t() {}
+
+			static std::string format(uint64_t ticks_) {
+				std::stringstream out;
+				out << duration_formatter(std::chrono::nanoseconds(nanoseconds(ticks_)));
+				return out.str();
+			}
+			static void add_rows(std::vector<std::vector<std::string>>& out_, profile_node_t const& node_, size_t depth_) {
+				using namespace autotelica::string_util;
+				for (auto const& c : node_._children) {
+					auto const& h = c->_histogram;
+					out_.push_back({
+						std::string(depth_ * 2, ' ') + c->_name,
+						to_string_t<std::string>::convert(c->_calls),
+						format(c->_total),
+						format(c->_calls ? c->_total / c->_calls : 0),
+						format(h.percentile(50)),
+						format(h.percentile(99)),
+						format(h.percentile(99.9)),
+						format(h.max()) });
+					add_rows(out_, *c, depth_ + 1);
+				}
+			}
+		public:
+			profiler_t(profiler_t const&) = delete;
+			profiler_t& operator=(profiler_t const&) = delete;
+
+			static profiler_t& instance() {
+				static profiler_t _instance;
+				return _instance;
+			}
+
+			// profiles are kept in profiler_clock ticks, this converts them
+			static inline uint64_t nanoseconds(uint64_t ticks_) {
+				return static_cast<uint64_t>(static_cast<double>(ticks_) * profiler_clock::nanoseconds_per_tick());
+			}
+
+			thread_profile_t& this_thread() {
+				static thread_local std::shared_ptr<thread_profile_t> _profile = [this]() {
+					auto profile = std::make_shared<thread_profile_t>();
+					std::lock_guard<std::mutex> lock(_mutex);
+					_threads.push_back(profile);
+					return profile;
+				}();
+				return *_profile;
+			}
+
+			// call tree of all threads merged, the root itself is never timed
+			profile_node_t merged() const {
+				profile_node_t out;
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto const& t : _threads)
+					t->merge_into(out);
+				return out;
+			}
+
+			// statistics are cleared, the call trees stay (scopes may be active while this runs)
+			void reset() {
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto const& t : _threads)
+					t->reset();
+			}
+
+			std::vector<std::vector<std::string>> to_table() const {
+				std::vector<std::vector<std::string>> out{ { "scope", "calls", "total", "mean", "p50", "p99", "p999", "max" } };
+				add_rows(out, merged(), 0);
+				return out;
+			}
+			std::string pretty() const {
+				using namespace autotelica::std_pretty_printing;
+				return table_s(to_table(), true);
+			}
+		};
+
+		// trace events
+		// while tracing is on, every profiled scope also records begin and end events into a per-thread ring buffer
+		// buffers are single producer (the owning thread) single consumer (tracer_t, under its lock), no locking on the producer side
+		// write() drains the buffers into a Chrome trace event JSON file (chrome://tracing or ui.perfetto.dev)
+		struct trace_event_t {
+			char const* _name;
+			uint64_t _ticks;
+			char _phase;		// 'B' or 'E'
+		};
+
+		class trace_buffer_t {
+		public:
+			static const size_t capacity = size_t(1) << 16;	// power of two
+		private:
+			std::vector<trace_event_t> _events;
+			std::atomic<size_t> _head;		// written by the producer
+			std::atomic<size_t> _tail;		// written by the consumer
+			std::atomic<size_t> _dropped;	// events that didn't fit
+			size_t const _thread_id;
+		public:
+			explicit trace_buffer_t(size_t thread_id_) :
+				_events(capacity), _head(0), _tail(0), _dropped(0), _thread_id(thread_id_) {}
+
+			size_t thread_id() const { return _thread_id; }
+			size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+			// false if the buffer is full and the event was dropped
+			inline bool push(char const* name_, char phase_, uint64_t ticks_) {
+				size_t head = _head.load(std::memory_order_relaxed);
+				if (head - _tail.load(std::memory_order_acquire) == capacity) {
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				_events[head & (capacity - 1)] = trace_event_t{ name_, ticks_, phase_ };
+				_head.store(head + 1, std::memory_order_release);
+				return true;
+			}
+
+			// only one consumer at a time
+			template<typename f_t>
+			void drain(f_t f_) {
+				size_t tail = _tail.load(std::memory_order_relaxed);
+				size_t head = _head.load(std::memory_order_acquire);
+				for (; tail != head; ++tail)
+					f_(_events[tail & (capacity - 1)]);
+				_tail.store(tail, std::memory_order_release);
+			}
+		};
+
+		class tracer_t {
+			mutable std::mutex _mutex;
+			std::vector<std::shared_ptr<trace_buffer_t>> _threads;
+			std::vector<std::pair<size_t, trace_event_t>> _events;	// drained so far, with thread ids
+			std::atomic<bool> _enabled;
+			uint64_t _start;
+
+			tracer_t() : _enabled(false), _start(0) {}
+
+			void drain_impl() {
+				for (auto const& t : _threads) {
+					size_t thread_id = t->thread_id();
+					t->drain([&](trace_event_t const& e_) { _events.push_back({ thread_id, e_ }); });
+				}
+			}
+			static void escaped(std::ostream& out_, char const* s_) {
+				for (; *s_; ++s_) {
+					if (*s_ == '"' || *s_ == '\\')
+						out_ << '\\' << *s_;
+					else if (static_cast<unsigned char>(*s_) < 0x20)
+						out_ << ' ';
+					else
+						out_ << *s_;
+				}
+			}
+		public:
+			tracer_t(tracer_t const&) = delete;
+			tracer_t& operator=(tracer_t const&) = delete;
+
+			static tracer_t& instance() {
+				static tracer_t _instance;
+				return _instance;
+			}
+
+			inline bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+			trace_buffer_t& this_thread() {
+				static thread_local std::shared_ptr<trace_buffer_t> _buffer = [this]() {
+					std::lock_guard<std::mutex> lock(_mutex);
+					_threads.push_back(std::make_shared<trace_buffer_t>(_threads.size() + 1));
+					return _threads.back();
+				}();
+				return *_buffer;
+			}
+
+			// starts a new trace, events recorded before are discarded
+			void start() {
+				std::lock_guard<std::mutex> lock(_mutex);
+				drain_impl();
+				_events.clear();
+				_start = profiler_clock::now();
+				_enabled.store(true, std::memory_order_relaxed);
+			}
+			void stop() {
+				_enabled.store(false, std::memory_order_relaxed);
+			}
+
+			// moves events from the thread buffers to the trace, call this now and then on long traces so that buffers don't fill up
+			void drain() {
+				std::lock_guard<std::mutex> lock(_mutex);
+				drain_impl();
+			}
+
+			size_t dropped() const {
+				std::lock_guard<std::mutex> lock(_mutex);
+				size_t out = 0;
+				for (auto const& t : _threads)
+					out += t->dropped();
+				return out;
+			}
+
+			// trace event format, timestamps in microseconds from start()
+			void to_stream(std::ostream& out_) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				drain_impl();
+				double microseconds_per_tick = profiler_clock::nanoseconds_per_tick() / 1000.0;
+				out_ << "{\"traceEvents\":[";
+				bool first = true;
+				for (auto const& t : _threads) {
+					out_ << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t->thread_id()
+						<< ",\"args\":{\"name\":\"thread " << t->thread_id() << "\"}}";
+					first = false;
+				}
+				auto flags = out_.flags();
+				auto precision = out_.precision();
+				out_ << std::fixed << std::setprecision(3);
+				for (auto const& e : _events) {
+					if (e.second._ticks < _start)
+						continue;
+					out_ << (first ? "" : ",") << "\n{\"name\":\"";
+					escaped(out_, e.second._name);
+					out_ << "\",\"ph\":\"" << e.second._phase << "\",\"ts\":" << (e.second._ticks - _start) * microseconds_per_tick
+						<< ",\"pid\":1,\"tid\":" << e.first << "}";
+					first = false;
+				}
+				out_ << "\n],\"displayTimeUnit\":\"ns\"}\n";
+				out_.flags(flags);
+				out_.precision(precision);
+			}
+			void write(std::string const& path_) {
+				std::ofstream out(path_);
+				AF_ASSERT(out, "Failed to open %.", path_);
+				to_stream(out);
+			}
+		};
+
+		class scoped_timer {
+			thread_profile_t& _profile;
+			profile_node_t* const _node;
+			trace_buffer_t* _trace;		// only set while tracing, and only if the begin event was recorded
+			uint64_t const _start;
+		public:
+			explicit scoped_timer(char const* name_) :
+				_profile(profiler_t::instance().this_thread()),
+				_node(_profile.enter(name_)),
+				_trace(nullptr),
+				_start(profiler_clock::now()) {
+				auto& tracer = tracer_t::instance();
+				if (tracer.enabled()) {
+					_trace = &tracer.this_thread();
+					if (!_trace->push(_node->_name.c_str(), 'B', _start))
+						_trace = nullptr;
+				}
+			}
+			~scoped_timer() {
+				uint64_t end = profiler_clock::now();
+				if (_trace)
+					_trace->push(_node->_name.c_str(), 'E', end);
+				_profile.leave(_node, end - _start);
+			}
+			scoped_timer(scoped_timer const&) = delete;
+			scoped_timer& operator=(scoped_timer const&) = delete;
+		};
+
+		inline std::ostream& operator<<(std::ostream& out, tracer_t& t) {
+			t.to_stream(out);
+			return out;
+		}
+
+		inline std::ostream& operator<<(std::ostream& out, profiler_t const& p) {
+			out << p.pretty();
+			return out;
+		}
 	}
 }
+
+#define AF_PROFILE_SCOPE(name) autotelica::timing::scoped_timer NAME_WITH_LINE(__af_profile_scope_)(name)
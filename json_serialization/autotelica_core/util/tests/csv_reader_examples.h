@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdio>
+#include <fstream>
+#include "testing_util.h"
+#include "csv_reader.h"
+namespace autotelica {
+    namespace examples {
+        namespace csv_reader {
+            template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+            void examples() {
+                // code here will only be run in example runs
+            }
+            template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+            void tests() {
+                using namespace autotelica::csv_reader;
+                using namespace autotelica::string_util;
+
+                AF_TEST_COMMENT("Parsing records.");
+                std::string const text =
+                    "name, count ,price,flag\n"
+                    "plain,1,1.5,true\r\n"
+                    "\n"
+                    "\"with, comma\",-2,2.25,false\n"
+                    "\"with \"\"quotes\"\"\",3,1e3,TRUE\n"
+                    "\"two\nlines\",4,-0.5,0\n"
+                    "  padded  ,5,6,1";
+                auto reader = make_csv_text_reader(text);
+                AF_TEST_RESULT(size_t(4), reader.header().size());
+                AF_TEST_RESULT(std::string("count"), reader.header()[1]);
+                AF_TEST_RESULT(size_t(2), reader.column_index("PRICE"));
+
+                std::vector<std::string> names;
+                reader.for_each_record([&](csv_record_t const& r_) { names.push_back(r_[0].str()); });
+                AF_TEST_RESULT(size_t(5), names.size());
+                AF_TEST_RESULT(std::string("plain"), names[0]);
+                AF_TEST_RESULT(std::string("with, comma"), names[1]);
+                AF_TEST_RESULT(std::string("with \"quotes\""), names[2]);
+                AF_TEST_RESULT(std::string("two\nlines"), names[3]);
+                AF_TEST_RESULT(std::string("padded"), names[4]);
+
+                AF_TEST_COMMENT("Typed columns.");
+                AF_TEST_RESULT(true, reader.column<int>("count") == std::vector<int>({ 1, -2, 3, 4, 5 }));
+                AF_TEST_RESULT(true, reader.column<double>(2) == std::vector<double>({ 1.5, 2.25, 1000.0, -0.5, 6.0 }));
+                AF_TEST_RESULT(true, reader.column<bool>("flag") == std::vector<bool>({ true, false, true, false, true }));
+                AF_TEST_RESULT(true, reader.column<std::string>(0, 3) == names);
+
+                AF_TEST_COMMENT("Fields convert like convert_string.");
+                int i = 0;
+                AF_TEST_RESULT(false, csv_field_t("2147483648", 10, false, false).to(i));
+                AF_TEST_RESULT(true, csv_field_t("-2147483648", 11, false, false).to(i));
+                AF_TEST_RESULT(std::numeric_limits<int>::min(), i);
+                AF_TEST_RESULT(false, csv_field_t("", 0, false, false).to(i));
+                AF_TEST_RESULT(false, csv_field_t("12x", 3, false, false).to(i));
+                AF_TEST_RESULT(false, csv_field_t("1.5", 3, false, false).to(i));
+                unsigned u = 0;
+                AF_TEST_RESULT(false, csv_field_t("-2", 2, false, false).to(u));
+                bool b = false;
+                AF_TEST_RESULT(false, csv_field_t("yes", 3, false, false).to(b));
+                AF_TEST_RESULT(42, csv_field_t("42", 2, false, false).as<int>());
+
+                AF_TEST_COMMENT("Reading what to_csv_row writes.");
+                std::string const excel = to_excel_csv_row_string("a:b", "say \"hi\"", "x,y", 7) + "\n"
+                    + to_plain_csv_row_string("a:b", "x,y", 7.5);
+                auto written = make_csv_text_reader(excel, false);
+                std::vector<std::string> values;
+                written.for_each_record([&](csv_record_t const& r_) {
+                    for (auto const& f : r_) values.push_back(f.str(values.size() < 4));
+                    });
+                AF_TEST_RESULT(true, values == std::vector<std::string>({ "a:b", "say \"hi\"", "x,y", "7", "a:b", "x,y", "7.5" }));
+
+                AF_TEST_COMMENT("Chunks start and end on record boundaries.");
+                std::string big = "id,text\n";
+                for (int r = 0; r < 1000; ++r)
+                    big += af_format_string("%,%\n", r, r % 3 ? "\"quoted\nover, lines\"" : "plain");
+                auto big_reader = make_csv_text_reader(big);
+                auto const chunks = big_reader.chunks(7);
+                AF_TEST_RESULT(size_t(7), chunks.size());
+                bool aligned = true;
+                for (size_t c = 0; c < chunks.size(); ++c)
+                    aligned = aligned && (c == 0 || chunks[c]._begin == chunks[c - 1]._end) && chunks[c]._end[-1] == '\n';
+                AF_TEST_RESULT(true, aligned);
+                std::vector<int> ids(1000);
+                for (int r = 0; r < 1000; ++r) ids[r] = r;
+                AF_TEST_RESULT(true, big_reader.column<int>("id", 7) == ids);
+                std::vector<size_t> counts(7);
+                big_reader.for_each_record([&](size_t c_, csv_record_t const& r_) { counts[c_] += r_.size() == 2; }, 7);
+                size_t total = 0;
+                for (auto c : counts) total += c;
+                AF_TEST_RESULT(size_t(1000), total);
+                AF_TEST_RESULT(size_t(1), make_csv_text_reader("a\n1").chunks(16).size());
+
+                AF_TEST_COMMENT("Memory mapped files.");
+                std::string const path = "csv_reader_examples.csv";
+                {
+                    std::ofstream out(path, std::ios::binary);
+                    out << big;
+                }
+                {
+                    auto file_reader = make_csv_file_reader(path);
+                    AF_TEST_RESULT(true, file_reader.column<long long>("id", 4) == std::vector<long long>(ids.begin(), ids.end()));
+                }
+                std::remove(path.c_str());
+            }
+        }
+    }
+}
+
+AF_DECLARE_TEST_SET("CSV Reader", csv_reader,
+    autotelica::examples::csv_reader::examples<>(), autotelica::examples::csv_reader::tests<>());
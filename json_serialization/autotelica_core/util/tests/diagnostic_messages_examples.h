@@ -82,10 +82,54 @@ namespace autotelica {
                 }
 
             }
+            static std::vector<std::string> async_lines(size_t threads_, size_t messages_per_thread_) {
+                using namespace autotelica::diagnostic_messages;
+                std::string out;
+                auto target = make_string_message_handler(out);
+                {
+                    auto async = make_async_message_handler(target, 16); // small rings, so that threads wait for the writer
+                    auto scoped = make_scoped_handler(async);
+                    timestamp_disabler _t;
+                    messages::message("Value is %, name is %.", 42, std::string("x"));
+                    messages::message("Wide %.", L"d\u00e9f");
+                    std::string long_text(600, 'a'); // doesn't fit into a ring slot
+                    messages::warning(long_text.c_str());
+                    std::string s("s"); // ten strings don't fit into a ring slot either
+                    messages::message("%%%%%%%%%%", s, s, s, s, s, s, s, s, s, s);
+                    std::vector<std::thread> threads;
+                    for (size_t t = 0; t < threads_; ++t)
+                        threads.emplace_back([=]() {
+                            for (size_t i = 0; i < messages_per_thread_; ++i)
+                                messages::message("Thread % message %", t, i);
+                        });
+                    for (auto& t : threads) 
+                        t.join();
+                    std::dynamic_pointer_cast<async_message_handler>(async)->flush();
+                }
+                std::vector<std::string> lines;
+                std::stringstream all(std::dynamic_pointer_cast<string_message_handler>(target)->str());
+                std::string line;
+                while (std::getline(all, line))
+                    lines.push_back(line);
+                return lines;
+            }
+
             template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
             void tests() {
                 // disagnostic messages are not tested on purpose 
                 // every other test tests them
+
+                // asynchronous messages are formatted on a background thread, and end up in the target handler
+                auto const lines = async_lines(4, 100);
+                AF_TEST_RESULT(size_t(404), lines.size());
+                AF_TEST_RESULT(std::string("Value is 42, name is x."), lines[0]);
+                AF_TEST_RESULT(std::string("Wide d\xc3\xa9" "f."), lines[1]);
+                AF_TEST_RESULT(std::string("WARNING: ") + std::string(600, 'a'), lines[2]);
+                AF_TEST_RESULT(std::string("ssssssssss"), lines[3]);
+                size_t thread_3_messages = std::count_if(lines.begin(), lines.end(), 
+                    [](std::string const& l) { return l.find("Thread 3 message") == 0; });
+                AF_TEST_RESULT(size_t(100), thread_3_messages);
+                AF_TEST_RESULT(true, std::find(lines.begin(), lines.end(), "Thread 1 message 99") != lines.end());
             }
         }
     }
@@ -674,6 +674,26 @@ namespace autotelica {
 				AF_TEST_RESULT(false, is_bitset_f(*vector_vector_.begin()));
 				AF_TEST_RESULT(true, is_bitset_f(bs1_));
 				AF_TEST_RESULT(true, is_bitset_f(bs2_));
+
+				// pmr
+				AF_TEST_COMMENT("pmr");
+				AF_TEST_RESULT(false, is_pmr_f(vector_));
+				AF_TEST_RESULT(false, is_pmr_f(map_));
+				AF_TEST_RESULT(false, is_pmr_f(string_));
+				AF_TEST_RESULT(false, is_pmr_f(123));
+#if _AF_HAS_PMR
+				std::pmr::vector<double> pmr_vector_{ 1.23, 0.32435 };
+				std::pmr::map<std::pmr::string, int> pmr_map_{ {"First",2}, {"Second",3234324} };
+				std::pmr::string pmr_string_{ "test string" };
+				AF_TEST_RESULT(true, is_pmr_f(pmr_vector_));
+				AF_TEST_RESULT(true, is_pmr_f(pmr_map_));
+				AF_TEST_RESULT(true, is_pmr_f(pmr_string_));
+				AF_TEST_RESULT(true, is_vector_f(pmr_vector_));
+				AF_TEST_RESULT(true, is_map_f(pmr_map_));
+				AF_TEST_RESULT(true, is_string_f(pmr_string_));
+				AF_TEST_RESULT(true, is_sequence_f(pmr_vector_));
+				AF_TEST_RESULT(true, is_mapish_f(pmr_map_));
+#endif
 			}
 		}
 	}
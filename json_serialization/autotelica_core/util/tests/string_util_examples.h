@@ -1,4 +1,5 @@
 #pragma once
+#include <clocale>
 #include "testing_util.h"
 #include "string_util.h"
 namespace autotelica {
@@ -25,6 +26,34 @@ namespace autotelica {
                 AF_TEST_RESULT(false, wildcard_match("Yes no No yes yes no .yesYESyes", "?es no * yes yes no .*no"));
                 AF_TEST_RESULT(true, wildcard_match("same", "same"));
 
+                AF_TEST_COMMENT("Compiled wildcards.");
+                compiled_wildcard const yes_no("?es no * yes yes no .*");
+                AF_TEST_RESULT(true, yes_no.match("Yes no No yes yes no .yesYESyes"));
+                AF_TEST_RESULT(false, yes_no.match("Yes no No yes yes no yesYESyes"));
+                AF_TEST_RESULT(false, compiled_wildcard("").match("Yes"));
+                AF_TEST_RESULT(true, compiled_wildcard("").match(""));
+                AF_TEST_RESULT(true, compiled_wildcard("*ab").match("aab"));
+                AF_TEST_RESULT(true, compiled_wildcard("a*b?d*e").match("AxxbcbXde"));
+                AF_TEST_RESULT(false, compiled_wildcard("a*b?d*e").match("AxxbcbXdf"));
+                AF_TEST_RESULT(false, compiled_wildcard("a*b?d*e", true).match("AxxbcbXde"));
+                AF_TEST_RESULT(true, compiled_wildcard("**").match("anything"));
+                AF_TEST_RESULT(false, compiled_wildcard("ab*ba").match("aba"));
+                AF_TEST_RESULT(std::string("test_"), compiled_wildcard("Test_*.h").literal_prefix());
+                AF_TEST_RESULT(std::string("s.h"), compiled_wildcard("*_example?s.h").literal_suffix());
+
+                AF_TEST_COMMENT("Wildcard sets.");
+                wildcard_set patterns;
+                patterns.add("*.h");
+                patterns.add("test_*");
+                patterns.add("*example*");
+                patterns.add("exact.cpp");
+                patterns.add("test_?.cpp");
+                AF_TEST_RESULT(true, (std::vector<size_t>{ 0, 1, 2 } == patterns.matches("Test_Example.H")));
+                AF_TEST_RESULT(true, (std::vector<size_t>{ 1, 4 } == patterns.matches("test_1.cpp")));
+                AF_TEST_RESULT(true, (std::vector<size_t>{ 3 } == patterns.matches("exact.cpp")));
+                AF_TEST_RESULT(true, patterns.match("some_examples.cpp"));
+                AF_TEST_RESULT(false, patterns.match("exact.cpp.bak"));
+
                 std::string s1("Yes no No yes yes no yesyesyes");
                 std::string s2("no no no no no no");
 
@@ -69,9 +98,51 @@ namespace autotelica {
                 AF_TEST_RESULT(false, (us.find("SECOND_") != us.end()));
                 AF_TEST_RESULT(true, (us.find("third") != us.end()));
 
+                AF_TEST_COMMENT("Case insesitive hashing and comparisons.");
+                std::string const long_mixed("Some Longer String, With UTF-8 \xc3\xa9 In It");
+                AF_TEST_RESULT(hash_nc(to_lower(long_mixed)), hash_nc(long_mixed));
+                AF_TEST_RESULT(hash_nc_t<char>()("abc"), hash_nc_t<char>()(std::string("ABC")));
+                AF_TEST_RESULT(hash_nc(std::wstring(L"Wide")), hash_nc(std::wstring(L"wIDE")));
+                AF_TEST_RESULT(true, equal_nc(long_mixed, to_upper(long_mixed)));
+                AF_TEST_RESULT(false, equal_nc(long_mixed, long_mixed + "!"));
+                AF_TEST_RESULT(false, equal_nc(std::string("some longer string, with utf-8 \xc3\x89 in it"), long_mixed));
+                AF_TEST_RESULT(0, compare_nc("ABCDEFGHIJ", 10, "abcdefghij", 10));
+                AF_TEST_RESULT(-1, compare_nc("abcdefghiJ", 10, "ABCDEFGHIK", 10));
+                AF_TEST_RESULT(1, compare_nc("abcdefghij", 10, "ABCDEFGHI", 9));
+                AF_TEST_RESULT(true, less_nc_t<char>()("Alpha", std::string("beta")));
+                AF_TEST_RESULT(true, equal_nc_t<char>()("Alpha", std::string("ALPHA")));
+                // ordered containers can be searched without making a string
+                AF_TEST_RESULT(true, (s.find("sEcOnD") != s.end()));
+
                 AF_TEST_COMMENT("String interpolation.");
                 AF_TEST_RESULT(std::string("Test string formatted with a number 3 and a boolean true"),
                     af_format_string("Test % formatted with a number % and a boolean %", "string", 3, true));
+                // numbers are formatted the same way default streams format them
+                AF_TEST_RESULT(std::string("-9223372036854775808 18446744073709551615 0 -7 2.52342 1e+20 0.0001 -inf"),
+                    af_format_string("% % % % % % % %", std::numeric_limits<long long>::min(), std::numeric_limits<unsigned long long>::max(),
+                        0, short(-7), 2.5234234, 1e20, 0.0001f, -std::numeric_limits<double>::infinity()));
+                AF_TEST_RESULT(std::string("c 65 x false"), af_format_string("% % % %", 'c', (unsigned short)65, std::string("x"), false));
+                AF_TEST_RESULT(std::string("escaped \\ then 1, no arguments left %"), af_format_string("escaped \\\\ then %, no arguments left %", 1));
+                AF_TEST_RESULT(std::wstring(L"wide 3 true w"), af_format_string(L"wide % % %", 3, true, std::wstring(L"w")));
+                AF_TEST_RESULT(std::string(300, 'a') + "1", af_format_string("%%", std::string(300, 'a'), 1));
+
+                AF_TEST_COMMENT("Formatting into buffers.");
+                char buffer[8];
+                AF_TEST_RESULT(size_t(9), formatted_size("% and %", 12, "ab"));
+                AF_TEST_RESULT(size_t(9), format_to(buffer, sizeof(buffer), "% and %", 12, "ab"));
+                AF_TEST_RESULT(std::string("12 and "), std::string(buffer));
+                AF_TEST_RESULT(size_t(5), format_to(buffer, sizeof(buffer), "%-%", 1, 234));
+                AF_TEST_RESULT(std::string("1-234"), std::string(buffer));
+                std::string appended("x=");
+                format_append(appended, "%, y=%", 1.5, -2);
+                AF_TEST_RESULT(std::string("x=1.5, y=-2"), appended);
+
+                AF_TEST_COMMENT("Numbers are formatted the same whatever the global locale.");
+                std::string const numeric_locale = std::setlocale(LC_NUMERIC, nullptr);
+                if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+                    AF_TEST_RESULT(std::string("1.5 0.25"), af_format_string("% %", 1.5, 0.25L));
+                    std::setlocale(LC_NUMERIC, numeric_locale.c_str());
+                }
 
                 AF_TEST_COMMENT("Case conversions");
                 AF_TEST_RESULT("YES YES YES YES YES YES YESYESYES", to_upper("Yes yes yes yes yes yes yesYESyes"));
@@ -95,6 +166,56 @@ namespace autotelica {
                 AF_TEST_RESULT("1,2,3,4,5", to_csv(vi));
                 AF_TEST_RESULT("one_1,two_1,three_1\none_2,two_2,three_2\none_3,two_3,three_3", to_csv(vs));
                 AF_TEST_RESULT("0,0.123,1.234,2.45678", to_csv(sd));
+                AF_TEST_RESULT(true, csv_to_vector<int>(" 1, 2,3 ,4,5") == vi);
+                AF_TEST_RESULT(true, csv_to_vector<double>("0,0.123,1.234,2.45678") == sd);
+                AF_TEST_RESULT(true, csv_to_vector<std::string>(" a ,b") == std::vector<std::string>({ "a", "b" }));
+
+                AF_TEST_COMMENT("Converting strings without exceptions.");
+                int i = 0;
+                AF_TEST_RESULT(true, convert_string(" -42 ", i) == convert_status::ok);
+                AF_TEST_RESULT(-42, i);
+                AF_TEST_RESULT(true, convert_string("12x", i) == convert_status::invalid);
+                AF_TEST_RESULT(true, convert_string("", i) == convert_status::invalid);
+                AF_TEST_RESULT(true, convert_string("2147483648", i) == convert_status::out_of_range);
+                AF_TEST_RESULT(true, convert_string("-2147483648", i) == convert_status::ok);
+                AF_TEST_RESULT(std::numeric_limits<int>::min(), i);
+                unsigned long long ull = 0;
+                AF_TEST_RESULT(true, convert_string(L"18446744073709551615", ull) == convert_status::ok);
+                AF_TEST_RESULT(std::numeric_limits<unsigned long long>::max(), ull);
+                AF_TEST_RESULT(true, convert_string("-1", ull) == convert_status::out_of_range);
+                double d = 0;
+                AF_TEST_RESULT(true, convert_string("1.25e2", d) == convert_status::ok);
+                AF_TEST_RESULT(125.0, d);
+                AF_TEST_RESULT(true, convert_string("0.1", d) == convert_status::ok && d == 0.1);
+                AF_TEST_RESULT(true, convert_string("-.5", d) == convert_status::ok && d == -0.5);
+                AF_TEST_RESULT(true, convert_string("2.2250738585072014e-308", d) == convert_status::ok && d == 2.2250738585072014e-308);
+                AF_TEST_RESULT(true, convert_string("3.14159265358979323846264", d) == convert_status::ok && d == 3.14159265358979323846264);
+                AF_TEST_RESULT(true, convert_string("inf", d) == convert_status::ok && std::isinf(d));
+                d = 125.0;// failed conversions leave the value alone
+                AF_TEST_RESULT(true, convert_string("1e400", d) == convert_status::out_of_range);
+                AF_TEST_RESULT(true, convert_string("1e", d) == convert_status::invalid);
+                AF_TEST_RESULT(true, convert_string("1.5.", d) == convert_status::invalid);
+                AF_TEST_RESULT(125.0, d);
+                if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+                    AF_TEST_RESULT(true, convert_string("3.14159265358979323846264", d) == convert_status::ok && d == 3.14159265358979323846264);
+                    AF_TEST_RESULT(true, convert_string("3,14159265358979323846264", d) == convert_status::invalid);
+                    std::setlocale(LC_NUMERIC, numeric_locale.c_str());
+                }
+                float f = 0;
+                AF_TEST_RESULT(true, convert_string("0.3", f) == convert_status::ok && f == 0.3f);
+                bool b = false;
+                AF_TEST_RESULT(true, convert_string(" TRUE", b) == convert_status::ok && b);
+                AF_TEST_RESULT(true, convert_string("0", b) == convert_status::ok && !b);
+                AF_TEST_RESULT(true, convert_string("yes", b) == convert_status::invalid);
+
+                AF_TEST_COMMENT("Converting strings in bulk.");
+                std::vector<std::string> const texts{ "1", "2.5", "-3e1" };
+                std::vector<double> converted;
+                AF_TEST_RESULT(true, convert_strings(texts, converted) == convert_status::ok);
+                AF_TEST_RESULT(true, converted == std::vector<double>({ 1, 2.5, -30 }));
+                std::vector<int> ints;
+                AF_TEST_RESULT(true, convert_strings(texts, ints) == convert_status::invalid);
+                AF_TEST_RESULT(size_t(1), ints.size());
 
                 AF_TEST_RESULT(true, is_uppercase("UPPER"));
                 AF_TEST_RESULT(false, is_uppercase("UpPeR"));
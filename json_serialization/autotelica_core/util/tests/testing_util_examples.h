@@ -28,6 +28,23 @@ namespace autotelica {
                 AF_TEST_RESULT(1, c);
 
                 AF_TEST_RESULT(1, f_that_doesnt_throw());
+
+                // benchmarks run once in tests, and are measured with -run_benchmarks and -record
+                AF_BENCHMARK(0, autotelica::testing::do_not_optimize(f_that_doesnt_throw(c)));
+                size_t rejected = 0;
+                AF_TEST_RESULT(10.0, autotelica::testing::testing_impl::mean_without_outliers({ 10, 9, 11, 10, 10, 1000 }, rejected));
+                AF_TEST_RESULT(size_t(1), rejected);
+                AF_TEST_RESULT(0.0, autotelica::testing::testing_impl::mean_without_outliers({}, rejected));
+            }
+        }
+        namespace testing_serial {
+            template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+            void tests() {
+                // serial test sets are run one at a time, after the others, in parallel runs (-jobs)
+                using autotelica::testing::all_tests;
+                AF_TEST_RESULT(true, all_tests::is_serial("TestingTestingSerial"));
+                AF_TEST_RESULT(false, all_tests::is_serial("TestingTesting"));
+                AF_TEST_RESULT(false, all_tests::is_serial("no_such_test_set"));
             }
         }
     }
@@ -36,4 +53,7 @@ namespace autotelica {
 AF_DECLARE_TEST_SET("TestingTesting", testing, 
     autotelica::examples::testing::examples<>() , autotelica::examples::testing::tests<>());
 
+AF_DECLARE_SERIAL_TEST_SET("TestingTestingSerial", testing_serial, 
+    , autotelica::examples::testing_serial::tests<>());
+
 
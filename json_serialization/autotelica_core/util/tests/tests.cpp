@@ -1,6 +1,7 @@
 #include "asserts_examples.h"
 #include "cl_parsing_examples.h"
 #include "comparissons_examples.h"
+#include "csv_reader_examples.h"
 #include "diagnostic_messages_examples.h"
 #include "enum_to_string_examples.h"
 #include "enum_bitset_examples.h"
@@ -3,6 +3,7 @@
 #include "testing_util.h"
 #include <thread>
 #include <chrono>
+#include <sstream>
 
 namespace autotelica {
     namespace examples {
@@ -11,6 +12,34 @@ namespace autotelica {
                 using namespace std::chrono_literals;
                 std::this_thread::sleep_for(23124235ns);
             }
+            void profiled_work(size_t depth_) {
+                AF_PROFILE_SCOPE("work");
+                if (depth_)
+                    profiled_work(depth_ - 1);
+            }
+            template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+            void profiler_examples() {
+                AF_TEST_COMMENT("Profiling nested scopes.");
+                using namespace autotelica::timing;
+                for (size_t i = 0; i < 100; ++i) {
+                    AF_PROFILE_SCOPE("outer");
+                    {
+                        AF_PROFILE_SCOPE("inner");
+                        profiled_work(2);
+                    }
+                }
+                std::cout << profiler_t::instance() << std::endl;
+
+                AF_TEST_COMMENT("Tracing the same scopes, the output opens in chrome://tracing.");
+                auto& tracer = tracer_t::instance();
+                tracer.start();
+                for (size_t i = 0; i < 2; ++i) {
+                    AF_PROFILE_SCOPE("outer");
+                    profiled_work(1);
+                }
+                tracer.stop();
+                std::cout << tracer << std::endl;
+            }
             template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
             void examples() {
                 // code here will only be run in example runs
@@ -33,10 +62,97 @@ namespace autotelica {
                 
                 std::cout << _timers << std::endl;
 
+                profiler_examples();
             }
             template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
             void tests() {
-                
+                using namespace autotelica::timing;
+                // histogram buckets are exact for small values and within 1/32 above that
+                latency_histogram_t h;
+                for (uint64_t v = 1; v <= 1000; ++v)
+                    h.record(v);
+                AF_TEST_RESULT(uint64_t(1000), h.count());
+                AF_TEST_RESULT(uint64_t(1), h.min());
+                AF_TEST_RESULT(uint64_t(1000), h.max());
+                AF_TEST_RESULT(true, h.percentile(50) >= 500 && h.percentile(50) <= 500 + 500 / 32);
+                AF_TEST_RESULT(true, h.percentile(99) >= 990 && h.percentile(99) <= 990 + 990 / 32);
+                AF_TEST_RESULT(uint64_t(1000), h.percentile(100));
+                AF_TEST_RESULT(uint64_t(17), latency_histogram_t::bucket_value(latency_histogram_t::bucket(17)));
+                AF_TEST_RESULT(true, latency_histogram_t::bucket_value(latency_histogram_t::bucket(123456789)) >= 123456789);
+
+                latency_histogram_t other;
+                other.record(5000);
+                h.merge(other);
+                AF_TEST_RESULT(uint64_t(1001), h.count());
+                AF_TEST_RESULT(uint64_t(5000), h.max());
+
+                // scopes from different threads are merged by call path
+                auto& profiler = profiler_t::instance();
+                profiler.reset();
+                auto work = []() {
+                    for (size_t i = 0; i < 10; ++i) {
+                        AF_PROFILE_SCOPE("timing tests");
+                        profiled_work(1);
+                    }
+                };
+                std::thread t1(work);
+                std::thread t2(work);
+                t1.join();
+                t2.join();
+                auto merged = profiler.merged();
+                auto scope = merged.find("timing tests");
+                AF_TEST_RESULT(true, scope != nullptr);
+                if (scope) {
+                    AF_TEST_RESULT(uint64_t(20), scope->_calls);
+                    auto work_scope = scope->find("work");
+                    AF_TEST_RESULT(true, work_scope && work_scope->_calls == 20);
+                    AF_TEST_RESULT(true, work_scope && work_scope->find("work") && work_scope->find("work")->_calls == 20);
+                    AF_TEST_RESULT(uint64_t(20), scope->_histogram.count());
+                }
+
+                // scopes record raw clock ticks, they are converted to time when reported
+                {
+                    AF_PROFILE_SCOPE("sleeping");
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+                auto sleeping = profiler.merged().find("sleeping");
+                AF_TEST_RESULT(true, sleeping && profiler_t::nanoseconds(sleeping->_total) >= 2000000);
+                AF_TEST_RESULT(true, sleeping && profiler_t::nanoseconds(sleeping->_histogram.max()) < 1000000000);
+
+                // tracing records begin and end events for every scope, per thread
+                auto& tracer = tracer_t::instance();
+                tracer.start();
+                std::thread t3(work);
+                std::thread t4(work);
+                t3.join();
+                t4.join();
+                tracer.stop();
+                {
+                    AF_PROFILE_SCOPE("not traced");
+                }
+                std::stringstream trace;
+                trace << tracer;
+                auto count = [](std::string const& s_, std::string const& what_) {
+                    size_t out = 0;
+                    for (size_t p = s_.find(what_); p != std::string::npos; p = s_.find(what_, p + 1))
+                        ++out;
+                    return out;
+                };
+                // 10 iterations of "timing tests" and two levels of "work" on two threads
+                AF_TEST_RESULT(size_t(60), count(trace.str(), "\"ph\":\"B\""));
+                AF_TEST_RESULT(size_t(60), count(trace.str(), "\"ph\":\"E\""));
+                AF_TEST_RESULT(size_t(0), count(trace.str(), "not traced"));
+                AF_TEST_RESULT(size_t(0), tracer.dropped());
+
+                // full buffers drop events rather than block
+                trace_buffer_t buffer(1);
+                for (size_t i = 0; i < trace_buffer_t::capacity + 10; ++i)
+                    buffer.push("event", 'B', i);
+                AF_TEST_RESULT(size_t(10), buffer.dropped());
+                size_t drained = 0;
+                buffer.drain([&](trace_event_t const&) { ++drained; });
+                AF_TEST_RESULT(size_t(trace_buffer_t::capacity), drained);
+                AF_TEST_RESULT(true, buffer.push("event", 'E', 0));
             }
         }
     }
@@ -0,0 +1,24 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "json_benchmarks.h"
+#include <cstdlib>
+#include <new>
+
+// counts allocations, so that benchmarks can report allocations per document
+void* operator new(std::size_t size_) {
+	++autotelica::json_benchmarks::allocations();
+	if (void* p = std::malloc(size_ ? size_ : 1))
+		return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p_) noexcept {
+	std::free(p_);
+}
+void operator delete(void* p_, std::size_t) noexcept {
+	std::free(p_);
+}
+
+int main(int argc, const char* argv[])
+{
+	return autotelica::json_benchmarks::run(argc, argv);
+}
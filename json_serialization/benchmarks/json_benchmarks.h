@@ -0,0 +1,549 @@
+#pragma once
+// json_benchmarks: synthetic workloads for the serialization code
+// every workload is written and read a number of times, throughput (MB/s) and
+// allocations per document are measured and compared against a recorded baseline
+// terse and verbose modes are compile time switches, so each mode is a separate build
+// and baselines are recorded per mode
+#include "json_serialization.h"
+#include "autotelica_core/util/include/cl_parsing.h"
+#include "autotelica_core/util/include/timing.h"
+#include "autotelica_core/util/include/std_pretty_printing.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <functional>
+#include <memory>
+
+namespace autotelica {
+	namespace json_benchmarks {
+		using namespace autotelica::type_description;
+
+		// incremented by the operator new in json_benchmarks.cpp
+		// stays at zero in builds that don't replace operator new
+		inline std::atomic<size_t>& allocations() {
+			static std::atomic<size_t> _allocations{ 0 };
+			return _allocations;
+		}
+
+		inline std::string mode() {
+			return _AF_SERIALIZATION_TERSE ? "terse" : "verbose";
+		}
+
+		// workload types
+		// flat records, most of the values are defaults so that terse mode has something to skip
+		struct flat_record_t {
+			int _id;
+			double _price;
+			bool _active;
+			std::string _name;
+			std::string _currency;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<flat_record_t, serialization_factory_t>("flat_record").
+						member("id", &flat_record_t::_id, 0).
+						member("price", &flat_record_t::_price, 0.0).
+						member("active", &flat_record_t::_active, true).
+						member("name", &flat_record_t::_name, std::string()).
+						member("currency", &flat_record_t::_currency, std::string("USD")).
+					end_object();
+				return description;
+			}
+		};
+
+		struct flat_records_t {
+			std::vector<flat_record_t> _records;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<flat_records_t, serialization_factory_t>("flat_records").
+						member("records", &flat_records_t::_records).
+					end_object();
+				return description;
+			}
+		};
+
+		// deep nesting, fixed depth so that the handler tree is finite
+		template<size_t depth_v>
+		struct nested_t {
+			int _level;
+			std::string _tag;
+			std::vector<nested_t<depth_v - 1>> _children;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<nested_t, serialization_factory_t>("nested").
+						member("level", &nested_t::_level).
+						member("tag", &nested_t::_tag).
+						member("children", &nested_t::_children).
+					end_object();
+				return description;
+			}
+		};
+
+		template<>
+		struct nested_t<0> {
+			int _level;
+			std::string _tag;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<nested_t, serialization_factory_t>("nested").
+						member("level", &nested_t::_level).
+						member("tag", &nested_t::_tag).
+					end_object();
+				return description;
+			}
+		};
+
+		static const size_t nesting_depth = 32;
+
+		struct deep_nesting_t {
+			std::vector<nested_t<nesting_depth>> _trees;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<deep_nesting_t, serialization_factory_t>("deep_nesting").
+						member("trees", &deep_nesting_t::_trees).
+					end_object();
+				return description;
+			}
+		};
+
+		struct numeric_arrays_t {
+			std::vector<double> _doubles;
+			std::vector<int> _ints;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<numeric_arrays_t, serialization_factory_t>("numeric_arrays").
+						member("doubles", &numeric_arrays_t::_doubles).
+						member("ints", &numeric_arrays_t::_ints).
+					end_object();
+				return description;
+			}
+		};
+
+		struct string_maps_t {
+			std::map<std::string, std::string> _values;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<string_maps_t, serialization_factory_t>("string_maps").
+						member("values", &string_maps_t::_values).
+					end_object();
+				return description;
+			}
+		};
+
+		// polymorphic graph, goes through handler_dynamic_object_t
+		struct shape_t {
+			virtual ~shape_t() {}
+			virtual autotelica::type_description::type_description_factory_p type_description_factory() = 0;
+		};
+
+		struct circle_t : public shape_t {
+			double _x;
+			double _y;
+			double _radius;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<circle_t, serialization_factory_t>("circle", 1).
+						member("x", &circle_t::_x).
+						member("y", &circle_t::_y).
+						member("radius", &circle_t::_radius).
+					end_object();
+				return description;
+			}
+			AF_IMPLEMENTS_DYNAMIC_TYPE_DESCRIPTION;
+		};
+
+		struct polygon_t : public shape_t {
+			std::vector<double> _xs;
+			std::vector<double> _ys;
+			std::string _label;
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<polygon_t, serialization_factory_t>("polygon", 2).
+						member("xs", &polygon_t::_xs).
+						member("ys", &polygon_t::_ys).
+						member("label", &polygon_t::_label).
+					end_object();
+				return description;
+			}
+			AF_IMPLEMENTS_DYNAMIC_TYPE_DESCRIPTION;
+		};
+
+		struct shape_maker_t {
+			shape_t* make(size_t class_id_) const {
+				switch (class_id_) {
+				case 1: return new circle_t();
+				case 2: return new polygon_t();
+				default: AF_ERROR("Unknown shape class id %.", class_id_);
+				}
+				return nullptr;
+			}
+			void make_from_class_id(size_t class_id_, shape_t** target_) const {
+				*target_ = make(class_id_);
+			}
+			void make_from_class_name(std::string const& class_name_, shape_t** target_) const {
+				if (class_name_ == "circle")
+					*target_ = make(1);
+				else if (class_name_ == "polygon")
+					*target_ = make(2);
+				else
+					AF_ERROR("Unknown shape class name %.", class_name_);
+			}
+		};
+
+		struct drawing_t {
+			std::vector<shape_t*> _shapes;
+
+			drawing_t() {}
+			drawing_t(drawing_t const&) = delete;
+			drawing_t& operator=(drawing_t const&) = delete;
+			~drawing_t() {
+				for (auto s : _shapes)
+					delete s;
+			}
+
+			template<typename serialization_factory_t>
+			static type_description_t<serialization_factory_t> const& type_description() {
+				static const auto description =
+					begin_object<drawing_t, serialization_factory_t>("drawing").
+						member("shapes", &drawing_t::_shapes, shape_maker_t()).
+					end_object();
+				return description;
+			}
+		};
+
+		// synthetic data, seeded so that every run serializes the same documents
+		namespace generators {
+			inline std::string random_string(std::mt19937& rng_, size_t min_, size_t max_) {
+				static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-";
+				std::uniform_int_distribution<size_t> length(min_, max_);
+				std::uniform_int_distribution<size_t> letter(0, sizeof(letters) - 2);
+				std::string out(length(rng_), ' ');
+				for (auto& c : out)
+					c = letters[letter(rng_)];
+				return out;
+			}
+
+			inline void generate(flat_records_t& target_, size_t size_) {
+				std::mt19937 rng(2510);
+				std::uniform_real_distribution<double> price(0.0, 1000.0);
+				target_._records.resize(size_);
+				for (size_t i = 0; i < size_; ++i) {
+					auto& r = target_._records[i];
+					r._id = static_cast<int>(i);
+					r._price = price(rng);
+					r._active = (i % 10) != 0;
+					r._name = random_string(rng, 8, 24);
+					r._currency = (i % 7) ? "USD" : "EUR";
+				}
+			}
+
+			inline void generate(nested_t<0>& target_, std::mt19937& rng_) {
+				target_._level = 0;
+				target_._tag = random_string(rng_, 4, 12);
+			}
+
+			template<size_t depth_v>
+			inline void generate(nested_t<depth_v>& target_, std::mt19937& rng_) {
+				target_._level = static_cast<int>(depth_v);
+				target_._tag = random_string(rng_, 4, 12);
+				target_._children.resize(1);
+				generate(target_._children[0], rng_);
+			}
+
+			inline void generate(deep_nesting_t& target_, size_t size_) {
+				std::mt19937 rng(2510);
+				target_._trees.resize(size_);
+				for (auto& t : target_._trees)
+					generate(t, rng);
+			}
+
+			inline void generate(numeric_arrays_t& target_, size_t size_) {
+				std::mt19937 rng(2510);
+				std::normal_distribution<double> d(0.0, 1e6);
+				std::uniform_int_distribution<int> i(-1000000, 1000000);
+				target_._doubles.resize(size_);
+				target_._ints.resize(size_);
+				for (size_t j = 0; j < size_; ++j) {
+					target_._doubles[j] = d(rng);
+					target_._ints[j] = i(rng);
+				}
+			}
+
+			inline void generate(string_maps_t& target_, size_t size_) {
+				std::mt19937 rng(2510);
+				while (target_._values.size() < size_)
+					target_._values[random_string(rng, 8, 32)] = random_string(rng, 16, 64);
+			}
+
+			inline void generate(drawing_t& target_, size_t size_) {
+				std::mt19937 rng(2510);
+				std::uniform_real_distribution<double> coordinate(-100.0, 100.0);
+				target_._shapes.reserve(size_);
+				for (size_t i = 0; i < size_; ++i) {
+					if (i % 3) {
+						auto c = new circle_t();
+						c->_x = coordinate(rng);
+						c->_y = coordinate(rng);
+						c->_radius = coordinate(rng);
+						target_._shapes.push_back(c);
+					}
+					else {
+						auto p = new polygon_t();
+						for (size_t v = 0; v < 6; ++v) {
+							p->_xs.push_back(coordinate(rng));
+							p->_ys.push_back(coordinate(rng));
+						}
+						p->_label = random_string(rng, 4, 16);
+						target_._shapes.push_back(p);
+					}
+				}
+			}
+		}
+
+		// one measurement
+		struct result_t {
+			std::string _mode;
+			std::string _workload;
+			std::string _operation;		// read or write
+			double _mbps;
+			double _allocations;		// per document
+
+			std::string key() const {
+				return _mode + " " + _workload + " " + _operation;
+			}
+		};
+
+		// a workload writes or reads its document once per call
+		class workload_t {
+			std::string _name;
+			std::function<std::string()> _write;
+			std::function<void(std::string const&)> _read;
+		public:
+			workload_t(std::string const& name_,
+				std::function<std::string()> write_,
+				std::function<void(std::string const&)> read_) :
+				_name(name_), _write(write_), _read(read_) {}
+
+			template<typename target_t>
+			static workload_t create(std::string const& name_, size_t size_) {
+				auto document = std::make_shared<target_t>();
+				generators::generate(*document, size_);
+				return workload_t(name_,
+					[document]() { return json::writer<>::to_string(*document); },
+					[](std::string const& json_) {
+						target_t target;
+						json::reader<>::from_string(target, json_);
+					});
+			}
+
+			std::string const& name() const { return _name; }
+
+			// every operation is timed repetitions_ times, iterations_ runs each, and the median repetition is reported
+			// so that one noisy repetition (a context switch, a page fault storm) doesn't make or hide a regression
+			std::vector<result_t> run(size_t iterations_, size_t repetitions_) const {
+				std::string json = _write();		// warm up, and the input for reading
+				_read(json);
+				double mb = static_cast<double>(json.size()) * iterations_ / (1024.0 * 1024.0);
+
+				auto median = [](std::vector<double>& values_) {
+					std::sort(values_.begin(), values_.end());
+					size_t const middle = values_.size() / 2;
+					return values_.size() % 2 ? values_[middle] : (values_[middle - 1] + values_[middle]) / 2;
+				};
+				auto measure = [&](std::string const& operation_, std::function<void()> const& f_) {
+					std::vector<double> mbps, allocations_per_document;
+					for (size_t r = 0; r < repetitions_; ++r) {
+						size_t allocations_before = allocations();
+						timing::timer timer;
+						timer.start();
+						for (size_t i = 0; i < iterations_; ++i)
+							f_();
+						timer.stop();
+						size_t allocated = allocations() - allocations_before;
+						double seconds = std::chrono::duration<double>(timer.period()).count();
+						mbps.push_back(seconds > 0 ? mb / seconds : 0.0);
+						allocations_per_document.push_back(static_cast<double>(allocated) / iterations_);
+					}
+					return result_t{ mode(), _name, operation_, median(mbps), median(allocations_per_document) };
+				};
+				return {
+					measure("write", [&]() { _write(); }),
+					measure("read", [&]() { _read(json); })
+				};
+			}
+		};
+
+		inline std::vector<workload_t> workloads() {
+			return {
+				workload_t::create<flat_records_t>("flat_records", 20000),
+				workload_t::create<deep_nesting_t>("deep_nesting", 500),
+				workload_t::create<numeric_arrays_t>("numeric_arrays", 100000),
+				workload_t::create<string_maps_t>("string_maps", 20000),
+				workload_t::create<drawing_t>("polymorphic", 10000)
+			};
+		}
+
+		// baseline file has one line per measurement:
+		//		<mode> <workload> <operation> <MB/s> <allocations per document>
+		// lines for modes other than the current one are kept when recording
+		inline std::vector<result_t> read_baseline(std::istream& in_) {
+			std::vector<result_t> out;
+			std::string line;
+			while (std::getline(in_, line)) {
+				if (line.empty() || line[0] == '#')
+					continue;
+				std::istringstream sin(line);
+				result_t r;
+				if (sin >> r._mode >> r._workload >> r._operation >> r._mbps >> r._allocations)
+					out.push_back(r);
+			}
+			return out;
+		}
+
+		inline void write_baseline(std::ostream& out_, std::vector<result_t> const& results_) {
+			out_ << "# mode workload operation MB/s allocations_per_document\n";
+			for (auto const& r : results_)
+				out_ << r._mode << " " << r._workload << " " << r._operation << " "
+					<< r._mbps << " " << r._allocations << "\n";
+		}
+
+		// replaces the baseline entries for which there are new results
+		inline std::vector<result_t> merge_baseline(std::vector<result_t> const& baseline_, std::vector<result_t> const& results_) {
+			std::vector<result_t> out;
+			for (auto const& b : baseline_)
+				if (std::find_if(results_.begin(), results_.end(),
+					[&](result_t const& r) { return r.key() == b.key(); }) == results_.end())
+					out.push_back(b);
+			out.insert(out.end(), results_.begin(), results_.end());
+			return out;
+		}
+
+		// a regression is throughput below, or allocation count above, the baseline by more than tolerance_ (a fraction)
+		inline std::vector<std::string> regressions(std::vector<result_t> const& baseline_, std::vector<result_t> const& results_, double tolerance_) {
+			using namespace autotelica::string_util;
+			std::vector<std::string> out;
+			for (auto const& r : results_) {
+				auto b = std::find_if(baseline_.begin(), baseline_.end(),
+					[&](result_t const& b_) { return b_.key() == r.key(); });
+				if (b == baseline_.end())
+					continue;
+				if (r._mbps < b->_mbps * (1.0 - tolerance_))
+					out.push_back(af_format_string("% is slower: % MB/s, baseline % MB/s.", r.key(), r._mbps, b->_mbps));
+				if (r._allocations > b->_allocations * (1.0 + tolerance_))
+					out.push_back(af_format_string("% allocates more: % per document, baseline %.", r.key(), r._allocations, b->_allocations));
+			}
+			return out;
+		}
+
+		inline std::vector<std::vector<std::string>> to_table(std::vector<result_t> const& baseline_, std::vector<result_t> const& results_) {
+			using namespace autotelica::string_util;
+			std::vector<std::vector<std::string>> out{ {"mode", "workload", "operation", "MB/s", "baseline MB/s", "allocations", "baseline allocations"} };
+			for (auto const& r : results_) {
+				auto b = std::find_if(baseline_.begin(), baseline_.end(),
+					[&](result_t const& b_) { return b_.key() == r.key(); });
+				bool has_baseline = b != baseline_.end();
+				out.push_back({ r._mode, r._workload, r._operation,
+					af_format_string("%", r._mbps), has_baseline ? af_format_string("%", b->_mbps) : "-",
+					af_format_string("%", r._allocations), has_baseline ? af_format_string("%", b->_allocations) : "-" });
+			}
+			return out;
+		}
+
+		inline int run(int argc_, const char* argv_[]) {
+			using namespace autotelica::cl_parsing;
+			using namespace autotelica::std_pretty_printing;
+			cl_commands commands(
+				"JSON serialization benchmarks, for the mode this was built with (" + mode() + ").\n"
+				"Fails when throughput or allocations regress against the baseline.");
+			commands.register_command("baseline", "Baseline file to compare against: -baseline <file>",
+				{ "baseline", "b" }, 1);
+			commands.register_command("record", "Records the results into the baseline file instead of comparing: -record",
+				{ "record", "r" }, 0);
+			commands.register_command("tolerance", "Allowed regression in percent, 10 by default: -tolerance <percent>",
+				{ "tolerance", "t" }, 1);
+			commands.register_command("iterations", "Number of times each document is written and read, 20 by default: -iterations <n>",
+				{ "iterations", "i" }, 1);
+			commands.register_command("repetitions", "Number of times the iterations are timed, the median is reported, 5 by default: -repetitions <n>",
+				{ "repetitions", "n" }, 1);
+			try {
+				commands.parse_command_line(argc_, argv_);
+				commands.execute();// help
+
+				size_t iterations = commands.has("iterations") ? std::stoul(commands.arguments("iterations")[0]) : 20;
+				size_t repetitions = commands.has("repetitions") ? std::stoul(commands.arguments("repetitions")[0]) : 5;
+				AF_ASSERT(iterations > 0 && repetitions > 0, "-iterations and -repetitions have to be positive.");
+				double tolerance = (commands.has("tolerance") ? std::stod(commands.arguments("tolerance")[0]) : 10.0) / 100.0;
+				std::string baseline_path = commands.has("baseline") ? commands.arguments("baseline")[0] : "";
+
+				bool const recording = commands.has("record");
+
+				// a baseline that isn't there must not pass as "no regressions", only recording may start a new one
+				std::vector<result_t> baseline;
+				if (!baseline_path.empty()) {
+					std::ifstream in(baseline_path);
+					AF_ASSERT(in || recording, "Failed to open baseline file %.", baseline_path);
+					if (in)
+						baseline = read_baseline(in);
+					AF_ASSERT(!baseline.empty() || recording, "Baseline file % has no measurements.", baseline_path);
+					AF_ASSERT(recording || std::any_of(baseline.begin(), baseline.end(),
+						[](result_t const& b_) { return b_._mode == mode(); }),
+						"Baseline file % has no measurements for %, record them with -record.", baseline_path, mode());
+				}
+
+				std::vector<result_t> results;
+				for (auto const& w : workloads()) {
+					std::cerr << "running " << w.name() << std::endl;
+					auto r = w.run(iterations, repetitions);
+					results.insert(results.end(), r.begin(), r.end());
+				}
+				std::cout << table_s(to_table(baseline, results), true) << std::endl;
+
+				if (recording) {
+					AF_ASSERT(!baseline_path.empty(), "-record needs a -baseline file to record into.");
+					std::ofstream out(baseline_path);
+					AF_ASSERT(out, "Failed to open %.", baseline_path);
+					write_baseline(out, merge_baseline(baseline, results));
+					std::cout << "Recorded " << mode() << " baseline in " << baseline_path << std::endl;
+					return 0;
+				}
+				if (baseline.empty()) {
+					std::cout << "No baseline to compare against, record one with -baseline <file> -record." << std::endl;
+					return 0;
+				}
+				auto failures = regressions(baseline, results, tolerance);
+				if (!failures.empty()) {
+					std::cerr << "\n*** PERFORMANCE REGRESSION (" << mode() << ") ***\n";
+					for (auto const& f : failures)
+						std::cerr << "\t" << f << "\n";
+					std::cerr << std::endl;
+					return 1;
+				}
+				std::cout << "No regressions against " << baseline_path << std::endl;
+			}
+			catch (std::exception const& e) {
+				std::cerr << e.what() << std::endl;
+				return 1;
+			}
+			return 0;
+		}
+	}
+}
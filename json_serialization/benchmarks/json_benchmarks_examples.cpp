@@ -0,0 +1,58 @@
+#include "autotelica_core/util/include/testing_util.h"
+#include "json_benchmarks.h"
+
+namespace json_benchmarks_examples {
+    using namespace autotelica::json_benchmarks;
+
+    std::vector<result_t> baseline() {
+        std::istringstream in(
+            "# mode workload operation MB/s allocations_per_document\n"
+            "verbose flat_records write 100 10\n"
+            "verbose flat_records read 50 200\n"
+            "\n"
+            "terse flat_records write 120 10\n");
+        return read_baseline(in);
+    }
+
+    template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+    void examples() {
+        // code here will only be run in example runs
+        using namespace autotelica::diagnostic_messages;
+        std::vector<result_t> results{ {"verbose", "flat_records", "write", 80, 10}, {"verbose", "flat_records", "read", 55, 250} };
+        messages::message("Regressions against the baseline: %", regressions(baseline(), results, 0.1));
+    }
+    template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
+    void tests() {
+        // code here will be run in test, examples and record mode
+        auto b = baseline();
+        AF_TEST_RESULT(size_t(3), b.size());
+        AF_TEST_RESULT(std::string("terse flat_records write"), b[2].key());
+        AF_TEST_RESULT(120.0, b[2]._mbps);
+
+        // within tolerance
+        std::vector<result_t> results{ {"verbose", "flat_records", "write", 95, 10}, {"verbose", "flat_records", "read", 50, 210} };
+        AF_TEST_RESULT(size_t(0), regressions(b, results, 0.1).size());
+        // slower
+        results[0]._mbps = 80;
+        AF_TEST_RESULT(size_t(1), regressions(b, results, 0.1).size());
+        // slower and allocating more
+        results[1]._allocations = 250;
+        AF_TEST_RESULT(size_t(2), regressions(b, results, 0.1).size());
+        // no baseline, nothing to regress against
+        std::vector<result_t> unknown{ {"verbose", "deep_nesting", "read", 1, 1000} };
+        AF_TEST_RESULT(size_t(0), regressions(b, unknown, 0.1).size());
+
+        // recording replaces entries for the same mode, workload and operation, and keeps the rest
+        auto merged = merge_baseline(b, results);
+        AF_TEST_RESULT(size_t(3), merged.size());
+        AF_TEST_RESULT(std::string("terse flat_records write"), merged[0].key());
+        AF_TEST_RESULT(80.0, merged[1]._mbps);
+
+        std::ostringstream out;
+        write_baseline(out, merged);
+        std::istringstream in(out.str());
+        AF_TEST_RESULT(size_t(3), read_baseline(in).size());
+    }
+}
+
+AF_DECLARE_TEST_SET("json_benchmarks tests", json_benchmarks, json_benchmarks_examples::examples<>(), json_benchmarks_examples::tests<>());
@@ -0,0 +1,2 @@
+#!/bin/sh
+./linux_build/packages/json_benchmarks/release/json_benchmarks_test -re -errors_only
@@ -6,6 +6,12 @@
 #define _AF_JSON_READ_BUFFER_SIZE 4*65535
 #endif
 
+// Size of each of the two buffers used by asynchronous file writing.
+// Keep it a multiple of 4096, direct I/O needs aligned writes.
+#ifndef _AF_JSON_ASYNC_WRITE_BUFFER_SIZE
+#define _AF_JSON_ASYNC_WRITE_BUFFER_SIZE 4*1024*1024
+#endif
+
 // Optimisation of strings maps means that keys in the map are used as JSON keys.
 // Otherwise they are written with "key", "value" pairs like other maps.
 #ifndef		_AF_JSON_OPTIMISED_STRING_MAPS
@@ -17,13 +23,62 @@
 #define		_AF_JSON_USE_CLASS_TAGS true
 #endif
 
+// Shared object ids preserve the object graph when several shared_ptr members point to the same object.
+// The first occurrence is written as {"$id": n, "$value": ...}, later ones as {"$ref": n}.
+// On reading, the references are resolved back to the same shared object.
+#ifndef		_AF_JSON_SHARED_OBJECT_IDS
+#define		_AF_JSON_SHARED_OBJECT_IDS false
+#endif
+
+// Per-type statistics: objects read and written, payload bytes, time and allocations, by class name.
+// When off (default) none of it is compiled in.
+// To count allocations, also put AF_IMPLEMENTS_JSON_ALLOCATION_COUNTING in one of your cpp files.
+#ifndef		_AF_JSON_PROFILING
+#define		_AF_JSON_PROFILING false
+#endif
+
+// Transparent gzip compression of JSON files (needs zlib).
+// Files ending in .gz are then compressed/decompressed on the fly, other files can be forced with json_compression::gzip.
+#ifndef		_AF_JSON_USE_ZLIB
+#define		_AF_JSON_USE_ZLIB false
+#endif
+
+// Chunk size for compressed streams, memory use of a stream is about twice that.
+#ifndef		_AF_JSON_COMPRESSION_CHUNK_SIZE
+#define		_AF_JSON_COMPRESSION_CHUNK_SIZE 65536
+#endif
+
 #include "type_description.h"
 
 #include "autotelica_core/util/include/asserts.h"
 #include "autotelica_core/util/include/enum_to_string.h"
 #include "autotelica_core/util/include/string_util.h"
+#if _AF_JSON_PROFILING
+#include "autotelica_core/util/include/timing.h"
+#include <map>
+#endif
 #include <string.h>
 #include <cstdint>
+#include <unordered_map>
+#include <typeindex>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#endif
 // for some reason, probably good, rapidjson uses their own size_t
 // we are going to just make that size_type
 #define RAPIDJSON_NO_SIZETYPEDEFINE
@@ -37,6 +92,10 @@ namespace rapidjson { typedef size_t SizeType; }
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/schema.h"
+#include "rapidjson/memorystream.h"
+#if _AF_JSON_USE_ZLIB
+#include <zlib.h>
+#endif
 
 
 namespace autotelica {
@@ -54,6 +113,408 @@ namespace json {
 		detect
 	};
 
+	// how asynchronous file writing treats the disk
+	enum class async_write_policy {
+		buffered,	// plain writes, the OS caches them as usual
+		sync_data,	// as above, but data is synced to disk (fdatasync) before the file is closed
+		direct		// bypasses the OS cache (O_DIRECT) where supported, good for huge dumps that won't be read soon
+	};
+
+#if _AF_JSON_USE_ZLIB
+	// compression of JSON files
+	enum class json_compression {
+		none,
+		gzip,
+		by_extension	// gzip if the file name ends in .gz
+	};
+#endif
+
+	// pool of distinct strings, equal strings are stored only once
+	// lookups don't allocate, only new strings are copied into the pool
+	// the pool is thread safe and never shrinks, so references to pooled strings stay valid
+	class string_pool_t {
+	public:
+		using char_t = traits::char_t;
+		using string_t = traits::string_t;
+	private:
+		struct view_t {
+			const char_t* _str;
+			size_t _length;
+		};
+		struct view_hash_t {
+			inline size_t operator()(view_t const& v_) const {
+				// FNV-1a, good enough for the short strings we usually intern
+				size_t h = static_cast<size_t>(14695981039346656037ULL);
+				for (size_t i = 0; i < v_._length; ++i) {
+					h ^= static_cast<size_t>(v_._str[i]);
+					h *= static_cast<size_t>(1099511628211ULL);
+				}
+				return h;
+			}
+		};
+		struct view_equal_t {
+			inline bool operator()(view_t const& l_, view_t const& r_) const {
+				return l_._length == r_._length &&
+					std::char_traits<char_t>::compare(l_._str, r_._str, l_._length) == 0;
+			}
+		};
+
+		std::deque<string_t> _storage; // deque never moves its elements
+		std::unordered_map<view_t, string_t const*, view_hash_t, view_equal_t> _index;
+		mutable std::mutex _mutex;
+	public:
+		string_pool_t() {}
+		string_pool_t(string_pool_t const&) = delete;
+		string_pool_t& operator=(string_pool_t const&) = delete;
+
+		string_t const& intern(const char_t* str_, size_t length_) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _index.find(view_t{ str_, length_ });
+			if (it != _index.end())
+				return *it->second;
+			_storage.emplace_back(str_, length_);
+			string_t const& interned = _storage.back();
+			_index.emplace(view_t{ interned.c_str(), interned.size() }, &interned);
+			return interned;
+		}
+		inline string_t const& intern(string_t const& str_) {
+			return intern(str_.c_str(), str_.size());
+		}
+
+		inline size_t size() const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _storage.size();
+		}
+
+		static string_pool_t& global() {
+			static string_pool_t _pool;
+			return _pool;
+		}
+
+		// interning into the global pool through a per thread cache of what the thread has interned before,
+		// so threads reading documents in parallel only take the pool lock for strings new to them
+		static string_t const& intern_global(const char_t* str_, size_t length_) {
+			static thread_local std::unordered_map<view_t, string_t const*, view_hash_t, view_equal_t> _cache;
+			auto it = _cache.find(view_t{ str_, length_ });
+			if (it != _cache.end())
+				return *it->second;
+			string_t const& interned = global().intern(str_, length_);
+			_cache.emplace(view_t{ interned.c_str(), interned.size() }, &interned);
+			return interned;
+		}
+		static string_t const* empty_global() {
+			static string_t const* const _empty = &global().intern(string_t());
+			return _empty;
+		}
+	};
+
+	// handle to a string in the global string pool
+	// use it instead of a string for members that repeat a small set of values (currencies, venues, ...)
+	// equal strings share storage and equality is a pointer comparison
+	class interned_string_t {
+	public:
+		using char_t = traits::char_t;
+		using string_t = traits::string_t;
+	private:
+		string_t const* _value;
+	public:
+		interned_string_t() : _value(string_pool_t::empty_global()) {}
+		interned_string_t(const char_t* str_, size_t length_) : _value(&string_pool_t::intern_global(str_, length_)) {}
+		interned_string_t(const char_t* str_) : interned_string_t(str_, std::char_traits<char_t>::length(str_)) {}
+		interned_string_t(string_t const& str_) : _value(&string_pool_t::intern_global(str_.c_str(), str_.size())) {}
+
+		inline string_t const& str() const { return *_value; }
+		inline const char_t* c_str() const { return _value->c_str(); }
+		inline size_t size() const { return _value->size(); }
+		inline bool empty() const { return _value->empty(); }
+		inline operator string_t const& () const { return *_value; }
+
+		inline bool operator==(interned_string_t const& other_) const { return _value == other_._value; }
+		inline bool operator!=(interned_string_t const& other_) const { return _value != other_._value; }
+		inline bool operator<(interned_string_t const& other_) const { return *_value < *other_._value; }
+
+		// pooled strings never move, so the address is a perfectly good hash
+		inline size_t hash() const { return std::hash<string_t const*>()(_value); }
+	};
+
+	template<typename stream_t>
+	inline stream_t& operator<<(stream_t& out_, interned_string_t const& s_) {
+		out_ << s_.str();
+		return out_;
+	}
+
+	template<typename T>
+	using is_interned_string_t = std::is_same<T, interned_string_t>;
+
+	// array that is streamed rather than stored, use it as a member in place of a container
+	// when reading, every element is passed to the sink as soon as it's loaded
+	// when writing, elements are pulled from the source until it returns false
+	// either way, memory use doesn't depend on the size of the array
+	template<typename element_tt>
+	class array_stream_t {
+	public:
+		using element_t = element_tt;
+		using sink_t = std::function<void(element_t&)>;
+		using source_t = std::function<bool(element_t&)>;
+	private:
+		sink_t _sink;
+		source_t _source;
+	public:
+		array_stream_t(sink_t sink_ = nullptr, source_t source_ = nullptr) :
+			_sink(sink_), _source(source_) {}
+
+		inline void set_sink(sink_t sink_) { _sink = sink_; }
+		inline void set_source(source_t source_) { _source = source_; }
+		inline sink_t const& sink() const { return _sink; }
+		inline source_t const& source() const { return _source; }
+	};
+
+	template<typename T, typename U = void>
+	struct is_array_stream_impl : std::false_type {};
+	template<typename T>
+	struct is_array_stream_impl<T, std_disambiguation::_void_t<std::enable_if_t<std::is_same<T,
+		array_stream_t<typename T::element_t>>::value>>> : std::true_type {};
+	template<typename T>
+	struct is_array_stream_t : is_array_stream_impl<T>::type {};
+
+#if _AF_JSON_PROFILING
+namespace profiling {
+	// what we know about reading and writing one type
+	struct type_stats_t {
+		using duration_t = std::chrono::nanoseconds;
+
+		size_t _read = 0;
+		size_t _written = 0;
+		size_t _bytes_read = 0;	// payload bytes: strings, keys and numbers, not the JSON punctuation
+		size_t _bytes_written = 0;
+		duration_t _read_time = duration_t::zero(); // includes time spent in contained objects
+		duration_t _write_time = duration_t::zero();
+		size_t _read_allocations = 0; // only counted with AF_IMPLEMENTS_JSON_ALLOCATION_COUNTING
+		size_t _write_allocations = 0;
+	};
+
+	// what one thread recorded for one type, only that thread adds to it
+	// counters are atomic so that the profiler can read (and reset) them while the thread keeps going
+	struct thread_type_stats_t {
+		using duration_t = type_stats_t::duration_t;
+		using counter_t = std::atomic<size_t>;
+		using time_counter_t = std::atomic<duration_t::rep>;
+
+		traits::string_t const _class_name;
+		counter_t _read{ 0 };
+		counter_t _written{ 0 };
+		counter_t _bytes_read{ 0 };
+		counter_t _bytes_written{ 0 };
+		time_counter_t _read_time{ 0 };
+		time_counter_t _write_time{ 0 };
+		counter_t _read_allocations{ 0 };
+		counter_t _write_allocations{ 0 };
+
+		thread_type_stats_t(traits::string_t const& class_name_) : _class_name(class_name_) {}
+
+		template<typename value_t>
+		static inline void add(std::atomic<value_t>& counter_, value_t value_) {
+			counter_.fetch_add(value_, std::memory_order_relaxed);
+		}
+		template<typename value_t>
+		static inline value_t get(std::atomic<value_t> const& counter_) {
+			return counter_.load(std::memory_order_relaxed);
+		}
+
+		inline void record_read(size_t bytes_, duration_t const& time_, size_t allocations_) {
+			add(_read, size_t(1));
+			add(_bytes_read, bytes_);
+			add(_read_time, time_.count());
+			add(_read_allocations, allocations_);
+		}
+		inline void record_write(size_t bytes_, duration_t const& time_, size_t allocations_) {
+			add(_written, size_t(1));
+			add(_bytes_written, bytes_);
+			add(_write_time, time_.count());
+			add(_write_allocations, allocations_);
+		}
+		void add_to(type_stats_t& stats_) const {
+			stats_._read += get(_read);
+			stats_._written += get(_written);
+			stats_._bytes_read += get(_bytes_read);
+			stats_._bytes_written += get(_bytes_written);
+			stats_._read_time += duration_t(get(_read_time));
+			stats_._write_time += duration_t(get(_write_time));
+			stats_._read_allocations += get(_read_allocations);
+			stats_._write_allocations += get(_write_allocations);
+		}
+		void reset() {
+			for (auto* c : { &_read, &_written, &_bytes_read, &_bytes_written, &_read_allocations, &_write_allocations })
+				c->store(0, std::memory_order_relaxed);
+			_read_time.store(0, std::memory_order_relaxed);
+			_write_time.store(0, std::memory_order_relaxed);
+		}
+	};
+	using thread_type_stats_p = std::shared_ptr<thread_type_stats_t>;
+
+	// collects type_stats_t for all types, thread safe
+	// objects record into counters of their own thread and type, those are merged when stats are asked for
+	class profiler_t {
+	public:
+		using string_t = traits::string_t;
+		using stats_t = std::map<string_t, type_stats_t>;
+	private:
+		std::vector<thread_type_stats_p> _thread_stats; // kept here too, so they outlive their threads
+		mutable std::mutex _mutex; // only taken when a thread meets a type for the first time and when merging
+
+		thread_type_stats_p add_thread_stats(string_t const& class_name_) {
+			auto stats = std::make_shared<thread_type_stats_t>(class_name_);
+			std::lock_guard<std::mutex> lock(_mutex);
+			_thread_stats.push_back(stats);
+			return stats;
+		}
+
+		static std::vector<string_t> const& headings() {
+			static std::vector<string_t> _headings{ "class", "read", "written", "bytes read", "bytes written",
+				"read time", "write time", "read allocations", "write allocations" };
+			return _headings;
+		}
+		static inline string_t format_duration(type_stats_t::duration_t const& duration_) {
+			std::basic_stringstream<traits::char_t> out;
+			timing::duration_formatter_<string_t>(duration_).to_stream(out);
+			return out.str();
+		}
+	public:
+		// counters for the current thread, profiled objects look at how much they grew
+		static inline size_t& bytes_counter() {
+			static thread_local size_t _bytes = 0;
+			return _bytes;
+		}
+		static inline size_t& allocations_counter() {
+			static thread_local size_t _allocations = 0;
+			return _allocations;
+		}
+		static inline void count_bytes(size_t bytes_) { bytes_counter() += bytes_; }
+		static inline void count_allocation() { ++allocations_counter(); }
+
+		static profiler_t& instance() {
+			static profiler_t _instance;
+			return _instance;
+		}
+
+		// counters of the current thread for target_t
+		template<typename target_t>
+		static inline thread_type_stats_t& thread_stats(string_t const& class_name_) {
+			static thread_local thread_type_stats_p _stats = instance().add_thread_stats(class_name_);
+			return *_stats;
+		}
+
+		void reset() {
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (auto const& s : _thread_stats)
+				s->reset();
+		}
+		stats_t stats() const {
+			stats_t out;
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (auto const& s : _thread_stats)
+				s->add_to(out[s->_class_name]);
+			return out;
+		}
+
+		std::vector<std::vector<string_t>> to_table() const {
+			using namespace string_util;
+			std::vector<std::vector<string_t>> out;
+			out.push_back(headings());
+			for (auto const& e : stats()) {
+				auto const& s = e.second;
+				out.push_back({
+					e.first,
+					to_string_t<string_t>::convert(s._read),
+					to_string_t<string_t>::convert(s._written),
+					to_string_t<string_t>::convert(s._bytes_read),
+					to_string_t<string_t>::convert(s._bytes_written),
+					format_duration(s._read_time),
+					format_duration(s._write_time),
+					to_string_t<string_t>::convert(s._read_allocations),
+					to_string_t<string_t>::convert(s._write_allocations) });
+			}
+			return out;
+		}
+		string_t pretty() const {
+			using namespace autotelica::std_pretty_printing;
+			return table_s(to_table(), true);
+		}
+		// one object per class, times in nanoseconds
+		string_t to_json(bool pretty_ = false) const {
+			using namespace rapidjson;
+			StringBuffer sb;
+			auto dump = [this](auto& writer_) {
+				writer_.StartArray();
+				for (auto const& e : stats()) {
+					auto const& s = e.second;
+					writer_.StartObject();
+					writer_.Key("class"); writer_.String(e.first.c_str(), e.first.size());
+					writer_.Key("read"); writer_.Uint64(s._read);
+					writer_.Key("written"); writer_.Uint64(s._written);
+					writer_.Key("bytes_read"); writer_.Uint64(s._bytes_read);
+					writer_.Key("bytes_written"); writer_.Uint64(s._bytes_written);
+					writer_.Key("read_ns"); writer_.Int64(s._read_time.count());
+					writer_.Key("write_ns"); writer_.Int64(s._write_time.count());
+					writer_.Key("read_allocations"); writer_.Uint64(s._read_allocations);
+					writer_.Key("write_allocations"); writer_.Uint64(s._write_allocations);
+					writer_.EndObject();
+				}
+				writer_.EndArray();
+			};
+			if (pretty_) {
+				PrettyWriter<StringBuffer> writer(sb);
+				dump(writer);
+			}
+			else {
+				Writer<StringBuffer> writer(sb);
+				dump(writer);
+			}
+			return sb.GetString();
+		}
+	};
+
+	// measures reading or writing of a single object
+	template<typename target_t>
+	class object_probe_t {
+		timing::timer _timer;
+		size_t _bytes;
+		size_t _allocations;
+	public:
+		object_probe_t() : _bytes(0), _allocations(0) {}
+		inline void start() {
+			_bytes = profiler_t::bytes_counter();
+			_allocations = profiler_t::allocations_counter();
+			_timer.start();
+		}
+		inline void stop_read(traits::string_t const& class_name_) {
+			_timer.stop();
+			profiler_t::thread_stats<target_t>(class_name_).record_read(
+				profiler_t::bytes_counter() - _bytes, _timer.period(),
+				profiler_t::allocations_counter() - _allocations);
+		}
+		inline void stop_write(traits::string_t const& class_name_) {
+			_timer.stop();
+			profiler_t::thread_stats<target_t>(class_name_).record_write(
+				profiler_t::bytes_counter() - _bytes, _timer.period(),
+				profiler_t::allocations_counter() - _allocations);
+		}
+	};
+}
+
+using profiler_t = profiling::profiler_t;
+
+// replaces global new and delete to count allocations for the profiler, use in one cpp file only
+#define AF_IMPLEMENTS_JSON_ALLOCATION_COUNTING \
+	void* operator new(std::size_t size_) {\
+		autotelica::json::profiling::profiler_t::count_allocation();\
+		if (void* p = std::malloc(size_ ? size_ : 1)) return p;\
+		throw std::bad_alloc();\
+	}\
+	void operator delete(void* p_) noexcept { std::free(p_); }\
+	void operator delete(void* p_, std::size_t) noexcept { std::free(p_); }
+#endif
+
 namespace impl {
 	// rapidjson has this weird thing about writers - there's no hierarchy
 	// but we want to make things really easy to use, so we are going to pay 
@@ -87,6 +548,21 @@ namespace impl {
 
 		writer_wrapper_impl_t(writer_t& writer_) :_writer(writer_) {}
 
+#if _AF_JSON_PROFILING
+		// count payload bytes as they go out
+		using profiler_t = profiling::profiler_t;
+		bool Null() override { return _writer.Null(); }
+		bool Bool(bool b) override { profiler_t::count_bytes(sizeof(b)); return _writer.Bool(b); }
+		bool Int(int i) override { profiler_t::count_bytes(sizeof(i)); return _writer.Int(i); }
+		bool Uint(unsigned i) override { profiler_t::count_bytes(sizeof(i)); return _writer.Uint(i); }
+		bool Int64(int64_t i) override { profiler_t::count_bytes(sizeof(i)); return _writer.Int64(i); }
+		bool Uint64(uint64_t i)  override { profiler_t::count_bytes(sizeof(i)); return _writer.Uint64(i); }
+		bool Double(double d) override { profiler_t::count_bytes(sizeof(d)); return _writer.Double(d); }
+		bool RawNumber(const char_t* str, size_t length, bool copy) override { profiler_t::count_bytes(length); return _writer.RawNumber(str, length, copy); }
+		bool String(const char_t* str, size_t length, bool copy) override { profiler_t::count_bytes(length); return _writer.String(str, length, copy); }
+		bool StartObject() override { return _writer.StartObject(); }
+		bool Key(const char_t* str, size_t length, bool copy) override { profiler_t::count_bytes(length); return _writer.Key(str, length, copy); }
+#else
 		bool Null() override { return _writer.Null(); }
 		bool Bool(bool b) override { return _writer.Bool(b); }
 		bool Int(int i) override { return _writer.Int(i); }
@@ -98,6 +574,7 @@ namespace impl {
 		bool String(const char_t* str, size_t length, bool copy) override { return _writer.String(str, length, copy); }
 		bool StartObject() override { return _writer.StartObject(); }
 		bool Key(const char_t* str, size_t length, bool copy) override { return _writer.Key(str, length, copy); }
+#endif
 		bool EndObject(size_t memberCount) override { return _writer.EndObject(memberCount); }
 		bool StartArray() override { return _writer.StartArray(); }
 		bool EndArray(size_t elementCount) override { return _writer.EndArray(elementCount); }
@@ -162,9 +639,45 @@ namespace impl {
 		virtual bool will_write() const = 0; 
 
 		virtual void write(writer_wrapper_t& writer_) const = 0;
+
+		// address of the value this handler loads into, used to find member handlers by member pointer
+		virtual void const* target_address() const { return nullptr; }
+
+		// JSON schema of what this handler reads and writes, the empty schema (anything goes) by default
+		virtual void write_schema(writer_wrapper_t& writer_) const {
+			writer_.StartObject();
+			writer_.EndObject(0);
+		}
+		// values with defaults are not required in schemas
+		virtual bool has_default() const { return false; }
 	};
 	using handler_p = std::shared_ptr<handler_t>;
 
+	namespace schema_writing {
+		inline void key(writer_wrapper_t& writer_, const traits::char_t* key_) {
+			writer_.Key(key_, strlen(key_), false);
+		}
+		inline void string(writer_wrapper_t& writer_, const traits::char_t* value_) {
+			writer_.String(value_, strlen(value_), false);
+		}
+		// {"type": type_}
+		inline void simple_type(writer_wrapper_t& writer_, const traits::char_t* type_) {
+			writer_.StartObject();
+			key(writer_, "type");
+			string(writer_, type_);
+			writer_.EndObject(1);
+		}
+		// {"type": "array", "items": <element schema>}
+		inline void array_of(writer_wrapper_t& writer_, handler_t const& element_handler_) {
+			writer_.StartObject();
+			key(writer_, "type");
+			string(writer_, "array");
+			key(writer_, "items");
+			element_handler_.write_schema(writer_);
+			writer_.EndObject(2);
+		}
+	}
+
 	// typed base for handlers
 	template<typename target_t>
 	struct handler_value_t : public handler_t {
@@ -213,6 +726,8 @@ namespace impl {
 		}
 
 		inline bool is_set() const { return _target != nullptr; }
+		void const* target_address() const override { return _target; }
+		bool has_default() const override { return _default != nullptr; }
 
 		inline target_t const& get() const { return *_target; }
 		inline target_t& get() { return *_target; }
@@ -258,6 +773,58 @@ namespace impl {
 	// handlers create other handlers, so we need a forward declaration
 	struct serialization_factory;
 
+#if _AF_HAS_PMR
+	// memory resource that std::pmr strings and containers are read into (see reader<> overloads taking one)
+	// handlers are made (and cached) independently of documents, so they find it through a scope 
+	// set up by the reader, the same way they find shared objects
+	// the scope is per thread, reads on other threads keep using whatever their values were made with
+	class memory_resource_t {
+		static inline std::pmr::memory_resource*& current_p() {
+			static thread_local std::pmr::memory_resource* _current = nullptr;
+			return _current;
+		}
+	public:
+		static inline std::pmr::memory_resource* current() { return current_p(); }
+
+		class scope_t {
+			std::pmr::memory_resource* _previous;
+		public:
+			scope_t(std::pmr::memory_resource* resource_) : _previous(current_p()) { current_p() = resource_; }
+			~scope_t() { current_p() = _previous; }
+			scope_t(scope_t const&) = delete;
+			scope_t& operator=(scope_t const&) = delete;
+		};
+	};
+
+	// pmr allocators don't propagate on assignment, so a value that lives elsewhere is rebuilt
+	// in place with an allocator for the current resource before it's read into
+	template<typename target_t, if_pmr_t<target_t> = true>
+	inline void adopt_memory_resource(target_t* target_) {
+		auto resource = memory_resource_t::current();
+		if (!resource || target_->get_allocator().resource() == resource)
+			return;
+		target_->~target_t();
+		new (target_) target_t(typename target_t::allocator_type(resource));
+	}
+	template<typename target_t, if_t<not_t<is_pmr_t<target_t>>> = true>
+	inline void adopt_memory_resource(target_t* /*target_*/) {}
+
+	// handlers that load elements into a value of their own hand that value back to the default resource
+	// once the element is copied out, the handler outlives the document and its resource
+	template<typename target_t>
+	inline void release_memory_resource(target_t* target_) {
+		if (!memory_resource_t::current())
+			return;
+		target_->~target_t();
+		new (target_) target_t();
+	}
+#else
+	template<typename target_t>
+	inline void adopt_memory_resource(target_t* /*target_*/) {}
+	template<typename target_t>
+	inline void release_memory_resource(target_t* /*target_*/) {}
+#endif
+
 
 	// handler for integral types
 	template<typename target_t>
@@ -284,6 +851,9 @@ namespace impl {
 			if (base_t::should_not_write()) return;
 			writing::write(*base_t::_target, writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, std::is_same<target_t, bool>::value ? "boolean" : "integer");
+		}
 
 	};
 
@@ -314,6 +884,9 @@ namespace impl {
 			if (base_t::should_not_write()) return;
 			writing::write(base_t::_target->to_ulong(), writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, "integer");
+		}
 
 	};
 
@@ -342,6 +915,9 @@ namespace impl {
 			if (base_t::should_not_write()) return;
 			writing::write(*base_t::_target, writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, "number");
+		}
 	};
 
 	// handler for strings
@@ -362,6 +938,7 @@ namespace impl {
 
 		// reader part
 		bool String(const char_t* str, size_t length, bool copy) override {
+			adopt_memory_resource(base_t::_target);
 			util::assign(base_t::_target, str, length);
 			return base_t::set_done();
 		}
@@ -370,6 +947,40 @@ namespace impl {
 			if (base_t::should_not_write()) return;
 			writing::write(*base_t::_target, writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, "string");
+		}
+	};
+
+	// handler for interned strings
+	template<typename target_t>
+	struct handler_interned_string_t : public handler_value_t<target_t> {
+
+		using base_t = handler_value_t<target_t>;
+		using default_p = typename base_t::default_p;
+		using default_contained_p = typename base_t::default_contained_p;
+		using char_t = traits::char_t;
+
+		handler_interned_string_t(
+				target_t* target_,
+				default_p default_,
+				default_contained_p /*unused*/) :
+			base_t(target_, default_) {
+		}
+
+		// reader part, no allocation unless we see the string for the first time
+		bool String(const char_t* str, size_t length, bool copy) override {
+			*base_t::_target = interned_string_t(str, length);
+			return base_t::set_done();
+		}
+
+		void write(writer_wrapper_t& writer_) const override {
+			if (base_t::should_not_write()) return;
+			writer_.String(base_t::_target->c_str(), base_t::_target->size(), false);
+		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, "string");
+		}
 	};
 
 	// handler for enumerations
@@ -402,6 +1013,9 @@ namespace impl {
 			to_string(out, *base_t::_target);
 			writing::write(out, writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::simple_type(writer_, "string");
+		}
 	};
 
 	// many handlers delegate to other handlers
@@ -443,9 +1057,12 @@ namespace impl {
 		using default_contained_p = typename base_t::default_contained_p;
 		using contained_t = traits::default_contained_t<target_t>;
 		using char_t = traits::char_t;
-		using value_handler_t = handler_value_p<contained_t>;
+		using value_handler_t = handler_value_t<contained_t>;
+		using value_handler_p = handler_value_p<contained_t>;
 
-		value_handler_t _value_handler;
+		default_contained_p _contained_default;
+		polymorphic_maker_t const _polymorphic_maker;
+		mutable value_handler_p _value_handler;
 
 		handler_ptr_t(
 				target_t* target_,
@@ -453,19 +1070,52 @@ namespace impl {
 				default_contained_p contained_default_,
 				polymorphic_maker_t const& polymorphic_maker_) :
 			base_t(target_, default_),
+			_contained_default(contained_default_),
+			_polymorphic_maker(polymorphic_maker_),
 			_value_handler(
-				std::static_pointer_cast<value_handler_t>(
-					serialization_factory::make_handler(
-						value_ptr(), contained_default_, nullptr, polymorphic_maker_))){
+				(value_ptr() || !std::is_abstract<contained_t>::value) ? make_value_handler(value_ptr()) : nullptr){
 		}
 
-		inline contained_t* value_ptr() {
+		inline contained_t* value_ptr() const {
+			if (!base_t::_target || !*base_t::_target)
+				return nullptr;
 			return &(*(*base_t::_target));// for shared_ptr this is _target->get(), but this should work for naked pointers too
 		}
 
+		// a pointee knows its own type (through its type description factory, if it is polymorphic),
+		// the polymorphic maker is only needed to make pointees of abstract types (see handler_shared_ptr_t)
+		// there is no handler for a missing pointee of an abstract type until one is made
+		inline value_handler_p make_value_handler(contained_t* value_) const {
+			return std::static_pointer_cast<value_handler_t>(
+				serialization_factory::make_handler(
+					value_, _contained_default, nullptr, null_polymorphic_maker()));
+		}
+
+		// the value handler (and whatever it made for members of the pointee) is bound to the pointee,
+		// which changes when the pointer is reassigned or when a cached handler tree is reused for another object
+		inline void bind_value_handler() const {
+			contained_t* value = value_ptr();
+			if (_value_handler && _value_handler->target_address() == value)
+				return;
+			if (!value) {
+				if (_value_handler)
+					_value_handler->reset(nullptr);
+				return;
+			}
+			_value_handler = make_value_handler(value);
+		}
+
+		void prepare_for_loading() override {
+			base_t::prepare_for_loading();
+			bind_value_handler();
+			if (_value_handler)
+				_value_handler->prepare_for_loading();
+		}
+
 		template<typename... ParamsT>
 		bool delegate_f(bool (value_handler_t::* mf)(ParamsT ...), ParamsT... ps) {
 			base_t::set_started_loading();
+			AF_ASSERT(_value_handler, "Pointer to an abstract type has to point to an object before loading.");
 			bool ret = (_value_handler->*mf)(ps...);
 			base_t::set_done(_value_handler->is_done());
 			return ret;
@@ -492,9 +1142,19 @@ namespace impl {
 
 		void write(writer_wrapper_t& writer_) const override {
 			if (base_t::should_not_write()) return;
-			_value_handler->reset(base_t::_target);
+			if (!value_ptr()) {
+				writer_.Null();
+				return;
+			}
+			bind_value_handler();
 			_value_handler->write(writer_);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			if (_value_handler)
+				_value_handler->write_schema(writer_);
+			else
+				base_t::write_schema(writer_);
+		}
 	};
 
 	// used as a base for maps, sets, vectors, lists
@@ -558,6 +1218,7 @@ namespace impl {
 		bool StartObject() override {
 			if (_as_object && !base_t::has_started_loading()) {
 				base_t::set_started_loading();
+				adopt_memory_resource(base_t::_target);
 				base_t::_target->clear();
 				return true;
 			}
@@ -573,6 +1234,7 @@ namespace impl {
 		bool StartArray() override {
 			if (!_as_object && !base_t::has_started_loading()) {
 				base_t::set_started_loading();
+				adopt_memory_resource(base_t::_target);
 				base_t::_target->clear();
 				return true;
 			}
@@ -600,6 +1262,19 @@ namespace impl {
 				writer_.EndArray(base_t::_target->size());
 			_value_handler->reset(nullptr);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			if (!_as_object) {
+				schema_writing::array_of(writer_, *_value_handler);
+				return;
+			}
+			// string maps are objects, the keys are the map keys
+			writer_.StartObject();
+			schema_writing::key(writer_, "type");
+			schema_writing::string(writer_, "object");
+			schema_writing::key(writer_, "additionalProperties");
+			_value_handler->write_schema(writer_);
+			writer_.EndObject(2);
+		}
 	};
 
 	// handler for sequences (lists and vectors)
@@ -631,88 +1306,192 @@ namespace impl {
 		}
 	};
 
-	// handler for sets
+	// handler for streamed arrays, see array_stream_t
 	template<typename target_t, typename polymorphic_maker_t>
-	struct handler_setish_t : public handler_container_base_t<target_t, polymorphic_maker_t> {
-
-		using base_t = handler_container_base_t<target_t, polymorphic_maker_t>;
-		using default_p = typename base_t::default_p;
-		using default_contained_p = typename base_t::default_contained_p;
-		using contained_t = typename target_t::value_type;
-
-		contained_t _current_value;
-
-		handler_setish_t(
-				target_t* target_,
-				default_p default_,
-				default_contained_p /*unused*/,
-				polymorphic_maker_t const& polymorphic_maker_) :
-			base_t(target_, default_, nullptr, polymorphic_maker_) {// sets canot contain default values
-		}
-
-		void set_next() override{
-			_current_value = contained_t();
-			base_t::_value_handler->reset(&_current_value);
-		}
-		void finish_loading_element() override {
-			base_t::_target->insert(_current_value);
-			base_t::_value_handler->reset(nullptr);
-		}
-	};
-
-
-	// pairs can be stored more efficiently if the first type is a string
-	// we will add a special handler for this
+	struct handler_array_stream_t : public handler_delegating_t<target_t> {
 
-	template<typename target_t, typename polymorphic_maker_t>
-	struct handler_string_pair_t : public handler_delegating_t<target_t> {
 		using base_t = handler_delegating_t<target_t>;
 		using default_p = typename base_t::default_p;
 		using default_contained_p = typename base_t::default_contained_p;
-		using contained_t = traits::default_contained_t<target_t>;
 		using char_t = traits::char_t;
-		using key_t = traits::key_t;
-		using value_t = typename target_t::second_type;
-		using value_handler_t = handler_value_t<value_t>;
-		using value_handler_p = handler_value_p<value_t>;
-
-		using key_t = traits::key_t;
-		using value_t = typename target_t::second_type;
+		using element_t = typename target_t::element_t;
+		using value_handler_t = handler_value_t<element_t>;
+		using value_handler_p = handler_value_p<element_t>;
 
-		inline key_t* key_p() { return base_t::is_set() ? (&(base_t::_target->first)) : nullptr; }
-		inline key_t const* key_p() const { return base_t::is_set() ? (&(base_t::_target->first)) : nullptr; }
-		inline value_t* value_p() { return base_t::is_set() ? (&(base_t::_target->second)) : nullptr; }
-		inline value_t const* value_p() const { return base_t::is_set() ? (&(base_t::_target->second)) : nullptr; }
-		
+		// every element is loaded into (or written from) this one, so the handler below can be reused
+		mutable element_t _current;
 		value_handler_p _value_handler;
+		bool _loading_element;
 
-		handler_string_pair_t(
+		handler_array_stream_t(
 				target_t* target_,
 				default_p default_,
 				default_contained_p /*unused*/,
 				polymorphic_maker_t const& polymorphic_maker_) :
 			base_t(target_, default_),
+			_current(),
 			_value_handler(
 				std::static_pointer_cast<value_handler_t>(
-					serialization_factory::make_handler(value_p(), nullptr, nullptr, polymorphic_maker_))) {
+					serialization_factory::make_handler(&_current, nullptr, nullptr, polymorphic_maker_))),
+			_loading_element(false) {
 		}
+
 		void prepare_for_loading() override {
 			base_t::prepare_for_loading();
 			_value_handler->prepare_for_loading();
+			_loading_element = false;
 		}
 
-		inline void initialise_loading() {
-			base_t::set_started_loading();
+		inline void finish_loading_element() {
+			auto const& sink = base_t::_target->sink();
+			if (sink)
+				sink(_current);
+			_current = element_t();
+			release_memory_resource(&_current);
+			_value_handler->prepare_for_loading();
+			_loading_element = false;
 		}
+
 		template<typename... ParamsT>
-		bool delegate_f(bool (value_handler_t::* mf)(ParamsT ...), ParamsT... ps) {
-			AF_ASSERT(base_t::has_started_loading(), "Reading value before the key in a string pair.");
-			bool ret = (_value_handler.get()->*mf)(ps...);
-			base_t::set_done(_value_handler->is_done());
+		inline bool delegate_f(bool (value_handler_t::* mf)(ParamsT ...), ParamsT... ps) {
+			AF_ASSERT(base_t::has_started_loading(), "Array expected when loading an array stream.");
+			_loading_element = true;
+			bool ret = ((*_value_handler).*mf)(ps...);
+			if (_value_handler->is_done())
+				finish_loading_element();
 			return ret;
 		}
-
-		bool Null()  override {
+		bool Null() override {
+			if (!base_t::has_started_loading())
+				return base_t::Null();
+			return delegate_f(&value_handler_t::Null);
+		}
+		bool Bool(bool b) override { return delegate_f(&value_handler_t::Bool, b); }
+		bool Int(int i) override { return delegate_f(&value_handler_t::Int, i); }
+		bool Uint(unsigned i) override { return delegate_f(&value_handler_t::Uint, i); }
+		bool Int64(int64_t i) override { return delegate_f(&value_handler_t::Int64, i); }
+		bool Uint64(uint64_t i) override { return delegate_f(&value_handler_t::Uint64, i); }
+		bool Double(double d) override { return delegate_f(&value_handler_t::Double, d); }
+		bool RawNumber(const char_t* str, size_t length, bool copy) override { return delegate_f(&value_handler_t::RawNumber, str, length, copy); }
+		bool String(const char_t* str, size_t length, bool copy) override { return delegate_f(&value_handler_t::String, str, length, copy); }
+		bool StartObject() override { return delegate_f(&value_handler_t::StartObject); }
+		bool Key(const char_t* str, size_t length, bool copy) override { return delegate_f(&value_handler_t::Key, str, length, copy); }
+		bool EndObject(size_t memberCount) override { return delegate_f(&value_handler_t::EndObject, memberCount); }
+		bool StartArray() override {
+			if (!base_t::has_started_loading()) {
+				base_t::set_started_loading();
+				return true;
+			}
+			return delegate_f(&value_handler_t::StartArray);
+		}
+		bool EndArray(size_t elementCount) override {
+			if (!_loading_element)
+				return base_t::set_done();
+			return delegate_f(&value_handler_t::EndArray, elementCount);
+		}
+
+		void write(writer_wrapper_t& writer_) const override {
+			if (base_t::should_not_write()) return;
+			writer_.StartArray();
+			size_t count = 0;
+			auto const& source = base_t::_target->source();
+			if (source) {
+				while (source(_current)) {
+					_value_handler->write(writer_);
+					++count;
+				}
+			}
+			writer_.EndArray(count);
+		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			schema_writing::array_of(writer_, *_value_handler);
+		}
+	};
+
+	// handler for sets
+	template<typename target_t, typename polymorphic_maker_t>
+	struct handler_setish_t : public handler_container_base_t<target_t, polymorphic_maker_t> {
+
+		using base_t = handler_container_base_t<target_t, polymorphic_maker_t>;
+		using default_p = typename base_t::default_p;
+		using default_contained_p = typename base_t::default_contained_p;
+		using contained_t = typename target_t::value_type;
+
+		contained_t _current_value;
+
+		handler_setish_t(
+				target_t* target_,
+				default_p default_,
+				default_contained_p /*unused*/,
+				polymorphic_maker_t const& polymorphic_maker_) :
+			base_t(target_, default_, nullptr, polymorphic_maker_) {// sets canot contain default values
+		}
+
+		void set_next() override{
+			_current_value = contained_t();
+			base_t::_value_handler->reset(&_current_value);
+		}
+		void finish_loading_element() override {
+			base_t::_target->insert(_current_value);
+			base_t::_value_handler->reset(nullptr);
+			release_memory_resource(&_current_value);
+		}
+	};
+
+
+	// pairs can be stored more efficiently if the first type is a string
+	// we will add a special handler for this
+
+	template<typename target_t, typename polymorphic_maker_t>
+	struct handler_string_pair_t : public handler_delegating_t<target_t> {
+		using base_t = handler_delegating_t<target_t>;
+		using default_p = typename base_t::default_p;
+		using default_contained_p = typename base_t::default_contained_p;
+		using contained_t = traits::default_contained_t<target_t>;
+		using char_t = traits::char_t;
+		using key_t = traits::key_t;
+		using value_t = typename target_t::second_type;
+		using value_handler_t = handler_value_t<value_t>;
+		using value_handler_p = handler_value_p<value_t>;
+
+		using key_t = traits::key_t;
+		using value_t = typename target_t::second_type;
+
+		inline key_t* key_p() { return base_t::is_set() ? (&(base_t::_target->first)) : nullptr; }
+		inline key_t const* key_p() const { return base_t::is_set() ? (&(base_t::_target->first)) : nullptr; }
+		inline value_t* value_p() { return base_t::is_set() ? (&(base_t::_target->second)) : nullptr; }
+		inline value_t const* value_p() const { return base_t::is_set() ? (&(base_t::_target->second)) : nullptr; }
+		
+		value_handler_p _value_handler;
+
+		handler_string_pair_t(
+				target_t* target_,
+				default_p default_,
+				default_contained_p /*unused*/,
+				polymorphic_maker_t const& polymorphic_maker_) :
+			base_t(target_, default_),
+			_value_handler(
+				std::static_pointer_cast<value_handler_t>(
+					serialization_factory::make_handler(value_p(), nullptr, nullptr, polymorphic_maker_))) {
+		}
+		void prepare_for_loading() override {
+			base_t::prepare_for_loading();
+			_value_handler->reset(value_p());
+			_value_handler->prepare_for_loading();
+		}
+
+		inline void initialise_loading() {
+			base_t::set_started_loading();
+		}
+		template<typename... ParamsT>
+		bool delegate_f(bool (value_handler_t::* mf)(ParamsT ...), ParamsT... ps) {
+			AF_ASSERT(base_t::has_started_loading(), "Reading value before the key in a string pair.");
+			bool ret = (_value_handler.get()->*mf)(ps...);
+			base_t::set_done(_value_handler->is_done());
+			return ret;
+		}
+
+		bool Null()  override {
 			if (base_t::has_started_loading()) // if we are already reading the contained value, delegate
 				return _value_handler->Null();
 			return base_t::Null();
@@ -755,6 +1534,10 @@ namespace impl {
 			else
 				_value_handler->write(writer_);
 		}
+		// the key is the property name in the enclosing object, only the value has a schema
+		void write_schema(writer_wrapper_t& writer_) const override {
+			_value_handler->write_schema(writer_);
+		}
 
 	};
 
@@ -770,6 +1553,325 @@ namespace impl {
 		static const size_t tag_class_name_sz = 10;
 		static traits::tag_t tag_class_id = _AF_CHAR_CONSTANT("class_id");
 		static const size_t tag_class_id_sz = 8;
+		static traits::tag_t tag_shared_id = _AF_CHAR_CONSTANT("$id");
+		static const size_t tag_shared_id_sz = 3;
+		static traits::tag_t tag_shared_ref = _AF_CHAR_CONSTANT("$ref");
+		static const size_t tag_shared_ref_sz = 4;
+		static traits::tag_t tag_shared_value = _AF_CHAR_CONSTANT("$value");
+		static const size_t tag_shared_value_sz = 6;
+	};
+
+	// keeps track of shared objects while a single document is read or written
+	// handlers are created deep down the type hierarchy, so the table for the current
+	// document is reachable through a (thread local) scope set up by reader and writer
+	// objects are told apart by type as well as by address: a base at a non-zero offset
+	// can't be cast back from std::shared_ptr<void>, so each type gets its own ids
+	class shared_objects_t {
+		using written_key_t = std::pair<void const*, std::type_index>;
+		struct written_hash_t {
+			size_t operator()(written_key_t const& key_) const {
+				return std::hash<void const*>()(key_.first) ^ key_.second.hash_code();
+			}
+		};
+		struct read_t {
+			std::shared_ptr<void> _object;
+			std::type_index _type;
+		};
+		std::unordered_map<written_key_t, size_t, written_hash_t> _written;
+		std::unordered_map<size_t, read_t> _read;
+
+		static inline shared_objects_t*& current_p() {
+			static thread_local shared_objects_t* _current = nullptr;
+			return _current;
+		}
+	public:
+		// returns true if the object was written before, id_ is set either way
+		inline bool register_written(void const* object_, std::type_index type_, size_t& id_) {
+			auto it = _written.find(written_key_t(object_, type_));
+			if (it != _written.end()) {
+				id_ = it->second;
+				return true;
+			}
+			id_ = _written.size();
+			_written.emplace(written_key_t(object_, type_), id_);
+			return false;
+		}
+		inline void register_read(size_t id_, std::shared_ptr<void> const& object_, std::type_index type_) {
+			auto it = _read.find(id_);
+			if (it == _read.end())
+				_read.emplace(id_, read_t{ object_, type_ });
+			else
+				it->second = read_t{ object_, type_ };
+		}
+		inline std::shared_ptr<void> find_read(size_t id_, std::type_index type_) const {
+			auto it = _read.find(id_);
+			if (it == _read.end())
+				return nullptr;
+			AF_ASSERT(it->second._type == type_, "Shared object % is referenced as a different type.", id_);
+			return it->second._object;
+		}
+
+		static inline shared_objects_t& current() {
+			AF_ASSERT(current_p(), "Shared objects are used outside of a reader or writer scope.");
+			return *current_p();
+		}
+
+		// scope for one document, restores whatever was there before on exit
+		class scope_t {
+			shared_objects_t _objects;
+			shared_objects_t* _previous;
+		public:
+			scope_t() : _previous(current_p()) { current_p() = &_objects; }
+			~scope_t() { current_p() = _previous; }
+			scope_t(scope_t const&) = delete;
+			scope_t& operator=(scope_t const&) = delete;
+		};
+	};
+
+	// handler for shared pointers that preserves sharing (see _AF_JSON_SHARED_OBJECT_IDS)
+	template<typename target_t, typename polymorphic_maker_t>
+	struct handler_shared_ptr_t : public handler_ptr_t<target_t, polymorphic_maker_t> {
+
+		using base_t = handler_ptr_t<target_t, polymorphic_maker_t>;
+		using default_p = typename base_t::default_p;
+		using default_contained_p = typename base_t::default_contained_p;
+		using contained_t = typename base_t::contained_t;
+		using value_handler_t = typename base_t::value_handler_t;
+		using char_t = traits::char_t;
+		using string_t = traits::string_t;
+
+		// where we are in {"$id": n, "$value": ...} or {"$ref": n}
+		enum class reading_state {
+			none,			// nothing read yet
+			opened,			// object started, but we don't know yet if it is a wrapper
+			id,				// expecting the id
+			ref,			// expecting the reference
+			wrapped_value,	// delegating the wrapped value
+			plain,			// delegating a plain value (written without ids)
+			closing,		// expecting the end of the wrapper
+			typing,			// expecting the start of a wrapped object of an abstract type
+			class_key,		// expecting the class tag key of a wrapped object of an abstract type
+			class_tag		// expecting the class id or class name of an object of an abstract type
+		};
+		reading_state _state;
+		reading_state _typed_state; // plain or wrapped_value, what to continue with once the object is made
+		bool _class_tag_is_id;
+		size_t _id;
+
+		handler_shared_ptr_t(
+				target_t* target_,
+				default_p default_,
+				default_contained_p contained_default_,
+				polymorphic_maker_t const& polymorphic_maker_) :
+			base_t(target_, default_, contained_default_, polymorphic_maker_),
+			_state(reading_state::none),
+			_typed_state(reading_state::plain),
+			_class_tag_is_id(false),
+			_id(0) {
+		}
+
+		void prepare_for_loading() override {
+			base_t::prepare_for_loading();
+			_state = reading_state::none;
+			_typed_state = reading_state::plain;
+			_class_tag_is_id = false;
+			_id = 0;
+		}
+
+		inline void allocate(std::true_type) {
+			if (!*base_t::_target)
+				*base_t::_target = std::make_shared<contained_t>();
+		}
+		inline void allocate(std::false_type) {
+			AF_ASSERT(*base_t::_target, "Shared object of abstract type has to be allocated before loading, or start with its class tag.");
+		}
+
+		// objects of abstract types are made by the polymorphic maker from their class tag
+		// (written first, see handler_object_t::write), the same way handler_dynamic_object_t makes them
+		inline bool needs_class_tag() const {
+			return !std::is_default_constructible<contained_t>::value && !*base_t::_target;
+		}
+		inline bool expect_class_tag(const char_t* str, size_t length, reading_state typed_state_) {
+			_class_tag_is_id = util::equal_tag(str, length, standard_tags::tag_class_id);
+			AF_ASSERT(_class_tag_is_id || util::equal_tag(str, length, standard_tags::tag_class_name),
+				"Object of an abstract type has to start with its class id or class name (found key %).", string_t(str, length));
+			_typed_state = typed_state_;
+			_state = reading_state::class_tag;
+			return true;
+		}
+		template<typename class_tag_t>
+		inline void make_typed(class_tag_t const&, std::true_type) {
+			AF_ERROR("Shared object of abstract type can't be made without a polymorphic maker.");
+		}
+		inline void make_typed(size_t class_id_, std::false_type) {
+			contained_t* made = nullptr;
+			base_t::_polymorphic_maker.make_from_class_id(class_id_, &made);
+			adopt_typed(made);
+		}
+		inline void make_typed(string_t const& class_name_, std::false_type) {
+			contained_t* made = nullptr;
+			base_t::_polymorphic_maker.make_from_class_name(class_name_, &made);
+			adopt_typed(made);
+		}
+		template<typename class_tag_t>
+		inline void make_typed(class_tag_t const& class_tag_) {
+			make_typed(class_tag_, std::integral_constant<bool, traits::predicates::is_null_polymorphic_maker_t<polymorphic_maker_t>::value>());
+		}
+		inline void adopt_typed(contained_t* made_) {
+			AF_ASSERT(made_, "Polymorphic maker didn't make an object.");
+			if (!made_) return;
+			*base_t::_target = target_t(made_);
+			start_value(_typed_state);
+			// replay the start of the object and the class tag key, the caller forwards the tag
+			forward_f(&value_handler_t::StartObject);
+			if (_class_tag_is_id)
+				forward_f(&value_handler_t::Key, standard_tags::tag_class_id, standard_tags::tag_class_id_sz, false);
+			else
+				forward_f(&value_handler_t::Key, standard_tags::tag_class_name, standard_tags::tag_class_name_sz, false);
+		}
+		inline void register_read() {
+			shared_objects_t::current().register_read(_id, *base_t::_target, std::type_index(typeid(contained_t)));
+		}
+		inline void start_value(reading_state state_) {
+			allocate(std::integral_constant<bool, std::is_default_constructible<contained_t>::value>());
+			// registered before the contents are read, so references to it from inside its own contents resolve
+			if (state_ == reading_state::wrapped_value)
+				register_read();
+			base_t::bind_value_handler();
+			base_t::_value_handler->prepare_for_loading();
+			_state = state_;
+		}
+
+		template<typename... ParamsT>
+		bool forward_f(bool (value_handler_t::* mf)(ParamsT ...), ParamsT... ps) {
+			if (_state == reading_state::none)
+				start_value(reading_state::plain);
+			AF_ASSERT(_state == reading_state::wrapped_value || _state == reading_state::plain,
+				"Unexpected value when loading a shared object.");
+			bool ret = base_t::delegate_f(mf, ps...);
+			if (_state == reading_state::wrapped_value && base_t::is_done()) {
+				register_read(); // again, in case reading replaced the object
+				_state = reading_state::closing;
+				base_t::set_done(false);
+			}
+			return ret;
+		}
+
+		template<typename integral_t>
+		inline bool read_integral(integral_t i, bool (value_handler_t::* mf)(integral_t)) {
+			if (_state == reading_state::id) {
+				_id = static_cast<size_t>(i);
+				_state = reading_state::opened;
+				return true;
+			}
+			if (_state == reading_state::ref) {
+				_id = static_cast<size_t>(i);
+				auto object = shared_objects_t::current().find_read(_id, std::type_index(typeid(contained_t)));
+				AF_ASSERT(object, "Reference to an unknown shared object (id %).", _id);
+				*base_t::_target = std::static_pointer_cast<contained_t>(object);
+				_state = reading_state::closing;
+				return true;
+			}
+			if (_state == reading_state::class_tag)
+				make_typed(static_cast<size_t>(i));
+			return forward_f(mf, i);
+		}
+
+		bool Null() override {
+			if (_state == reading_state::none) {
+				*base_t::_target = nullptr;
+				return base_t::set_done();
+			}
+			return forward_f(&value_handler_t::Null);
+		}
+		bool Bool(bool b) override { return forward_f(&value_handler_t::Bool, b); }
+		bool Int(int i) override { return read_integral(i, &value_handler_t::Int); }
+		bool Uint(unsigned i) override { return read_integral(i, &value_handler_t::Uint); }
+		bool Int64(int64_t i) override { return read_integral(i, &value_handler_t::Int64); }
+		bool Uint64(uint64_t i) override { return read_integral(i, &value_handler_t::Uint64); }
+		bool Double(double d) override { return forward_f(&value_handler_t::Double, d); }
+		bool RawNumber(const char_t* str, size_t length, bool copy) override { return forward_f(&value_handler_t::RawNumber, str, length, copy); }
+		bool String(const char_t* str, size_t length, bool copy) override {
+			if (_state == reading_state::class_tag)
+				make_typed(string_t(str, length));
+			return forward_f(&value_handler_t::String, str, length, copy);
+		}
+		bool StartObject() override {
+			if (_state == reading_state::none) {
+				_state = reading_state::opened;
+				return true;
+			}
+			if (_state == reading_state::typing) {
+				_state = reading_state::class_key;
+				return true;
+			}
+			return forward_f(&value_handler_t::StartObject);
+		}
+		bool Key(const char_t* str, size_t length, bool copy) override {
+			if (_state == reading_state::class_key)
+				return expect_class_tag(str, length, reading_state::wrapped_value);
+			if (_state != reading_state::opened)
+				return forward_f(&value_handler_t::Key, str, length, copy);
+			if (util::equal_tag(str, length, standard_tags::tag_shared_id)) {
+				_state = reading_state::id;
+				return true;
+			}
+			if (util::equal_tag(str, length, standard_tags::tag_shared_ref)) {
+				_state = reading_state::ref;
+				return true;
+			}
+			if (util::equal_tag(str, length, standard_tags::tag_shared_value)) {
+				if (needs_class_tag())
+					_state = reading_state::typing;
+				else
+					start_value(reading_state::wrapped_value);
+				return true;
+			}
+			if (needs_class_tag())
+				return expect_class_tag(str, length, reading_state::plain);
+			// not a wrapper after all, replay the start of the object to the value handler
+			start_value(reading_state::plain);
+			forward_f(&value_handler_t::StartObject);
+			return forward_f(&value_handler_t::Key, str, length, copy);
+		}
+		bool EndObject(size_t memberCount) override {
+			if (_state == reading_state::closing) {
+				_state = reading_state::none;
+				return base_t::set_done();
+			}
+			if (_state == reading_state::opened) {
+				// an empty object, not a wrapper, replay its start to the value handler
+				start_value(reading_state::plain);
+				forward_f(&value_handler_t::StartObject);
+			}
+			return forward_f(&value_handler_t::EndObject, memberCount);
+		}
+		bool StartArray() override { return forward_f(&value_handler_t::StartArray); }
+		bool EndArray(size_t elementCount) override { return forward_f(&value_handler_t::EndArray, elementCount); }
+
+		void write(writer_wrapper_t& writer_) const override {
+			if (base_t::should_not_write()) return;
+			auto const& target = *base_t::_target;
+			if (!target) {
+				writer_.Null();
+				return;
+			}
+			size_t id = 0;
+			bool const written = shared_objects_t::current().register_written(target.get(), std::type_index(typeid(contained_t)), id);
+			writer_.StartObject();
+			if (written) {
+				writer_.Key(standard_tags::tag_shared_ref, standard_tags::tag_shared_ref_sz, false);
+				writer_.Uint64(static_cast<uint64_t>(id));
+				writer_.EndObject(1);
+				return;
+			}
+			writer_.Key(standard_tags::tag_shared_id, standard_tags::tag_shared_id_sz, false);
+			writer_.Uint64(static_cast<uint64_t>(id));
+			writer_.Key(standard_tags::tag_shared_value, standard_tags::tag_shared_value_sz, false);
+			base_t::bind_value_handler();
+			base_t::_value_handler->write(writer_);
+			writer_.EndObject(2);
+		}
 	};
 
 	// handling pairs
@@ -891,6 +1993,19 @@ namespace impl {
 				_value_handler->write(writer_);
 			writer_.EndObject(2);
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			writer_.StartObject();
+			schema_writing::key(writer_, "type");
+			schema_writing::string(writer_, "object");
+			schema_writing::key(writer_, "properties");
+			writer_.StartObject();
+			writer_.Key(standard_tags::tag_key, standard_tags::tag_key_sz, false);
+			_key_handler->write_schema(writer_);
+			writer_.Key(standard_tags::tag_value, standard_tags::tag_value_sz, false);
+			_value_handler->write_schema(writer_);
+			writer_.EndObject(2);
+			writer_.EndObject(2);
+		}
 	};
 
 
@@ -970,6 +2085,9 @@ namespace impl {
 		pre_save_function_t _pre_save_f;
 		post_load_function_t _post_load_f;
 		post_save_function_t _post_save_f;
+#if _AF_JSON_PROFILING
+		mutable profiling::object_probe_t<target_t> _probe;
+#endif
 
 		handler_object_t(
 				target_t* target_,
@@ -1050,6 +2168,9 @@ namespace impl {
 		bool StartObject() override {
 			if (_current_handler)
 				return delegate_f(&handler_t::StartObject);
+#if _AF_JSON_PROFILING
+			_probe.start();
+#endif
 			if (_pre_load_f)
 				_pre_load_f();
 			return true;
@@ -1076,6 +2197,9 @@ namespace impl {
 			validate_all_loaded();
 			if (_post_load_f)
 				_post_load_f();
+#if _AF_JSON_PROFILING
+			_probe.stop_read(_class_name);
+#endif
 			return base_t::set_done();
 		}
 		bool StartArray() override { return delegate_f(&handler_t::StartArray); }
@@ -1085,6 +2209,9 @@ namespace impl {
 			if (_pre_save_f)
 				_pre_save_f();
 			if (base_t::should_not_write()) return;
+#if _AF_JSON_PROFILING
+			_probe.start();
+#endif
 			writer_.StartObject();
 
 #if _AF_JSON_USE_CLASS_TAGS
@@ -1118,8 +2245,59 @@ namespace impl {
 			writer_.EndObject(_handlers.size());
 			if (_post_save_f)
 				_post_save_f();
+#if _AF_JSON_PROFILING
+			_probe.stop_write(_class_name);
+#endif
 
 		}
+		void write_schema(writer_wrapper_t& writer_) const override {
+			using namespace schema_writing;
+			writer_.StartObject();
+			size_t count = 0;
+			if (!_class_name.empty()) {
+				key(writer_, "title");
+				writer_.String(_class_name.c_str(), _class_name.size(), false);
+				++count;
+			}
+			key(writer_, "type");
+			string(writer_, "object");
+			key(writer_, "properties");
+			writer_.StartObject();
+			size_t properties = 0;
+#if _AF_JSON_USE_CLASS_TAGS
+			if (_class_id != -1) {
+				writer_.Key(standard_tags::tag_class_id, standard_tags::tag_class_id_sz, false);
+				simple_type(writer_, "integer");
+				++properties;
+			}
+			if (!_class_name.empty()) {
+				writer_.Key(standard_tags::tag_class_name, standard_tags::tag_class_name_sz, false);
+				simple_type(writer_, "string");
+				++properties;
+			}
+#endif
+			for (auto const& h : _handlers) {
+				writer_.Key(h.first.c_str(), h.first.size(), false);
+				h.second->write_schema(writer_);
+			}
+			writer_.EndObject(properties + _handlers.size());
+			count += 2;
+#if !_AF_SERIALIZATION_TERSE
+			// without defaults, members have to be there
+			key(writer_, "required");
+			writer_.StartArray();
+			size_t required = 0;
+			for (auto const& h : _handlers) {
+				if (!h.second->has_default()) {
+					writer_.String(h.first.c_str(), h.first.size(), false);
+					++required;
+				}
+			}
+			writer_.EndArray(required);
+			++count;
+#endif
+			writer_.EndObject(count);
+		}
 	};
 
 	namespace handler_makers {
@@ -1157,9 +2335,20 @@ namespace impl {
 			_JSON_HANDLER_SIMPLE_TRAIT(handler_bitset_t, is_bitset_t<target_t>);
 			_JSON_HANDLER_SIMPLE_TRAIT(handler_floating_t, is_floating_point_t<target_t>);
 			_JSON_HANDLER_SIMPLE_TRAIT(handler_string_t, is_string_t<target_t>);
+			_JSON_HANDLER_SIMPLE_TRAIT(handler_interned_string_t, is_interned_string_t<target_t>);
 			_JSON_HANDLER_SIMPLE_TRAIT(handler_enum_t, is_enum_t<target_t>);
-			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_ptr_t, is_pointer_t<target_t>);
-			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_sequence_t, is_sequence_t<target_t>);
+#if _AF_JSON_SHARED_OBJECT_IDS
+			// shared pointers get their own handler, naked pointers can't share ownership
+			template<typename target_t>
+			using is_naked_pointer_t = all_of_t<is_pointer_t<target_t>, not_t<is_shared_ptr_t<target_t>>>;
+
+			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_ptr_t, is_naked_pointer_t<target_t>);
+			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_shared_ptr_t, is_shared_ptr_t<target_t>);
+#else
+			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_ptr_t, is_pointer_t<target_t>);
+#endif
+			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_sequence_t, is_sequence_t<target_t>);
+			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_array_stream_t, is_array_stream_t<target_t>);
 			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_setish_t, is_setish_t<target_t>);
 #if _AF_JSON_OPTIMISED_STRING_MAPS
 			_JSON_HANDLER_POLYMORPHIC_TRAIT(handler_pair_t, is_non_string_pair_t<target_t>);
@@ -1494,18 +2683,29 @@ namespace impl {
 		};
 		using json_handler_cache_p = std::shared_ptr<json_handler_cache_t>;
 
+		// the cache lives outside of the objects, one per type and thread, so that objects don't carry one each
+		// handlers are bound to the addresses of the values they load, so the cached handler is only
+		// reused for the object it was made for (same address means same layout, the type is fixed)
+		// and replaced when a different object of the type comes along
+		// an object at a reused address (a stack slot, say) may point to different values than the last one did,
+		// which is why pointer handlers re-bind to their pointees in prepare_for_loading and write
 		template<typename target_t>
 		struct json_handler_cache_impl_t : public json_handler_cache_t {
 			handler_value_p<target_t> _handler_cache;
 
 			json_handler_cache_impl_t() : _handler_cache(nullptr) {}
 
+			static json_handler_cache_impl_t& instance() {
+				static thread_local json_handler_cache_impl_t _instance;
+				return _instance;
+			}
+
 			template<typename polymorphic_maker_t>
 			inline handler_p create(
 				target_t* that_,
 				default_value_p<target_t> default_,
-				polymorphic_maker_t const& polymorphic_maker_) {// this cache is per instance, so it the polymorphic maker, no need to check for consistency there
-				if (!_handler_cache)
+				polymorphic_maker_t const& polymorphic_maker_) {// cached handlers are never polymorphic (see if_handler_from_json_handler_cache_t), no need to check the maker for consistency
+				if (!_handler_cache || _handler_cache->target_address() != that_)
 					_handler_cache = std::dynamic_pointer_cast<handler_value_t<target_t>>(
 						make_cached_json_handler(that_, default_, nullptr, polymorphic_maker_));
 				else
@@ -1524,7 +2724,7 @@ namespace impl {
 			traits::default_contained_p<target_t> 	/*unused*/,
 			polymorphic_maker_t const& polymorphic_maker_
 		) {
-			auto& handler_cache = target_->json_handler_cache();
+			auto& handler_cache = target_t::json_handler_cache();
 			auto& cache_impl = static_cast<json_handler_cache_impl_t<target_t>&>(handler_cache);
 			return cache_impl.create(target_, default_, polymorphic_maker_);
 		}
@@ -1688,6 +2888,172 @@ namespace impl {
 
 // TODO: maybe tuple, variant, ranges ...  serialization 
 
+	// input stream that transcodes UTF-16/UTF-32 input to UTF-8 a block at a time
+	// the parser then reads plain UTF-8, so it never goes through rapidjson's per-character
+	// transcoding and string tokens reach the handlers already converted
+	// the underlying stream is a byte stream, the input ends with a zero code unit (as in rapidjson)
+	// invalid input ends the transcoded text with a control character at the offending code unit,
+	// so the parser fails right there and the reader reports error() instead of the parser's own complaint
+	// Tell() counts code units of the input, so parse error offsets point into the original text
+	template<json_encoding source_v, typename stream_t>
+	class utf8_transcoding_stream {
+	public:
+		typedef char Ch;
+	private:
+		static const bool utf16 = (source_v == json_encoding::utf16le || source_v == json_encoding::utf16be);
+		static const bool big_endian = (source_v == json_encoding::utf16be || source_v == json_encoding::utf32be);
+		static const size_t unit_bytes = utf16 ? 2 : 4;
+		static const size_t block_size = 1024;// code units per block
+
+		stream_t* _stream;
+		char _buffer[(block_size + 1) * 4 + 1];	// UTF-8 takes at most 4 bytes per code unit, +1 for the end marker
+		size_t _position;
+		size_t _size;
+		size_t _consumed;	// code units in the blocks before the current one
+		size_t _block_units;	// code units in the current block
+		// Tell() counts code units up to _position from where it counted last time,
+		// the parser only ever asks for increasing positions, so this is linear overall
+		mutable size_t _tell_position;
+		mutable size_t _tell_units;
+		bool _started;
+		bool _finished;
+		const char* _error;
+		size_t _error_offset;
+
+		inline uint32_t read_unit() {
+			uint32_t unit = 0;
+			for (size_t i = 0; i < unit_bytes; ++i) {
+				uint32_t byte = static_cast<uint8_t>(_stream->Take());
+				unit = big_endian ? ((unit << 8) | byte) : (unit | (byte << (8 * i)));
+			}
+			return unit;
+		}
+		static inline bool high_surrogate(uint32_t unit_) { return unit_ >= 0xD800 && unit_ <= 0xDBFF; }
+		static inline bool low_surrogate(uint32_t unit_) { return unit_ >= 0xDC00 && unit_ <= 0xDFFF; }
+
+		// stops the text at the i_th code unit of the current block, the parser then trips over the marker
+		inline char* fail(char* out_, size_t i_, const char* error_) {
+			_error = error_;
+			_error_offset = _consumed + i_;
+			_finished = true;
+			*out_++ = '\x01';// control characters are not valid JSON anywhere, in strings or out of them
+			return out_;
+		}
+
+		// reads a block of code units and converts them in one go
+		void refill() {
+			_consumed += _block_units;
+			_block_units = 0;
+			_position = _size = 0;
+			_tell_position = _tell_units = 0;
+			_buffer[0] = '\0';
+			if (_finished)
+				return;
+			uint32_t units[block_size + 1];
+			size_t n = 0;
+			while (n < block_size) {
+				uint32_t unit = read_unit();
+				if (!unit) {
+					_finished = true;
+					break;
+				}
+				units[n++] = unit;
+			}
+			// don't split a surrogate pair between blocks
+			if (utf16 && !_finished && high_surrogate(units[n - 1])) {
+				uint32_t unit = read_unit();
+				if (unit)
+					units[n++] = unit;
+				else
+					_finished = true;
+			}
+			_block_units = n;
+			size_t i = 0;
+			if (!_started) {
+				_started = true;
+				if (n && units[0] == 0xFEFF)
+					i = _tell_units = 1;// BOM
+			}
+			char* out = _buffer;
+			while (i < n) {
+				// ASCII runs are the common case in JSON, this loop vectorises well
+				size_t ascii_end = i;
+				while (ascii_end < n && units[ascii_end] < 0x80)
+					++ascii_end;
+				for (; i < ascii_end; ++i)
+					*out++ = static_cast<char>(units[i]);
+				if (i == n)
+					break;
+				uint32_t code_point = units[i];
+				if (utf16 && high_surrogate(code_point)) {
+					if (i + 1 == n || !low_surrogate(units[i + 1])) {
+						out = fail(out, i, "Invalid UTF-16 surrogate pair in JSON input.");
+						break;
+					}
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (units[i + 1] - 0xDC00);
+					i += 2;
+				}
+				else if (low_surrogate(code_point) || code_point > 0x10FFFF) {
+					out = fail(out, i, "Invalid code point in JSON input.");
+					break;
+				}
+				else
+					++i;
+
+				if (code_point < 0x800) {
+					*out++ = static_cast<char>(0xC0 | (code_point >> 6));
+				}
+				else if (code_point < 0x10000) {
+					*out++ = static_cast<char>(0xE0 | (code_point >> 12));
+					*out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+				}
+				else {
+					*out++ = static_cast<char>(0xF0 | (code_point >> 18));
+					*out++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+					*out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+				}
+				*out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+			}
+			*out = '\0';
+			_size = static_cast<size_t>(out - _buffer);
+			if (!_size && !_finished)
+				refill();// the block was only a BOM
+		}
+	public:
+		utf8_transcoding_stream(stream_t& stream_) :
+			_stream(&stream_), _position(0), _size(0), _consumed(0), _block_units(0),
+			_tell_position(0), _tell_units(0), _started(false), _finished(false),
+			_error(nullptr), _error_offset(0) {
+			refill();
+		}
+
+		inline Ch Peek() const { return _buffer[_position]; }
+		inline Ch Take() {
+			Ch c = _buffer[_position];
+			if (_position < _size && ++_position == _size)
+				refill();
+			return c;
+		}
+		inline size_t Tell() const {
+			for (; _tell_position < _position; ++_tell_position) {
+				unsigned char c = static_cast<unsigned char>(_buffer[_tell_position]);
+				if ((c & 0xC0) != 0x80)// not a continuation byte, so a new code point
+					_tell_units += (utf16 && c >= 0xF0) ? 2 : 1;// 4 byte sequences come from surrogate pairs
+			}
+			return _consumed + _tell_units;
+		}
+
+		// what was wrong with the input, nullptr if nothing was
+		inline const char* error() const { return _error; }
+		inline size_t error_offset() const { return _error_offset; }
+
+		// not implemented, same as rapidjson::EncodedInputStream
+		void Put(Ch) { RAPIDJSON_ASSERT(false); }
+		void Flush() { RAPIDJSON_ASSERT(false); }
+		Ch* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
 	namespace encoding_traits {
 		// reading and writing traits
 		template<typename stream_t, json_encoding encoding>
@@ -1740,19 +3106,20 @@ namespace impl {
 			static inline input_stream_t input_stream(stream_t& stream) { return stream; }
 		};
 
-#define __AF_JSON_READING_TRAIT(INPUT_ENCODING_ENUM, INPUT_ENCODING_JSON)\
+	// UTF-16/32 input is transcoded in blocks, the parser only ever sees UTF-8
+#define __AF_JSON_READING_TRAIT(INPUT_ENCODING_ENUM)\
 	template<typename stream_t> \
 	struct reading<stream_t, json_encoding::INPUT_ENCODING_ENUM> {\
-		using input_encoding_t = rapidjson::INPUT_ENCODING_JSON<_AF_SERIALIZATION_CHAR_T>;\
-		using input_stream_t = rapidjson::EncodedInputStream<input_encoding_t, stream_t>;\
+		using input_encoding_t = rapidjson::UTF8<_AF_SERIALIZATION_CHAR_T>;\
+		using input_stream_t = utf8_transcoding_stream<json_encoding::INPUT_ENCODING_ENUM, stream_t>;\
 		using schema_t = rapidjson::SchemaDocument;\
 		static inline input_stream_t input_stream(stream_t& stream) { return input_stream_t(stream); }\
 	};
 
-		__AF_JSON_READING_TRAIT(utf16le, UTF16LE);
-		__AF_JSON_READING_TRAIT(utf16be, UTF16BE);
-		__AF_JSON_READING_TRAIT(utf32le, UTF32LE);
-		__AF_JSON_READING_TRAIT(utf32be, UTF32BE);
+		__AF_JSON_READING_TRAIT(utf16le);
+		__AF_JSON_READING_TRAIT(utf16be);
+		__AF_JSON_READING_TRAIT(utf32le);
+		__AF_JSON_READING_TRAIT(utf32be);
 
 		template<typename stream_t>
 		struct reading<stream_t, json_encoding::detect> {
@@ -1781,7 +3148,7 @@ namespace impl {
 				_fp = fopen(path_.c_str(), read_flags);
 			else
 				_fp = fopen(path_.c_str(), write_flags);
-
+			AF_ASSERT(_fp, "Failed to open %.", path_);
 		}
 
 		inline read_stream_t&& read_stream() {
@@ -1797,6 +3164,540 @@ namespace impl {
 		}
 	};
 
+	// rapidjson output stream that writes to a file on a background thread
+	// serialization fills one buffer while the other one is being written out,
+	// so CPU work and disk I/O overlap instead of taking turns
+	class async_file_write_stream {
+	public:
+		typedef char Ch;
+	private:
+		static const size_t alignment = 4096;
+		using lock_t = std::unique_lock<std::mutex>;
+
+		size_t const _buffer_size;
+		async_write_policy const _policy;
+		bool _direct;			// the file was opened for direct I/O, so only whole blocks can be written until the last write
+		char* _buffers[2];
+		size_t _current;		// index of the buffer we are filling
+		char* _position;		// where the next character goes
+		char* _end;
+
+		// shared with the background thread
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		char const* _pending;	// buffer waiting to be written, nullptr when there's nothing to do
+		size_t _pending_size;
+		bool _stop;
+		std::string _error;		// background errors are reported on the serializing thread
+		std::thread _thread;
+
+#ifdef _WIN32
+		FILE* _fp;
+		inline bool open_file(std::string const& path_) {
+			_fp = fopen(path_.c_str(), "wb");
+			return _fp != nullptr;
+		}
+		inline bool write_all(char const* data_, size_t size_, bool /*last*/) {
+			return fwrite(data_, 1, size_, _fp) == size_;
+		}
+		inline bool close_file() {
+			bool ok = fflush(_fp) == 0;
+			return (fclose(_fp) == 0) && ok;
+		}
+#else
+		int _fd;
+		inline bool open_file(std::string const& path_) {
+			int const flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+			if (_policy == async_write_policy::direct) {
+				_fd = ::open(path_.c_str(), flags | O_DIRECT, 0644);
+				if (_fd >= 0) {
+					_direct = true;
+					return true;
+				}
+				if (errno != EINVAL)
+					return false;
+				// the file system doesn't do direct I/O (tmpfs for one), write through the cache instead
+			}
+#endif
+			_fd = ::open(path_.c_str(), flags, 0644);
+			return _fd >= 0;
+		}
+		inline bool write_all(char const* data_, size_t size_, bool last_) {
+#ifdef O_DIRECT
+			// direct I/O only takes whole blocks, the tail of the file goes through the cache
+			if (last_ && _direct && (size_ % alignment) != 0)
+				fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+#endif
+			while (size_ > 0) {
+				ssize_t written = ::write(_fd, data_, size_);
+				if (written < 0)
+					return false;
+				data_ += written;
+				size_ -= static_cast<size_t>(written);
+			}
+			return true;
+		}
+		inline bool close_file() {
+			bool ok = true;
+			if (_policy != async_write_policy::buffered)
+				ok = (fdatasync(_fd) == 0);
+			return (::close(_fd) == 0) && ok;
+		}
+#endif
+		static inline char* allocate_buffer(size_t size_) {
+#ifdef _WIN32
+			return static_cast<char*>(_aligned_malloc(size_, alignment));
+#else
+			void* p = nullptr;
+			return posix_memalign(&p, alignment, size_) == 0 ? static_cast<char*>(p) : nullptr;
+#endif
+		}
+		static inline void free_buffer(char* buffer_) {
+#ifdef _WIN32
+			_aligned_free(buffer_);
+#else
+			free(buffer_);
+#endif
+		}
+
+		void background_writer() {
+			lock_t lock(_mutex);
+			while (true) {
+				_cv.wait(lock, [this]() { return _pending || _stop; });
+				if (_pending) {
+					char const* data = _pending;
+					size_t size = _pending_size;
+					bool last = _stop;// only the buffer handed over by close() ends the file
+					lock.unlock();
+					bool ok = write_all(data, size, last);
+					lock.lock();
+					if (!ok && _error.empty())
+						_error = "Failed to write JSON file.";
+					_pending = nullptr;
+					_cv.notify_all();
+				}
+				else if (_stop)
+					return;
+			}
+		}
+		inline void check_errors(lock_t const& /*held*/) {
+			if (!_error.empty()) {
+				std::string error;
+				std::swap(error, _error);
+				AF_ERROR("%", error);
+			}
+		}
+		// waits for the background thread to take the other buffer, then hands over the current one
+		void swap_buffers(bool stopping_ = false) {
+			size_t size = static_cast<size_t>(_position - _buffers[_current]);
+			lock_t lock(_mutex);
+			_cv.wait(lock, [this]() { return !_pending; });
+			check_errors(lock);
+			if (size) {
+				_pending = _buffers[_current];
+				_pending_size = size;
+			}
+			_stop = stopping_;
+			_cv.notify_all();
+			_current = 1 - _current;
+			_position = _buffers[_current];
+			_end = _position + _buffer_size;
+		}
+	public:
+		async_file_write_stream(
+				typename traits::string_t const& path_,
+				async_write_policy policy_ = async_write_policy::buffered,
+				size_t buffer_size_ = _AF_JSON_ASYNC_WRITE_BUFFER_SIZE) :
+			_buffer_size(((buffer_size_ + alignment - 1) / alignment) * alignment),
+			_policy(policy_),
+			_direct(false),
+			_current(0),
+			_pending(nullptr),
+			_pending_size(0),
+			_stop(false) {
+			_buffers[0] = allocate_buffer(_buffer_size);
+			_buffers[1] = allocate_buffer(_buffer_size);
+			if (!_buffers[0] || !_buffers[1]) {
+				free_buffer(_buffers[0]);
+				free_buffer(_buffers[1]);
+				AF_ERROR("Failed to allocate buffers for writing %.", path_);
+			}
+			_position = _buffers[0];
+			_end = _position + _buffer_size;
+			if (!open_file(path_)) {
+				free_buffer(_buffers[0]);
+				free_buffer(_buffers[1]);
+				AF_ERROR("Failed to open % for writing.", path_);
+			}
+			_thread = std::thread(&async_file_write_stream::background_writer, this);
+		}
+		~async_file_write_stream() {
+			try {
+				close();
+			}
+			catch (...) {}// nothing sensible to do with errors in a destructor, call close() to see them
+		}
+		async_file_write_stream(async_file_write_stream const&) = delete;
+		async_file_write_stream& operator=(async_file_write_stream const&) = delete;
+
+		// writes out whatever is left and waits for the background thread to finish
+		void close() {
+			if (!_thread.joinable())
+				return;
+			swap_buffers(true);
+			{
+				lock_t lock(_mutex);
+				_cv.wait(lock, [this]() { return !_pending; });
+			}
+			_thread.join();
+			bool closed = close_file();
+			free_buffer(_buffers[0]);
+			free_buffer(_buffers[1]);
+			_buffers[0] = _buffers[1] = nullptr;
+			lock_t lock(_mutex);
+			check_errors(lock);
+			AF_ASSERT(closed, "Failed to close JSON file.");
+		}
+
+		inline void Put(Ch c) {
+			if (_position == _end)
+				swap_buffers();
+			*_position++ = c;
+		}
+		// rapidjson flushes at the end of each document, handing the buffer over is enough
+		// with direct I/O a partly filled buffer would break the block alignment of the writes after it,
+		// so it stays where it is until it's full or the stream is closed
+		inline void Flush() {
+			if (_position != _buffers[_current] && !_direct)
+				swap_buffers();
+		}
+
+		// not implemented, same as rapidjson::FileWriteStream
+		char Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+		char Take() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+		char* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(char*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
+#if _AF_JSON_USE_ZLIB
+	inline bool is_compressed(typename traits::string_t const& path_, json_compression compression_) {
+		if (compression_ == json_compression::by_extension) {
+			static const typename traits::string_t extension(".gz");
+			return path_.size() > extension.size() &&
+				path_.compare(path_.size() - extension.size(), extension.size(), extension) == 0;
+		}
+		return compression_ == json_compression::gzip;
+	}
+
+	// rapidjson input stream that inflates gzip (or zlib) data on the fly, one chunk at a time
+	// compressed bytes come from a file or from memory, not from another rapidjson stream:
+	// those use '\0' as the end marker, which is a perfectly good byte in compressed data
+	// copies share the state, the reading traits pass streams around by value
+	class gzip_read_stream {
+	public:
+		typedef char Ch;
+	private:
+		static const size_t chunk_size = _AF_JSON_COMPRESSION_CHUNK_SIZE;
+		struct state_t {
+			z_stream _z;
+			FILE* _fp;
+			char const* _data;		// compressed input when reading from memory
+			size_t _data_size;
+			char _in[chunk_size];
+			char _out[chunk_size + 1];// +1 for the '\0' end marker
+			char* _current;
+			char* _end;
+			size_t _consumed;		// characters taken before the current chunk
+			bool _in_member;		// inside a gzip member, running out of input here means truncated data
+			bool _finished;
+
+			state_t(FILE* fp_, char const* data_, size_t data_size_) :
+				_fp(fp_), _data(data_), _data_size(data_size_),
+				_current(_out), _end(_out), _consumed(0), _in_member(false), _finished(false) {
+				_out[0] = '\0';
+				memset(&_z, 0, sizeof(_z));
+				// 15 + 32: maximum window, detect gzip or zlib header
+				if (inflateInit2(&_z, 15 + 32) != Z_OK) {
+					if (_fp)
+						fclose(_fp);
+					AF_ERROR("Failed to initialise zlib.");
+				}
+			}
+			~state_t() {
+				inflateEnd(&_z);
+				if (_fp)
+					fclose(_fp);
+			}
+
+			size_t read_input() {
+				size_t size = 0;
+				if (_fp)
+					size = fread(_in, 1, chunk_size, _fp);
+				else {
+					size = _data_size < chunk_size ? _data_size : chunk_size;
+					memcpy(_in, _data, size);
+					_data += size;
+					_data_size -= size;
+				}
+				_z.next_in = reinterpret_cast<Bytef*>(_in);
+				_z.avail_in = static_cast<uInt>(size);
+				return size;
+			}
+
+			void refill() {
+				_consumed += static_cast<size_t>(_end - _out);
+				_current = _end = _out;
+				while (_current == _end && !_finished) {
+					if (_z.avail_in == 0 && read_input() == 0) {
+						AF_ASSERT(!_in_member, "Compressed JSON input is truncated.");
+						_finished = true;
+						break;
+					}
+					_in_member = true;
+					_z.next_out = reinterpret_cast<Bytef*>(_out);
+					_z.avail_out = static_cast<uInt>(chunk_size);
+					int result = inflate(&_z, Z_NO_FLUSH);
+					if (result == Z_STREAM_END) {
+						// there may be more members, concatenated gzip files are valid gzip files
+						_in_member = false;
+						inflateReset(&_z);
+					}
+					else if (result != Z_OK && result != Z_BUF_ERROR)
+						AF_ERROR("Corrupt compressed JSON input: %", (_z.msg ? _z.msg : "unknown zlib error"));
+					_end = _out + (chunk_size - _z.avail_out);
+				}
+				*_end = '\0';
+			}
+		};
+		std::shared_ptr<state_t> _state;
+	public:
+		// reads a compressed file
+		gzip_read_stream(typename traits::string_t const& path_) {
+			FILE* fp = fopen(path_.c_str(), "rb");
+			AF_ASSERT(fp, "Failed to open % for reading.", path_);
+			_state = std::make_shared<state_t>(fp, nullptr, 0);
+			_state->refill();
+		}
+		// reads compressed data from memory, data_ has to outlive the stream
+		gzip_read_stream(char const* data_, size_t size_) :
+			_state(std::make_shared<state_t>(nullptr, data_, size_)) {
+			_state->refill();
+		}
+
+		inline Ch Peek() const { return *_state->_current; }
+		inline Ch Take() {
+			Ch c = *_state->_current;
+			if (_state->_current != _state->_end && ++_state->_current == _state->_end)
+				_state->refill();
+			return c;
+		}
+		inline size_t Tell() const { return _state->_consumed + static_cast<size_t>(_state->_current - _state->_out); }
+		// for encoding detection
+		inline Ch const* Peek4() const { return (_state->_end - _state->_current >= 4) ? _state->_current : 0; }
+
+		// not implemented, same as rapidjson::FileReadStream
+		void Put(Ch) { RAPIDJSON_ASSERT(false); }
+		void Flush() { RAPIDJSON_ASSERT(false); }
+		Ch* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
+	// rapidjson output stream that gzips everything put into it and passes it on to another output stream
+	// (a file stream, a string buffer, ...)
+	// call finish() at the end, the gzip trailer is only written then
+	template<typename stream_t>
+	class gzip_write_stream {
+	public:
+		typedef char Ch;
+	private:
+		static const size_t chunk_size = _AF_JSON_COMPRESSION_CHUNK_SIZE;
+		// the buffers are on the heap, streams are created on the stack of the writers
+		struct buffers_t {
+			char _in[chunk_size];
+			char _out[chunk_size];
+		};
+		stream_t& _stream;
+		z_stream _z;
+		std::unique_ptr<buffers_t> _buffers;
+		char* _in;
+		char* _out;
+		char* _position;
+		bool _finished;
+
+		void deflate_input(int flush_) {
+			_z.next_in = reinterpret_cast<Bytef*>(_in);
+			_z.avail_in = static_cast<uInt>(_position - _in);
+			do {
+				_z.next_out = reinterpret_cast<Bytef*>(_out);
+				_z.avail_out = static_cast<uInt>(chunk_size);
+				int result = deflate(&_z, flush_);
+				AF_ASSERT(result != Z_STREAM_ERROR, "Failed to compress JSON output.");
+				for (char const* p = _out; p != _out + (chunk_size - _z.avail_out); ++p)
+					_stream.Put(*p);
+			} while (_z.avail_out == 0);
+			_position = _in;
+		}
+	public:
+		gzip_write_stream(stream_t& stream_, int level_ = Z_DEFAULT_COMPRESSION) :
+			_stream(stream_),
+			_buffers(new buffers_t),
+			_in(_buffers->_in),
+			_out(_buffers->_out),
+			_position(_in),
+			_finished(false) {
+			memset(&_z, 0, sizeof(_z));
+			// 15 + 16: maximum window, gzip header
+			if (deflateInit2(&_z, level_, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				AF_ERROR("Failed to initialise zlib.");
+		}
+		~gzip_write_stream() {
+			try {
+				finish();
+			}
+			catch (...) {}
+			deflateEnd(&_z);
+		}
+		gzip_write_stream(gzip_write_stream const&) = delete;
+		gzip_write_stream& operator=(gzip_write_stream const&) = delete;
+
+		void finish() {
+			if (_finished)
+				return;
+			_finished = true;
+			deflate_input(Z_FINISH);
+			_stream.Flush();
+		}
+
+		inline void Put(Ch c) {
+			if (_position == _in + chunk_size)
+				deflate_input(Z_NO_FLUSH);
+			*_position++ = c;
+		}
+		// compressing small pieces would hurt the ratio, so this is only a hint
+		inline void Flush() {}
+
+		// not implemented, same as rapidjson::FileWriteStream
+		char Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+		char Take() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+		char* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(char*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+#endif
+
+	// output stream that only counts characters, for computing exact serialized sizes
+	class size_counting_stream {
+		size_t _size;
+	public:
+		typedef char Ch;
+		size_counting_stream() : _size(0) {}
+
+		inline size_t size() const { return _size; }
+		inline void Put(Ch) { ++_size; }
+		inline void Flush() {}
+
+		// not implemented, same as rapidjson::FileWriteStream
+		char Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+		char Take() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+		char* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(char*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
+	// output stream that writes into a string sized up front, no reallocations and no final copy
+	template<typename string_t>
+	class presized_string_stream {
+		string_t& _out;
+		size_t _position;
+	public:
+		typedef char Ch;
+		presized_string_stream(string_t& out_, size_t size_) : _out(out_), _position(0) {
+			_out.resize(size_);
+		}
+
+		inline size_t size() const { return _position; }
+		inline void Put(Ch c) {
+			if (_position < _out.size())
+				_out[_position] = c;
+			else
+				_out.push_back(c);// the size was wrong, still produce the right output
+			++_position;
+		}
+		inline void Flush() {}
+
+		// not implemented, same as rapidjson::FileWriteStream
+		char Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+		char Take() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+		char* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(char*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
+	// runs a worker for every document index on a pool of threads_ threads (0 means one per core)
+	// make_worker_() is called once per thread, the worker it returns is then called with each index the thread takes,
+	// so whatever the worker sets up is reused for all documents of its thread
+	// documents are handed out one at a time, so a few big ones don't hold up the rest
+	// returns one error message per document, empty when the document was fine
+	template<typename make_worker_t>
+	std::vector<std::string> for_each_document(size_t count_, size_t threads_, make_worker_t const& make_worker_) {
+		std::vector<std::string> errors(count_);
+		if (!threads_)
+			threads_ = (std::max)(static_cast<size_t>(std::thread::hardware_concurrency()), size_t(1));
+		threads_ = (std::min)(threads_, count_);
+
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			auto f = make_worker_();
+			for (size_t i = next++; i < count_; i = next++) {
+				try {
+					f(i);
+				}
+				catch (std::exception const& e) {
+					errors[i] = e.what();
+				}
+				catch (...) {
+					errors[i] = "Unknown error.";
+				}
+			}
+		};
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads_; ++t)
+			pool.emplace_back(worker);
+		worker();// this thread works too
+		for (auto& t : pool)
+			t.join();
+		return errors;
+	}
+
+#if _AF_JSON_PROFILING
+	// sits between rapidjson and the top handler to count payload bytes as they come in
+	// (nested handlers see the same values again, so this is the only place where counting is right)
+	struct profiling_handler_t {
+		using char_t = traits::char_t;
+		using profiler_t = profiling::profiler_t;
+		handler_t& _handler;
+
+		profiling_handler_t(handler_t& handler_) : _handler(handler_) {}
+
+		bool Null() { return _handler.Null(); }
+		bool Bool(bool b) { profiler_t::count_bytes(sizeof(b)); return _handler.Bool(b); }
+		bool Int(int i) { profiler_t::count_bytes(sizeof(i)); return _handler.Int(i); }
+		bool Uint(unsigned i) { profiler_t::count_bytes(sizeof(i)); return _handler.Uint(i); }
+		bool Int64(int64_t i) { profiler_t::count_bytes(sizeof(i)); return _handler.Int64(i); }
+		bool Uint64(uint64_t i) { profiler_t::count_bytes(sizeof(i)); return _handler.Uint64(i); }
+		bool Double(double d) { profiler_t::count_bytes(sizeof(d)); return _handler.Double(d); }
+		bool RawNumber(const char_t* str, size_t length, bool copy) { profiler_t::count_bytes(length); return _handler.RawNumber(str, length, copy); }
+		bool String(const char_t* str, size_t length, bool copy) { profiler_t::count_bytes(length); return _handler.String(str, length, copy); }
+		bool StartObject() { return _handler.StartObject(); }
+		bool Key(const char_t* str, size_t length, bool copy) { profiler_t::count_bytes(length); return _handler.Key(str, length, copy); }
+		bool EndObject(size_t memberCount) { return _handler.EndObject(memberCount); }
+		bool StartArray() { return _handler.StartArray(); }
+		bool EndArray(size_t elementCount) { return _handler.EndArray(elementCount); }
+	};
+#endif
+
 	static void report_parsing_error(rapidjson::Reader const& reader) {
 		using namespace rapidjson;
 		ParseErrorCode e = reader.GetParseErrorCode();
@@ -1804,6 +3705,18 @@ namespace impl {
 		AF_ERROR("Error parsing JSON. Error is: % (near %)",
 			GetParseError_En(e), o);
 	}
+	// the parser fails on bad input from transcoding streams too, but the stream knows what was wrong
+	template<typename stream_t>
+	static void report_parsing_error(rapidjson::Reader const& reader, stream_t const& /*stream_*/) {
+		report_parsing_error(reader);
+	}
+	template<json_encoding source_v, typename stream_t>
+	static void report_parsing_error(rapidjson::Reader const& reader, utf8_transcoding_stream<source_v, stream_t> const& stream_) {
+		if (stream_.error())
+			AF_ERROR("Error parsing JSON. Error is: % (near %)", stream_.error(), stream_.error_offset());
+		else
+			report_parsing_error(reader);
+	}
 
 } // namespace impl
 
@@ -1812,10 +3725,10 @@ using json_handler_cache_t = impl::handler_makers::json_handler_cache_t;
 template<typename target_t>
 using json_handler_cache_impl_t = impl::handler_makers::json_handler_cache_impl_t<target_t>;
 
+// handlers for TYPE are cached per type and thread, instances of TYPE don't grow
 #define AF_IMPLEMENTS_JSON_HANDLER(TYPE) \
-    autotelica::json::json_handler_cache_impl_t<TYPE> __handler_cache;\
-    virtual autotelica::json::json_handler_cache_t& json_handler_cache() {\
-        return __handler_cache;\
+    static autotelica::json::json_handler_cache_t& json_handler_cache() {\
+        return autotelica::json::json_handler_cache_impl_t<TYPE>::instance();\
     }
 
 
@@ -1953,7 +3866,7 @@ private:
 			AF_ERROR("Error parsing JSON during validation. Error is: % (near %)",
 				GetParseError_En(e), o);
 		}
-		check_errors(_validator);
+		check_errors();
 	}
 
 public:
@@ -1964,15 +3877,13 @@ public:
 
 	template<typename stream_t>
 	inline static std::shared_ptr<schema> from_stream(stream_t& stream, std::string const& root_ = "") {
-		return std::make_shared<schema_t>(dom_t::from_stream(stream), root_);
+		return std::shared_ptr<schema>(new schema(dom_t::from_stream(stream), root_));
 	}
-	template<typename stream_t>
 	inline static std::shared_ptr<schema> from_string(typename traits::string_t const& schema_, std::string const& root_ = "") {
-		return std::make_shared<schema_t>(dom_t::from_string(schema_), root_);
+		return std::shared_ptr<schema>(new schema(dom_t::from_string(schema_), root_));
 	}
-	template<typename stream_t>
 	inline static std::shared_ptr<schema> from_file(typename traits::string_t const& path_, std::string const& root_ = "") {
-		return std::make_shared<schema_t>(dom_t::from_file(path_), root_);
+		return std::shared_ptr<schema>(new schema(dom_t::from_file(path_), root_));
 	}
 
 	template<typename stream_t, typename handler_t>
@@ -1981,13 +3892,13 @@ public:
 		using namespace impl;
 		handler_validator_t<handler_t > validator(_schema, handler_);
 		Reader reader;
-		if (reader.Parse(stream_, validator))
-			impl::report_parsing_error(reader);
+		if (!reader.Parse(stream_, validator))
+			impl::report_parsing_error(reader, stream_);
 		check_validation_errors(validator);
 	}
 	void validate_string(typename traits::string_t const& json_) {
 		using namespace rapidjson;
-		StringStream ss(json.c_str());
+		StringStream ss(json_.c_str());
 		validate_stream(ss);
 	}
 	void validate_file(typename traits::string_t const& path_) {
@@ -1996,34 +3907,89 @@ public:
 		validate_stream(stream);
 	}
 };
-template<json_encoding encoding_v = json_envoding::utf8>
+template<json_encoding encoding_v = json_encoding::utf8>
 using schema_p = std::shared_ptr<schema<encoding_v>>;
 
 template<json_encoding encoding_v = json_encoding::utf8>
 struct reader {
-
-
-	template<typename target_t, typename stream_t>
-	static void from_stream(
-			target_t& target_,
+private:
+	// parses stream_ through a handler tree that is already bound to the target
+	template<typename stream_t>
+	static void parse(
+			impl::handler_t& handler_,
 			stream_t& stream_,
-			schema_p<encoding_v> schema_ = nullptr) {
+			schema_p<encoding_v> schema_) {
 		using namespace rapidjson;
 		using namespace impl;
-		
-		Reader reader;
-		auto handler = impl::serialization_factory::make_handler(&target_);
-		handler->prepare_for_loading();
+
+#if _AF_JSON_SHARED_OBJECT_IDS
+		impl::shared_objects_t::scope_t shared_objects_scope;
+#endif
+		handler_.prepare_for_loading();
+#if _AF_JSON_PROFILING
+		impl::profiling_handler_t top_handler(handler_);
+#else
+		auto& top_handler = handler_;
+#endif
 		using reader_factory_t = encoding_traits::reading<stream_t, encoding_v>;
 		auto actual_stream = reader_factory_t::input_stream(stream_);
 		if (schema_) {
-			schema_->parse_with_validation(actual_stream, *handler);
+			schema_->parse_with_validation(actual_stream, top_handler);
 		}
 		else {
 			Reader reader;
-			if (!reader.Parse(actual_stream, *handler))
-				impl::report_parsing_error(reader);
+			if (!reader.Parse(actual_stream, top_handler))
+				impl::report_parsing_error(reader, actual_stream);
+		}
+	}
+
+	// reads documents one after the other through the same handler tree
+	// handlers are bound to the addresses they load into (members of objects included), so documents
+	// are read into a scratch target the handlers stay bound to, and swapped into place afterwards
+	template<typename target_t>
+	class document_reader_t {
+		target_t _scratch;
+		impl::handler_p const _handler;
+	public:
+		document_reader_t() : _handler(impl::serialization_factory::make_handler(&_scratch)) {}
+		document_reader_t(document_reader_t const&) = delete;
+		document_reader_t& operator=(document_reader_t const&) = delete;
+
+		template<typename stream_t>
+		void read(target_t& target_, stream_t& stream_, schema_p<encoding_v> schema_) {
+			using std::swap;
+			swap(_scratch, target_);// reading on top of what target_ held, as reading into target_ would
+			try {
+				parse(*_handler, stream_, schema_);
+			}
+			catch (...) {
+				swap(_scratch, target_);
+				throw;
+			}
+			swap(_scratch, target_);
 		}
+		void read_file(target_t& target_, typename traits::string_t const& path_, schema_p<encoding_v> schema_) {
+#if _AF_JSON_USE_ZLIB
+			if (impl::is_compressed(path_, json_compression::by_extension)) {
+				impl::gzip_read_stream stream(path_);
+				read(target_, stream, schema_);
+				return;
+			}
+#endif
+			impl::json_file file(path_, true);
+			auto stream = file.read_stream();
+			read(target_, stream, schema_);
+		}
+	};
+
+public:
+	template<typename target_t, typename stream_t>
+	static void from_stream(
+			target_t& target_,
+			stream_t& stream_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		auto handler = impl::serialization_factory::make_handler(&target_);
+		parse(*handler, stream_, schema_);
 	}
 
 	template<typename target_t>
@@ -2058,9 +4024,13 @@ struct reader {
 			target_t& target_,
 			typename traits::string_t const& path_,
 			schema_p<encoding_v> schema_ = nullptr) {
+#if _AF_JSON_USE_ZLIB
+		from_file(target_, path_, json_compression::by_extension, schema_);
+#else
 		impl::json_file file(path_, true);
 		auto stream = file.read_stream();
 		from_stream(target_, stream, schema_);
+#endif
 	}
 	template<typename target_t>
 	inline static void from_file(
@@ -2081,6 +4051,292 @@ struct reader {
 		from_file(target, path_, encoded_, schema_);
 		return target;
 	}
+
+	// batches of independent documents are read in parallel, targets_[i] is populated from jsons_[i]
+	// returns one error message per document (empty when the document was read fine), 
+	// a bad document doesn't stop the others
+	// every thread builds one handler tree and reads all of its documents through it
+	// threads_ = 0 uses one thread per core
+	template<typename target_t>
+	static std::vector<std::string> from_strings(
+			std::vector<typename traits::string_t> const& jsons_,
+			std::vector<target_t>& targets_,
+			size_t threads_ = 0,
+			schema_p<encoding_v> schema_ = nullptr) {
+		targets_.resize(jsons_.size());
+		return impl::for_each_document(jsons_.size(), threads_, [&]() {
+			auto document_reader = std::make_shared<document_reader_t<target_t>>();
+			return [&, document_reader](size_t i_) {
+				rapidjson::StringStream stream(jsons_[i_].c_str());
+				document_reader->read(targets_[i_], stream, schema_);
+			};
+		});
+	}
+
+	// same as from_strings, for files
+	template<typename target_t>
+	static std::vector<std::string> from_files(
+			std::vector<typename traits::string_t> const& paths_,
+			std::vector<target_t>& targets_,
+			size_t threads_ = 0,
+			schema_p<encoding_v> schema_ = nullptr) {
+		targets_.resize(paths_.size());
+		return impl::for_each_document(paths_.size(), threads_, [&]() {
+			auto document_reader = std::make_shared<document_reader_t<target_t>>();
+			return [&, document_reader](size_t i_) {
+				document_reader->read_file(targets_[i_], paths_[i_], schema_);
+			};
+		});
+	}
+
+#if _AF_JSON_USE_ZLIB
+	template<typename target_t>
+	inline static void from_file(
+			target_t& target_,
+			typename traits::string_t const& path_,
+			json_compression compression_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		if (impl::is_compressed(path_, compression_)) {
+			impl::gzip_read_stream stream(path_);
+			from_stream(target_, stream, schema_);
+		}
+		else {
+			impl::json_file file(path_, true);
+			auto stream = file.read_stream();
+			from_stream(target_, stream, schema_);
+		}
+	}
+
+	// reads gzip (or zlib) compressed JSON held in memory
+	template<typename target_t>
+	inline static void from_compressed_string(
+			target_t& target_,
+			std::string const& compressed_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		impl::gzip_read_stream stream(compressed_.data(), compressed_.size());
+		from_stream(target_, stream, schema_);
+	}
+#endif
+
+#if _AF_HAS_PMR
+	// reading into memory resources (typically std::pmr::monotonic_buffer_resource)
+	// std::pmr containers and strings that are read are (re)built on resource_, elements of pmr containers
+	// get it from their container, so the whole object graph can be released in one go by releasing the resource
+	// the default resource is left alone, allocations on other threads don't end up in resource_
+	// NOTE: resource_ has to outlive the target
+	template<typename target_t>
+	inline static void from_string(
+			target_t& target_,
+			typename traits::string_t const& json_,
+			std::pmr::memory_resource* resource_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		impl::memory_resource_t::scope_t scope(resource_);
+		from_string(target_, json_, schema_);
+	}
+
+	template<typename target_t>
+	inline static target_t from_string(
+			typename traits::string_t const& json_,
+			std::pmr::memory_resource* resource_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		target_t target;
+		from_string(target, json_, resource_, schema_);
+		return target;
+	}
+
+	template<typename target_t>
+	inline static void from_file(
+			target_t& target_,
+			typename traits::string_t const& path_,
+			std::pmr::memory_resource* resource_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		impl::memory_resource_t::scope_t scope(resource_);
+		from_file(target_, path_, schema_);
+	}
+
+	template<typename target_t>
+	inline static target_t from_file(
+			typename traits::string_t const& path_,
+			std::pmr::memory_resource* resource_,
+			schema_p<encoding_v> schema_ = nullptr) {
+		target_t target;
+		from_file(target, path_, resource_, schema_);
+		return target;
+	}
+#endif
+};
+
+// Read-only view over an in-memory JSON object that decodes members only when they are touched.
+// Construction does a cheap pass over the buffer that only records where each member's value is,
+// accessors then parse just that value, using the handlers from target_t's type description.
+// Useful for filtering or routing big messages on a few fields.
+// NOTE: the buffer is not copied, so it has to outlive the view. It also has to be null terminated.
+template<typename target_t>
+class lazy_view {
+	using char_t = traits::char_t;
+	using string_t = traits::string_t;
+	using key_t = traits::key_t;
+	using object_handler_t = impl::handler_object_t<target_t>;
+
+	// where in the buffer a member's value is
+	struct span_t {
+		const char_t* _key;
+		size_t _key_length;
+		const char_t* _value;
+		size_t _value_length;
+	};
+
+	const char_t* const _json;
+	size_t const _length;
+	std::vector<span_t> _spans;
+	target_t _object; // members are decoded into this one, as needed
+	std::shared_ptr<object_handler_t> _handler;
+	std::vector<bool> _decoded; // indexed the same way as _handler->_handlers
+
+	// the first pass - a minimal scanner, doesn't decode or validate anything it doesn't have to
+	inline void skip_whitespace(size_t& i_) const {
+		while (i_ < _length && string_util::fast_is_space(_json[i_])) ++i_;
+	}
+	inline void skip_string(size_t& i_) const {
+		AF_ASSERT(_json[i_] == '"', "String expected at offset %.", i_);
+		for (++i_; i_ < _length && _json[i_] != '"'; ++i_) {
+			if (_json[i_] == '\\')
+				++i_;
+		}
+		AF_ASSERT(i_ < _length, "Unterminated string in JSON.");
+		++i_;
+	}
+	inline void skip_value(size_t& i_) const {
+		char_t const c = _json[i_];
+		if (c == '"') {
+			skip_string(i_);
+			return;
+		}
+		if (c == '{' || c == '[') {
+			size_t depth = 0;
+			while (i_ < _length) {
+				char_t const d = _json[i_];
+				if (d == '"') {
+					skip_string(i_);
+					continue;
+				}
+				if (d == '{' || d == '[')
+					++depth;
+				else if ((d == '}' || d == ']') && --depth == 0) {
+					++i_;
+					return;
+				}
+				++i_;
+			}
+			AF_ERROR("Unterminated object or array in JSON.");
+		}
+		// numbers, true, false, null
+		while (i_ < _length && _json[i_] != ',' && _json[i_] != '}' && _json[i_] != ']' && 
+			!string_util::fast_is_space(_json[i_]))
+			++i_;
+	}
+	void scan() {
+		size_t i = 0;
+		skip_whitespace(i);
+		AF_ASSERT(i < _length && _json[i] == '{', "Lazy views work only on JSON objects.");
+		++i;
+		skip_whitespace(i);
+		if (i < _length && _json[i] == '}')
+			return;
+		while (i < _length) {
+			span_t span;
+			size_t const key_start = i;
+			skip_string(i);
+			span._key = _json + key_start + 1;
+			span._key_length = i - key_start - 2;
+			skip_whitespace(i);
+			AF_ASSERT(i < _length && _json[i] == ':', "Colon expected at offset %.", i);
+			++i;
+			skip_whitespace(i);
+			size_t const value_start = i;
+			skip_value(i);
+			span._value = _json + value_start;
+			span._value_length = i - value_start;
+			_spans.push_back(span);
+			skip_whitespace(i);
+			AF_ASSERT(i < _length, "Unterminated object in JSON.");
+			if (_json[i] == '}')
+				return;
+			AF_ASSERT(_json[i] == ',', "Comma expected at offset %.", i);
+			++i;
+			skip_whitespace(i);
+		}
+	}
+
+	inline span_t const* find_span(key_t const& key_) const {
+		for (auto const& s : _spans) {
+			if (s._key_length == key_.size() && util::equal_tag(s._key, s._key_length, key_.c_str()))
+				return &s;
+		}
+		return nullptr;
+	}
+	inline size_t find_handler(void const* member_address_) const {
+		auto const& handlers = _handler->_handlers;
+		for (size_t i = 0; i < handlers.size(); ++i) {
+			if (handlers[i].second->target_address() == member_address_)
+				return i;
+		}
+		AF_ERROR("Member is not part of the type description.");
+		return size_t(-1);
+	}
+	void decode(size_t index_) {
+		if (_decoded[index_]) return;
+		auto const& h = _handler->_handlers[index_];
+		h.second->prepare_for_loading();
+		auto span = find_span(h.first);
+		if (!span)
+			h.second->Missing(h.first);
+		else {
+			using namespace rapidjson;
+			StringStream ss(span->_value);
+			Reader reader;
+			if (!reader.Parse<kParseStopWhenDoneFlag>(ss, *h.second))
+				impl::report_parsing_error(reader);
+		}
+		_decoded[index_] = true;
+	}
+public:
+	lazy_view(const char_t* json_, size_t length_) :
+		_json(json_),
+		_length(length_),
+		_object(),
+		_handler(std::dynamic_pointer_cast<object_handler_t>(
+			impl::serialization_factory::make_handler(&_object))) {
+		AF_ASSERT(_handler, "Lazy views need a type with a type description.");
+		_decoded.resize(_handler->_handlers.size(), false);
+		scan();
+	}
+	lazy_view(string_t const& json_) : lazy_view(json_.c_str(), json_.size()) {}
+	lazy_view(lazy_view const&) = delete; // handlers point into _object
+	lazy_view& operator=(lazy_view const&) = delete;
+
+	// is the member present in the JSON
+	inline bool has(key_t const& key_) const { return find_span(key_) != nullptr; }
+	// raw JSON text of a member, without decoding it
+	inline string_t raw(key_t const& key_) const {
+		auto span = find_span(key_);
+		return span ? string_t(span->_value, span->_value_length) : string_t();
+	}
+
+	// decodes the member on first access
+	template<typename member_t>
+	member_t const& get(member_t target_t::* member_) {
+		member_t& member = _object.*member_;
+		decode(find_handler(&member));
+		return member;
+	}
+
+	// decodes everything that hasn't been decoded yet, for when a full object is needed after all
+	target_t const& object() {
+		for (size_t i = 0; i < _decoded.size(); ++i)
+			decode(i);
+		return _object;
+	}
 };
 
 template<json_encoding encoding_v = json_encoding::utf8>
@@ -2093,18 +4349,79 @@ struct writer {
 		using namespace rapidjson;
 		using namespace impl;
 		//TODO: this should use serialization_factory
+#if _AF_JSON_SHARED_OBJECT_IDS
+		impl::shared_objects_t::scope_t shared_objects_scope;
+#endif
 		auto handler = impl::serialization_factory::make_handler(&target_);
 		auto writer_wrapper = writer_wrapper_impl_t<writer_t>{ writer_ };
 		handler->write(writer_wrapper);
 	}
 
-	template<typename target_t, typename stream_t>
-	static void to_stream(
-		target_t& target_,
+	// JSON schema of what gets written for target_t, built from its handlers
+	template<typename target_t, typename writer_t>
+	static void schema_to_writer(writer_t& writer_) {
+		using namespace impl;
+		target_t target;
+		auto handler = impl::serialization_factory::make_handler(&target);
+		auto writer_wrapper = writer_wrapper_impl_t<writer_t>{ writer_ };
+		handler->write_schema(writer_wrapper);
+	}
+
+	// streaming: writes a JSON array straight from a range, one element at a time
+	// elements are copied into one local so its handler is made once (object handlers are bound
+	// to the members of the object they were made for, so they can't be pointed at the next element)
+	template<typename iterator_t, typename writer_t>
+	static void range_to_writer(
+		iterator_t begin_,
+		iterator_t end_,
+		writer_t& writer_) {
+		using namespace impl;
+		using element_t = typename std::iterator_traits<iterator_t>::value_type;
+#if _AF_JSON_SHARED_OBJECT_IDS
+		impl::shared_objects_t::scope_t shared_objects_scope;
+#endif
+		element_t element;
+		auto handler = impl::serialization_factory::make_handler(&element);
+		auto writer_wrapper = writer_wrapper_impl_t<writer_t>{ writer_ };
+		writer_wrapper.StartArray();
+		size_t count = 0;
+		for (; begin_ != end_; ++begin_, ++count) {
+			element = *begin_;
+			handler->write(writer_wrapper);
+		}
+		writer_wrapper.EndArray(count);
+	}
+
+	// streaming: writes a JSON array of whatever generator_ produces, until it returns false
+	// the generator fills in the same element every time, so memory use stays constant
+	template<typename element_t, typename writer_t>
+	static void generator_to_writer(
+		std::function<bool(element_t&)> const& generator_,
+		writer_t& writer_) {
+		using namespace impl;
+#if _AF_JSON_SHARED_OBJECT_IDS
+		impl::shared_objects_t::scope_t shared_objects_scope;
+#endif
+		element_t element;
+		auto handler = impl::serialization_factory::make_handler(&element);
+		auto writer_wrapper = writer_wrapper_impl_t<writer_t>{ writer_ };
+		writer_wrapper.StartArray();
+		size_t count = 0;
+		while (generator_(element)) {
+			handler->write(writer_wrapper);
+			++count;
+		}
+		writer_wrapper.EndArray(count);
+	}
+
+	// sets up the right kind of rapidjson writer for the stream and passes it to write_f_
+	template<typename stream_t, typename write_f_t>
+	static void with_writer(
 		stream_t& stream_,
-		bool pretty_ = false,
-		schema_p<encoding_v> schema_ = nullptr, 
-		bool put_bom_ = false) {
+		bool pretty_,
+		schema_p<encoding_v> schema_,
+		bool put_bom_,
+		write_f_t const& write_f_) {
 		using namespace rapidjson;
 		using namespace impl;
 
@@ -2114,23 +4431,110 @@ struct writer {
 			if (schema_) {
 				typename writer_factory_t::validating_pretty_writer_t v_writer(
 					schema_->get_schema(), writer);
-				to_writer(target_, v_writer);
+				write_f_(v_writer);
 			}
 			else
-				to_writer(target_, writer);
+				write_f_(writer);
 		}
 		else {
 			auto writer = writer_factory_t::writer(stream_, put_bom_);
 			if (schema_) {
 				typename writer_factory_t::validating_writer_t v_writer(
 					schema_->get_schema(), writer);
-				to_writer(target_, v_writer);
+				write_f_(v_writer);
 			}
 			else
-				to_writer(target_, writer);
+				write_f_(writer);
 		}
 	}
 
+	template<typename target_t, typename stream_t>
+	static void to_stream(
+		target_t& target_,
+		stream_t& stream_,
+		bool pretty_ = false,
+		schema_p<encoding_v> schema_ = nullptr, 
+		bool put_bom_ = false) {
+		with_writer(stream_, pretty_, schema_, put_bom_, 
+			[&target_](auto& writer_) { to_writer(target_, writer_); });
+	}
+
+	template<typename target_t, typename stream_t>
+	static void schema_to_stream(
+		stream_t& stream_,
+		bool pretty_ = true) {
+		with_writer(stream_, pretty_, nullptr, false,
+			[](auto& writer_) { schema_to_writer<target_t>(writer_); });
+	}
+
+	template<typename target_t>
+	static typename traits::string_t schema_to_string(bool pretty_ = true) {
+		rapidjson::StringBuffer sb;
+		schema_to_stream<target_t>(sb, pretty_);
+		return typename traits::string_t(sb.GetString(), sb.GetSize());
+	}
+
+	template<typename iterator_t, typename stream_t>
+	static void range_to_stream(
+		iterator_t begin_,
+		iterator_t end_,
+		stream_t& stream_,
+		bool pretty_ = false,
+		schema_p<encoding_v> schema_ = nullptr,
+		bool put_bom_ = false) {
+		with_writer(stream_, pretty_, schema_, put_bom_,
+			[&begin_, &end_](auto& writer_) { range_to_writer(begin_, end_, writer_); });
+	}
+
+	template<typename element_t, typename stream_t>
+	static void generator_to_stream(
+		std::function<bool(element_t&)> const& generator_,
+		stream_t& stream_,
+		bool pretty_ = false,
+		schema_p<encoding_v> schema_ = nullptr,
+		bool put_bom_ = false) {
+		with_writer(stream_, pretty_, schema_, put_bom_,
+			[&generator_](auto& writer_) { generator_to_writer(generator_, writer_); });
+	}
+
+	template<typename iterator_t>
+	static void range_to_file(
+		iterator_t begin_,
+		iterator_t end_,
+		typename traits::string_t const& path_,
+		bool pretty_ = false,
+		schema_p<encoding_v> schema_ = nullptr,
+		bool put_bom_ = false) {
+		impl::json_file file(path_, false);
+		auto stream = file.write_stream();
+		range_to_stream(begin_, end_, stream, pretty_, schema_, put_bom_);
+	}
+
+	template<typename element_t>
+	static void generator_to_file(
+		std::function<bool(element_t&)> const& generator_,
+		typename traits::string_t const& path_,
+		bool pretty_ = false,
+		schema_p<encoding_v> schema_ = nullptr,
+		bool put_bom_ = false) {
+		impl::json_file file(path_, false);
+		auto stream = file.write_stream();
+		generator_to_stream(generator_, stream, pretty_, schema_, put_bom_);
+	}
+
+	// exact length in bytes of what to_string/to_file would write, in this encoding and terse mode
+	// it goes through the same handlers as writing, so it costs about as much as writing without the I/O
+	// (worth it when the size can be reused, for example to presize a buffer for many similar documents)
+	template<typename target_t>
+	static size_t serialized_size(
+			target_t& target_,
+			bool pretty_ = false,
+			bool put_bom_ = false) {
+		impl::size_counting_stream counter;
+		to_stream(target_, counter, pretty_, nullptr, put_bom_);
+		return counter.size();
+	}
+
 	template<typename target_t>
 	inline static void to_string(
 			target_t& target_,
@@ -2141,7 +4545,22 @@ struct writer {
 		using namespace rapidjson;
 		StringBuffer ss;
 		to_stream(target_, ss, pretty_, schema_, put_bom_);
-		json = ss.GetString();
+		json_.assign(ss.GetString(), ss.GetSize());
+	}
+
+	// writes straight into json_, sized to size_ up front (from serialized_size, or an estimate)
+	// with the right size the output is allocated once and never copied, a wrong one still gives the right output
+	template<typename target_t>
+	inline static void to_presized_string(
+			target_t& target_,
+			typename traits::string_t& json_,
+			size_t size_,
+			bool pretty_ = false,
+			schema_p<encoding_v> schema_ = nullptr,
+			bool put_bom_ = false) {
+		impl::presized_string_stream<typename traits::string_t> stream(json_, size_);
+		to_stream(target_, stream, pretty_, schema_, put_bom_);
+		json_.resize(stream.size());
 	}
 
 	template<typename target_t>
@@ -2160,10 +4579,9 @@ struct writer {
 			bool pretty_ = false,
 			schema_p<encoding_v> schema_ = nullptr,
 			bool put_bom_ = false) {
-		using namespace rapidjson;
-		StringBuffer ss;
-		to_stream(target_, ss, pretty_, schema_, put_bom_);
-		return ss.GetString();
+		typename traits::string_t json;
+		to_string(target_, json, pretty_, schema_, put_bom_);
+		return json;
 	}
 
 	template<typename target_t>
@@ -2182,11 +4600,52 @@ struct writer {
 			bool pretty_ = false,
 			schema_p<encoding_v> schema_ = nullptr,
 			bool put_bom_ = false) {
+#if _AF_JSON_USE_ZLIB
+		to_file(target_, path_, json_compression::by_extension, pretty_, schema_, put_bom_);
+#else
 		// rapidjson documentation says this is how to open files
 		impl::json_file file(path_, false);
 		auto stream = file.write_stream();
 		to_stream(target_, stream, pretty_, schema_, put_bom_);
+#endif
+	}
+
+#if _AF_JSON_USE_ZLIB
+	template<typename target_t>
+	static void to_file(
+			target_t& target_,
+			typename traits::string_t const& path_,
+			json_compression compression_,
+			bool pretty_ = false,
+			schema_p<encoding_v> schema_ = nullptr,
+			bool put_bom_ = false) {
+		impl::json_file file(path_, false);
+		auto stream = file.write_stream();
+		if (impl::is_compressed(path_, compression_)) {
+			impl::gzip_write_stream<decltype(stream)> gzip_stream(stream);
+			to_stream(target_, gzip_stream, pretty_, schema_, put_bom_);
+			gzip_stream.finish();
+		}
+		else
+			to_stream(target_, stream, pretty_, schema_, put_bom_);
+	}
+
+	// gzip compressed JSON in memory
+	template<typename target_t>
+	static std::string to_compressed_string(
+			target_t& target_,
+			bool pretty_ = false,
+			schema_p<encoding_v> schema_ = nullptr,
+			bool put_bom_ = false) {
+		rapidjson::StringBuffer buffer;
+		{
+			impl::gzip_write_stream<rapidjson::StringBuffer> gzip_stream(buffer);
+			to_stream(target_, gzip_stream, pretty_, schema_, put_bom_);
+			gzip_stream.finish();
+		}
+		return std::string(buffer.GetString(), buffer.GetSize());
 	}
+#endif
 
 	template<typename target_t>
 	inline static void to_file(
@@ -2198,7 +4657,198 @@ struct writer {
 		to_file(*target_, path_, pretty_, schema_, put_bom_);
 	}
 
+	// same as to_file, but the file is written on a background thread while serialization goes on
+	template<typename target_t>
+	static void to_file_async(
+			target_t& target_,
+			typename traits::string_t const& path_,
+			async_write_policy policy_ = async_write_policy::buffered,
+			bool pretty_ = false,
+			schema_p<encoding_v> schema_ = nullptr,
+			bool put_bom_ = false) {
+		impl::async_file_write_stream stream(path_, policy_);
+		to_stream(target_, stream, pretty_, schema_, put_bom_);
+		stream.close();
+	}
+
 };
 
+#ifndef _WIN32
+// messages over file descriptors (pipes, socketpairs, unix domain sockets)
+// each message is a frame: 4 byte little endian length followed by the JSON
+// messages are serialized straight into a send buffer and parsed in place from the receive buffer,
+// both buffers are reused, so in steady state they don't allocate
+// the channel doesn't own the descriptors, closing them is up to the caller
+// a peer that went away is reported as an error on send, it never raises SIGPIPE
+template<json_encoding encoding_v = json_encoding::utf8>
+class framed_channel {
+	static const size_t prefix_size = 4;
+
+	// rapidjson output stream into the send buffer, behind the length prefix
+	class send_stream_t {
+		std::vector<char>& _buffer;
+	public:
+		typedef char Ch;
+		send_stream_t(std::vector<char>& buffer_) : _buffer(buffer_) {}
+		inline void Put(Ch c) { _buffer.push_back(c); }
+		inline void Flush() {}
+
+		// not implemented, same as rapidjson::FileWriteStream
+		char Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+		char Take() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+		char* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+		size_t PutEnd(char*) { RAPIDJSON_ASSERT(false); return 0; }
+	};
+
+	int const _read_fd;
+	int const _write_fd;
+	size_t const _max_frame_size;
+	std::vector<char> _send_buffer;
+	// received bytes live in [_begin, _end) of the receive buffer
+	// consumed frames move _begin forward, a partial frame is moved to the front only when we run out of space
+	std::vector<char> _receive_buffer;
+	size_t _begin;
+	size_t _end;
+	// cleared the first time send() tells us the write descriptor is not a socket
+	bool _write_is_socket;
+
+	// plain write with SIGPIPE blocked for this thread
+	// a SIGPIPE raised by our own write is consumed, one that was already pending is left alone
+	static inline ssize_t write_without_sigpipe(int fd_, char const* data_, size_t size_) {
+		sigset_t sigpipe_set, old_set, pending_set;
+		sigemptyset(&sigpipe_set);
+		sigaddset(&sigpipe_set, SIGPIPE);
+		sigpending(&pending_set);
+		bool const was_pending = sigismember(&pending_set, SIGPIPE) == 1;
+		pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+		ssize_t written = ::write(fd_, data_, size_);
+		int const error = errno;
+		if (written < 0 && error == EPIPE && !was_pending) {
+			sigpending(&pending_set);
+			int signal_number = 0;
+			if (sigismember(&pending_set, SIGPIPE) == 1)
+				sigwait(&sigpipe_set, &signal_number);
+		}
+		pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+		errno = error;
+		return written;
+	}
+	inline ssize_t write_some(char const* data_, size_t size_) {
+#ifdef MSG_NOSIGNAL
+		if (_write_is_socket) {
+			ssize_t sent = ::send(_write_fd, data_, size_, MSG_NOSIGNAL);
+			if (sent >= 0 || errno != ENOTSOCK)
+				return sent;
+			_write_is_socket = false;
+		}
+#endif
+		return write_without_sigpipe(_write_fd, data_, size_);
+	}
+	inline void write_all(char const* data_, size_t size_) {
+		while (size_ > 0) {
+			ssize_t written = write_some(data_, size_);
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EPIPE)
+					AF_ERROR("Failed to send a JSON message, the other side has closed the channel.");
+				else
+					AF_ERROR("Failed to send a JSON message: %", strerror(errno));
+				return;
+			}
+			data_ += written;
+			size_ -= static_cast<size_t>(written);
+		}
+	}
+	// reads whatever is available (at least one byte), returns false on end of input
+	bool receive_more() {
+		if (_end == _receive_buffer.size()) {
+			if (_begin > 0) {
+				std::copy(_receive_buffer.begin() + _begin, _receive_buffer.begin() + _end, _receive_buffer.begin());
+				_end -= _begin;
+				_begin = 0;
+			}
+			else
+				_receive_buffer.resize(_receive_buffer.size() * 2);
+		}
+		while (true) {
+			ssize_t received = ::read(_read_fd, _receive_buffer.data() + _end, _receive_buffer.size() - _end);
+			if (received < 0) {
+				if (errno == EINTR)
+					continue;
+				AF_ERROR("Failed to receive a JSON message: %", strerror(errno));
+			}
+			_end += static_cast<size_t>(received);
+			return received > 0;
+		}
+	}
+	inline size_t available() const { return _end - _begin; }
+	inline size_t frame_size() const {
+		auto p = reinterpret_cast<unsigned char const*>(_receive_buffer.data() + _begin);
+		return static_cast<size_t>(p[0]) | (static_cast<size_t>(p[1]) << 8) |
+			(static_cast<size_t>(p[2]) << 16) | (static_cast<size_t>(p[3]) << 24);
+	}
+public:
+	// sockets read and write on the same descriptor, leave write_fd_ out for those
+	framed_channel(
+			int read_fd_,
+			int write_fd_ = -1,
+			size_t buffer_size_ = 65536,
+			size_t max_frame_size_ = 0xFFFFFFFF) :
+		_read_fd(read_fd_),
+		_write_fd(write_fd_ == -1 ? read_fd_ : write_fd_),
+		_max_frame_size(max_frame_size_),
+		_receive_buffer((std::max)(buffer_size_, static_cast<size_t>(prefix_size))),
+		_begin(0),
+		_end(0),
+		_write_is_socket(true) {
+		_send_buffer.reserve(buffer_size_);
+	}
+
+	template<typename target_t>
+	void send(target_t& target_, schema_p<encoding_v> schema_ = nullptr) {
+		_send_buffer.resize(prefix_size);// keeps the capacity
+		send_stream_t stream(_send_buffer);
+		writer<encoding_v>::to_stream(target_, stream, false, schema_);
+		size_t size = _send_buffer.size() - prefix_size;
+		AF_ASSERT(size <= _max_frame_size, "JSON message of % bytes is too big to send.", size);
+		for (size_t i = 0; i < prefix_size; ++i)
+			_send_buffer[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+		write_all(_send_buffer.data(), _send_buffer.size());
+	}
+
+	// reads the next message into target_, returns false when the other side has closed the channel
+	template<typename target_t>
+	bool receive(target_t& target_, schema_p<encoding_v> schema_ = nullptr) {
+		while (available() < prefix_size)
+			if (!receive_more()) {
+				AF_ASSERT(available() == 0, "JSON message channel closed in the middle of a message.");
+				return false;
+			}
+		size_t size = frame_size();
+		AF_ASSERT(size <= _max_frame_size, "Received JSON message of % bytes is too big.", size);
+		if (_receive_buffer.size() < size + prefix_size)
+			_receive_buffer.resize(size + prefix_size);
+		while (available() < size + prefix_size)
+			AF_ASSERT(receive_more(), "JSON message channel closed in the middle of a message.");
+
+		rapidjson::MemoryStream stream(_receive_buffer.data() + _begin + prefix_size, size);
+		_begin += prefix_size + size;
+		if (_begin == _end)
+			_begin = _end = 0;
+		reader<encoding_v>::from_stream(target_, stream, schema_);
+		return true;
+	}
+};
+#endif
+
 } // namespace json
-} // namespace autotelica
\ No newline at end of file
+} // namespace autotelica
+
+namespace std {
+	template<>
+	struct hash<autotelica::json::interned_string_t> {
+		inline size_t operator()(autotelica::json::interned_string_t const& s_) const { return s_.hash(); }
+	};
+}
\ No newline at end of file
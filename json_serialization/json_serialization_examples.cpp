@@ -1,6 +1,10 @@
 
 #include "autotelica_core/util/include/testing_util.h"
 #include "autotelica_core/util/include/diagnostic_messages.h"
+#include <fstream>
+#include <sstream>
+#define _AF_JSON_SHARED_OBJECT_IDS true
+#include "json_serialization.h"
 
 namespace json_serialization {
     template< bool = true> // declaring it as a template is a way to work aroud c++ limitations about declaring things in headers
@@ -16,4 +20,681 @@ namespace json_serialization {
     }
 }
 
-AF_DECLARE_TEST_SET("json_serialization tests", json_serialization,json_serialization::examples<>() , json_serialization::tests<>());
\ No newline at end of file
+AF_DECLARE_TEST_SET("json_serialization tests", json_serialization,json_serialization::examples<>() , json_serialization::tests<>());
+
+namespace json_handler_cache {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    // owns its value through a pointer, so every instance points somewhere else
+    struct holder_t {
+        std::shared_ptr<int> _value;
+
+        holder_t() : _value(std::make_shared<int>(0)) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<holder_t, serialization_factory_t>("holder").
+                    member("value", &holder_t::_value).
+                end_object();
+            return description;
+        }
+        AF_IMPLEMENTS_JSON_HANDLER(holder_t);
+    };
+
+    // naked pointers don't own what they point to
+    struct raw_holder_t {
+        int* _value;
+
+        raw_holder_t() : _value(nullptr) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<raw_holder_t, serialization_factory_t>("raw_holder").
+                    member("value", &raw_holder_t::_value).
+                end_object();
+            return description;
+        }
+    };
+
+    // the holder lives in the same stack slot on every call, so the cached handler tree is reused for it
+    template< bool = true>
+    int read_through_stack_slot(std::string const& json_) {
+        holder_t holder;
+        reader<>::from_string(holder, json_);
+        return *holder._value;
+    }
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Cached handlers re-bind to the pointees of the object they are reused for.");
+        AF_TEST_RESULT(1, read_through_stack_slot("{\"value\":1}"));
+        AF_TEST_RESULT(2, read_through_stack_slot("{\"value\":2}"));
+        holder_t holder;
+        *holder._value = 3;
+        AF_TEST_RESULT(true, writer<>::to_string(holder).find("\"value\":3") != std::string::npos);
+        holder._value = std::make_shared<int>(4);
+        AF_TEST_RESULT(true, writer<>::to_string(holder).find("\"value\":4") != std::string::npos);
+        holder._value = nullptr;
+        AF_TEST_RESULT(true, writer<>::to_string(holder).find("\"value\":null") != std::string::npos);
+        raw_holder_t raw;
+        AF_TEST_RESULT(true, writer<>::to_string(raw).find("\"value\":null") != std::string::npos);
+        int five = 5;
+        raw._value = &five;
+        AF_TEST_RESULT(true, writer<>::to_string(raw).find("\"value\":5") != std::string::npos);
+    }
+}
+
+AF_DECLARE_TEST_SET("json handler cache", json_handler_cache, json_handler_cache::examples<>(), json_handler_cache::tests<>());
+
+namespace json_shared_objects {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct node_t {
+        int _value;
+
+        node_t() : _value(0) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<node_t, serialization_factory_t>("node").
+                    member("value", &node_t::_value, 0).
+                end_object();
+            return description;
+        }
+    };
+
+    struct graph_t {
+        std::shared_ptr<node_t> _first;
+        std::shared_ptr<node_t> _second;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<graph_t, serialization_factory_t>("graph").
+                    member("first", &graph_t::_first).
+                    member("second", &graph_t::_second).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+        graph_t graph;
+        graph._first = std::make_shared<node_t>();
+        graph._second = graph._first;
+        std::cout << writer<>::to_string(graph) << std::endl;
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Shared objects are written once and referenced by $id afterwards.");
+        graph_t graph;
+        graph._first = std::make_shared<node_t>();
+        graph._first->_value = 7;
+        graph._second = graph._first;
+        std::string const json = writer<>::to_string(graph);
+        AF_TEST_RESULT(true, json.find("\"$id\"") != std::string::npos);
+        AF_TEST_RESULT(true, json.find("\"$ref\"") != std::string::npos);
+
+        graph_t read;
+        reader<>::from_string(read, json);
+        AF_TEST_RESULT(true, read._first && read._first == read._second);
+        AF_TEST_RESULT(7, read._first->_value);
+
+        AF_TEST_COMMENT("Plain values, empty objects and nulls are read without ids.");
+        graph_t plain;
+        reader<>::from_string(plain, "{\"first\":{},\"second\":null}");
+        AF_TEST_RESULT(true, plain._first != nullptr);
+        AF_TEST_RESULT(0, plain._first->_value);
+        AF_TEST_RESULT(true, plain._second == nullptr);
+        reader<>::from_string(plain, "{\"first\":{\"value\":3},\"second\":{\"value\":3}}");
+        AF_TEST_RESULT(true, plain._first != plain._second);
+        AF_TEST_RESULT(3, plain._second->_value);
+    }
+}
+
+AF_DECLARE_TEST_SET("json shared objects", json_shared_objects, json_shared_objects::examples<>(), json_shared_objects::tests<>());
+
+#ifndef _WIN32
+namespace json_framed_channel {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct message_t {
+        int _id;
+        std::string _text;
+
+        message_t() : _id(0) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<message_t, serialization_factory_t>("message").
+                    member("id", &message_t::_id).
+                    member("text", &message_t::_text).
+                end_object();
+            return description;
+        }
+    };
+
+    // sends two messages from one end and reads them back on the other
+    template< bool = true>
+    bool round_trip(int read_fd_, int write_fd_) {
+        framed_channel<> sender(write_fd_);
+        framed_channel<> receiver(read_fd_, -1, 16);// smaller than a frame, so the receive buffer has to grow
+        message_t first, second, received;
+        first._id = 1;
+        first._text = "first";
+        second._id = 2;
+        second._text = std::string(100, 'x');
+        sender.send(first);
+        sender.send(second);
+        bool ok = receiver.receive(received) && received._id == 1 && received._text == "first";
+        ok = ok && receiver.receive(received) && received._id == 2 && received._text == second._text;
+        close(write_fd_);
+        return ok && !receiver.receive(received);
+    }
+
+    template< bool = true>
+    void examples() {
+        // the other side is gone, send reports it instead of taking the process down with SIGPIPE
+        int fds[2];
+        if (pipe(fds) != 0)
+            return;
+        close(fds[0]);
+        framed_channel<> channel(fds[1]);
+        message_t message;
+        try {
+            channel.send(message);
+        }
+        catch (std::runtime_error const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+        }
+        close(fds[1]);
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Messages are framed over pipes and sockets alike.");
+        int pipe_fds[2];
+        AF_TEST_RESULT(0, pipe(pipe_fds));
+        AF_TEST_RESULT(true, round_trip(pipe_fds[0], pipe_fds[1]));
+        close(pipe_fds[0]);
+        int socket_fds[2];
+        AF_TEST_RESULT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds));
+        AF_TEST_RESULT(true, round_trip(socket_fds[0], socket_fds[1]));
+        close(socket_fds[0]);
+    }
+}
+
+AF_DECLARE_TEST_SET("json framed channel", json_framed_channel, json_framed_channel::examples<>(), json_framed_channel::tests<>());
+#endif
+
+namespace json_batch_reading {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct document_t {
+        int _id;
+        std::string _name;
+        std::vector<int> _values;
+
+        document_t() : _id(0) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<document_t, serialization_factory_t>("document").
+                    member("id", &document_t::_id).
+                    member("name", &document_t::_name).
+                    member("values", &document_t::_values).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Documents read in parallel end up in their own targets, threads reuse their handlers.");
+        std::vector<std::string> jsons;
+        for (int i = 0; i < 16; ++i)
+            jsons.push_back("{\"id\":" + std::to_string(i) + ",\"name\":\"doc" + std::to_string(i) +
+                "\",\"values\":[" + std::to_string(i) + "," + std::to_string(i * i) + "]}");
+        std::vector<document_t> documents;
+        auto errors = reader<>::from_strings(jsons, documents, 3);
+        bool all_read = documents.size() == jsons.size();
+        for (size_t i = 0; all_read && i < documents.size(); ++i) {
+            int const n = static_cast<int>(i);
+            all_read = errors[i].empty() && documents[i]._id == n && documents[i]._name == "doc" + std::to_string(i) &&
+                documents[i]._values == std::vector<int>{ n, n * n };
+        }
+        AF_TEST_RESULT(true, all_read);
+    }
+}
+
+AF_DECLARE_TEST_SET("json batch reading", json_batch_reading, json_batch_reading::examples<>(), json_batch_reading::tests<>());
+
+namespace json_utf_input {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct text_t {
+        std::string _text;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<text_t, serialization_factory_t>("text").
+                    member("text", &text_t::_text).
+                end_object();
+            return description;
+        }
+    };
+
+    // {"text":"aaa...<U+1F600>"} with the surrogate pair of U+1F600 at code units 1023 and 1024,
+    // right across the transcoding block boundary, encoded little endian in unit_bytes_ bytes per code unit
+    template< bool = true>
+    std::string encode(size_t unit_bytes_, bool bom_) {
+        std::vector<uint32_t> units;
+        if (bom_)
+            units.push_back(0xFEFF);
+        for (char c : std::string("{\"text\":\""))
+            units.push_back(static_cast<uint32_t>(c));
+        while (units.size() < 1023)
+            units.push_back('a');
+        if (unit_bytes_ == 2) {
+            units.push_back(0xD83D);
+            units.push_back(0xDE00);
+        }
+        else
+            units.push_back(0x1F600);
+        units.push_back('"');
+        units.push_back('}');
+        units.push_back(0);
+        std::string bytes;
+        for (uint32_t unit : units)
+            for (size_t i = 0; i < unit_bytes_; ++i)
+                bytes.push_back(static_cast<char>((unit >> (8 * i)) & 0xFF));
+        return bytes;
+    }
+
+    template<json_encoding encoding_v>
+    std::string read_text(std::string const& bytes_) {
+        text_t target;
+        rapidjson::MemoryStream stream(bytes_.data(), bytes_.size());
+        reader<encoding_v>::from_stream(target, stream);
+        return target._text;
+    }
+
+    template< bool = true>
+    void examples() {
+        // a lone surrogate is reported by the reader, with its position in code units
+        std::string bytes = encode(2, false);
+        bytes[2 * 1024] = 'a';
+        bytes[2 * 1024 + 1] = '\0';
+        try {
+            read_text<json_encoding::utf16le>(bytes);
+        }
+        catch (std::runtime_error const& e) {
+            std::cout << "Exception: " << e.what() << std::endl;
+        }
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("UTF-16 and UTF-32 input is transcoded to UTF-8, including characters across transcoding blocks.");
+        std::string const expected = std::string(1023 - 9, 'a') + "\xF0\x9F\x98\x80";
+        AF_TEST_RESULT(true, read_text<json_encoding::utf16le>(encode(2, false)) == expected);
+        AF_TEST_RESULT(true, read_text<json_encoding::utf16le>(encode(2, true)).size() == expected.size() - 1);
+        AF_TEST_RESULT(true, read_text<json_encoding::utf32le>(encode(4, false)) == expected);
+    }
+}
+
+AF_DECLARE_TEST_SET("json UTF-16/UTF-32 input", json_utf_input, json_utf_input::examples<>(), json_utf_input::tests<>());
+
+namespace json_async_file_writing {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct series_t {
+        std::vector<int> _values;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<series_t, serialization_factory_t>("series").
+                    member("values", &series_t::_values).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    std::string file_content(std::string const& path_) {
+        std::ifstream in(path_, std::ios::binary);
+        std::stringstream content;
+        content << in.rdbuf();
+        return content.str();
+    }
+
+    // three documents in one file, each flushed at its end, through buffers much smaller than the output
+    template< bool = true>
+    bool write_documents(async_write_policy policy_) {
+        std::string const path = "json_async_file_writing.json";
+        series_t series;
+        std::string expected;
+        {
+            autotelica::json::impl::async_file_write_stream stream(path, policy_, 4096);
+            for (int d = 0; d < 3; ++d) {
+                series._values.resize(2000 + 100 * d, d);
+                writer<>::to_stream(series, stream);
+                expected += writer<>::to_string(series);
+            }
+            stream.close();
+        }
+        bool same = file_content(path) == expected;
+        std::remove(path.c_str());
+        return same;
+    }
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Asynchronous file writes produce the same output as writing to a string, whatever the policy.");
+        AF_TEST_RESULT(true, write_documents(async_write_policy::buffered));
+        AF_TEST_RESULT(true, write_documents(async_write_policy::sync_data));
+        AF_TEST_RESULT(true, write_documents(async_write_policy::direct));
+    }
+}
+
+AF_DECLARE_TEST_SET("json asynchronous file writing", json_async_file_writing, json_async_file_writing::examples<>(), json_async_file_writing::tests<>());
+
+#if _AF_JSON_USE_ZLIB
+namespace json_compressed_streams {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct samples_t {
+        std::string _name;
+        std::vector<int> _values;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<samples_t, serialization_factory_t>("samples").
+                    member("name", &samples_t::_name).
+                    member("values", &samples_t::_values).
+                end_object();
+            return description;
+        }
+    };
+
+    // big enough to go through several compression chunks
+    template< bool = true>
+    samples_t make_samples() {
+        samples_t samples;
+        samples._name = "samples";
+        for (int i = 0; i < 50000; ++i)
+            samples._values.push_back(i % 1000);
+        return samples;
+    }
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Compressed JSON reads back the same as it was written.");
+        samples_t samples = make_samples();
+        std::string const compressed = writer<>::to_compressed_string(samples);
+        AF_TEST_RESULT(true, compressed.size() > 2 &&
+            static_cast<unsigned char>(compressed[0]) == 0x1f && static_cast<unsigned char>(compressed[1]) == 0x8b);
+        AF_TEST_RESULT(true, compressed.size() < writer<>::to_string(samples).size());
+        samples_t read;
+        reader<>::from_compressed_string(read, compressed);
+        AF_TEST_RESULT(true, read._name == samples._name && read._values == samples._values);
+
+        AF_TEST_COMMENT("Files ending in .gz are compressed and decompressed transparently.");
+        std::string const path = "json_compressed_streams.json.gz";
+        writer<>::to_file(samples, path);
+        samples_t from_file;
+        reader<>::from_file(from_file, path);
+        std::remove(path.c_str());
+        AF_TEST_RESULT(true, from_file._name == samples._name && from_file._values == samples._values);
+    }
+}
+
+AF_DECLARE_TEST_SET("json compressed streams", json_compressed_streams, json_compressed_streams::examples<>(), json_compressed_streams::tests<>());
+#endif
+
+namespace json_interned_strings {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct trade_t {
+        interned_string_t _currency;
+        std::vector<interned_string_t> _venues;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<trade_t, serialization_factory_t>("trade").
+                    member("currency", &trade_t::_currency).
+                    member("venues", &trade_t::_venues).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Equal strings read into interned members share one pooled copy.");
+        trade_t first, second;
+        reader<>::from_string(first, "{\"currency\":\"interned_USD\",\"venues\":[\"interned_XLON\",\"interned_XNYS\"]}");
+        size_t const pooled = string_pool_t::global().size();
+        reader<>::from_string(second, "{\"currency\":\"interned_USD\",\"venues\":[\"interned_XNYS\",\"interned_XLON\"]}");
+        AF_TEST_RESULT(pooled, string_pool_t::global().size());
+        AF_TEST_RESULT(true, first._currency == second._currency);
+        AF_TEST_RESULT(true, first._currency.c_str() == second._currency.c_str());
+        AF_TEST_RESULT(true, first._venues[0] == second._venues[1] && first._venues[1] == second._venues[0]);
+        AF_TEST_RESULT(true, first._venues[0] != first._venues[1]);
+        AF_TEST_RESULT(true, first._currency == interned_string_t("interned_USD"));
+
+        AF_TEST_COMMENT("Interned strings are written as plain strings.");
+        AF_TEST_RESULT(true, writer<>::to_string(first).find("\"currency\":\"interned_USD\"") != std::string::npos);
+    }
+}
+
+AF_DECLARE_TEST_SET("json interned strings", json_interned_strings, json_interned_strings::examples<>(), json_interned_strings::tests<>());
+
+namespace json_array_streams {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct point_t {
+        int _x;
+        int _y;
+
+        point_t() : _x(0), _y(0) {}
+        point_t(int x_, int y_) : _x(x_), _y(y_) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<point_t, serialization_factory_t>("point").
+                    member("x", &point_t::_x).
+                    member("y", &point_t::_y).
+                end_object();
+            return description;
+        }
+    };
+
+    // the points are streamed, they are never all in memory at once
+    struct track_t {
+        std::string _name;
+        array_stream_t<point_t> _points;
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<track_t, serialization_factory_t>("track").
+                    member("name", &track_t::_name).
+                    member("points", &track_t::_points).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Ranges and generators are written as arrays, element by element.");
+        std::vector<int> const numbers{ 1, 2, 3 };
+        rapidjson::StringBuffer range_buffer;
+        writer<>::range_to_stream(numbers.begin(), numbers.end(), range_buffer);
+        AF_TEST_RESULT(std::string("[1,2,3]"), std::string(range_buffer.GetString()));
+        int next = 0;
+        rapidjson::StringBuffer generator_buffer;
+        writer<>::generator_to_stream<int>([&next](int& element_) { element_ = next * next; return ++next <= 4; }, generator_buffer);
+        AF_TEST_RESULT(std::string("[0,1,4,9]"), std::string(generator_buffer.GetString()));
+
+        AF_TEST_COMMENT("Array stream members pull elements from a source when writing and push them to a sink when reading.");
+        track_t track;
+        track._name = "track";
+        int written = 0;
+        track._points.set_source([&written](point_t& point_) {
+            point_ = point_t(written, -written);
+            return ++written <= 100;
+        });
+        std::string const json = writer<>::to_string(track);
+        std::vector<point_t> received;
+        track_t read;
+        read._points.set_sink([&received](point_t& point_) { received.push_back(point_); });
+        reader<>::from_string(read, json);
+        bool all_received = read._name == "track" && received.size() == 100;
+        for (size_t i = 0; all_received && i < received.size(); ++i)
+            all_received = received[i]._x == static_cast<int>(i) && received[i]._y == -static_cast<int>(i);
+        AF_TEST_RESULT(true, all_received);
+    }
+}
+
+AF_DECLARE_TEST_SET("json array streams", json_array_streams, json_array_streams::examples<>(), json_array_streams::tests<>());
+
+namespace json_lazy_view {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct order_t {
+        int _id;
+        std::string _venue;
+        std::vector<double> _prices;
+        std::map<std::string, int> _limits;
+
+        order_t() : _id(0) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<order_t, serialization_factory_t>("order").
+                    member("id", &order_t::_id).
+                    member("venue", &order_t::_venue).
+                    member("prices", &order_t::_prices).
+                    member("limits", &order_t::_limits).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Lazy views find members without decoding them and decode only what is asked for.");
+        std::string const json =
+            "{ \"id\" : 7, \"venue\":\"X\\\"LON\", \"prices\":[1.5, [2], {\"a\":3}], \"limits\":{\"min\":1,\"max\":{\"x\":\"}\"}}}";
+        std::string const typed_json = "{\"id\":7,\"venue\":\"XLON\",\"prices\":[1.5,2.5],\"limits\":{\"min\":1,\"max\":9}}";
+        lazy_view<order_t> skipped(json);
+        AF_TEST_RESULT(true, skipped.has("prices") && !skipped.has("price"));
+        AF_TEST_RESULT(std::string("[1.5, [2], {\"a\":3}]"), skipped.raw("prices"));
+        AF_TEST_RESULT(std::string("{\"min\":1,\"max\":{\"x\":\"}\"}}"), skipped.raw("limits"));
+        AF_TEST_RESULT(7, skipped.get(&order_t::_id));
+        AF_TEST_RESULT(std::string("X\"LON"), skipped.get(&order_t::_venue));
+
+        lazy_view<order_t> view(typed_json);
+        AF_TEST_RESULT(true, view.get(&order_t::_prices) == std::vector<double>{ 1.5, 2.5 });
+        AF_TEST_RESULT(9, view.get(&order_t::_limits).at("max"));
+        order_t const& order = view.object();
+        AF_TEST_RESULT(true, order._id == 7 && order._venue == "XLON");
+    }
+}
+
+AF_DECLARE_TEST_SET("json lazy view", json_lazy_view, json_lazy_view::examples<>(), json_lazy_view::tests<>());
+
+namespace json_presized_output {
+    using namespace autotelica::type_description;
+    using namespace autotelica::json;
+
+    struct quote_t {
+        std::string _symbol;
+        double _bid;
+        double _ask;
+        std::vector<int> _sizes;
+
+        quote_t() : _bid(0.0), _ask(0.0) {}
+
+        template<typename serialization_factory_t>
+        static type_description_t<serialization_factory_t> const& type_description() {
+            static const auto description =
+                begin_object<quote_t, serialization_factory_t>("quote").
+                    member("symbol", &quote_t::_symbol).
+                    member("bid", &quote_t::_bid).
+                    member("ask", &quote_t::_ask).
+                    member("sizes", &quote_t::_sizes).
+                end_object();
+            return description;
+        }
+    };
+
+    template< bool = true>
+    void examples() {
+    }
+    template< bool = true>
+    void tests() {
+        AF_TEST_COMMENT("Serialized sizes are exact and presized output is right whatever size it is given.");
+        quote_t quote;
+        quote._symbol = "ab\"c\n\xc3\xa9";
+        quote._bid = 99.125;
+        quote._ask = 1e-7;
+        quote._sizes = { 100, -200, 300000 };
+        std::string const json = writer<>::to_string(quote);
+        std::string const pretty_json = writer<>::to_string(quote, true);
+        AF_TEST_RESULT(json.size(), writer<>::serialized_size(quote));
+        AF_TEST_RESULT(pretty_json.size(), writer<>::serialized_size(quote, true));
+        std::string presized;
+        writer<>::to_presized_string(quote, presized, writer<>::serialized_size(quote));
+        AF_TEST_RESULT(json, presized);
+        writer<>::to_presized_string(quote, presized, 3);
+        AF_TEST_RESULT(json, presized);
+        writer<>::to_presized_string(quote, presized, 10 * json.size());
+        AF_TEST_RESULT(json, presized);
+    }
+}
+
+AF_DECLARE_TEST_SET("json presized output", json_presized_output, json_presized_output::examples<>(), json_presized_output::tests<>());